@@ -0,0 +1,37 @@
+#include "pico/time.h"
+
+#include "boot.h"
+
+
+static volatile uint32_t boot_us[BOOT_NUM_PHASES];
+
+static char const * const boot_phase_names[BOOT_NUM_PHASES] = {
+    "main",
+    "stdio",
+    "settings",
+    "display",
+    "first frame",
+    "i2c",
+    "husb238",
+    "hmi",
+    "first contract",
+    "warm restore",
+};
+
+
+void boot_mark(boot_phase_t phase) {
+    if (boot_us[phase] == 0) {
+        uint32_t us = time_us_32();
+        boot_us[phase] = (us == 0) ? 1 : us;
+    }
+}
+
+
+uint32_t boot_get_us(boot_phase_t phase) {
+    return boot_us[phase];
+}
+
+
+char const * boot_phase_name(boot_phase_t phase) {
+    return boot_phase_names[phase];
+}
@@ -0,0 +1,45 @@
+#ifndef __BOOT_H__
+#define __BOOT_H__
+
+#include <stdint.h>
+
+//
+// Boot-phase timestamps.
+//
+// Boot code calls `boot_mark()` as it reaches each phase.  Only the
+// first mark of each phase counts, so it's fine to mark a phase from
+// code that runs over and over (like "first contract" from the main
+// window's draw function).  Times are microseconds since the RP2040's
+// timer started, which is a few ms after power-on.
+//
+// The timestamps are shown on the Info window and can be read over
+// USB with USB_PROTO_OP_GET_BOOT_TIMES.
+//
+
+typedef enum {
+    BOOT_PHASE_MAIN,            // entered main()
+    BOOT_PHASE_STDIO,           // USB stdio initialized
+    BOOT_PHASE_SETTINGS,        // settings read from flash
+    BOOT_PHASE_DISPLAY,         // display initialized (core1)
+    BOOT_PHASE_FIRST_FRAME,     // first frame on the screen (core1)
+    BOOT_PHASE_I2C,             // i2c initialized
+    BOOT_PHASE_HUSB238,         // first successful contact with the HUSB238
+    BOOT_PHASE_HMI,             // HMI initialized, main loop about to start
+    BOOT_PHASE_FIRST_CONTRACT,  // first time we saw a PD contract
+    BOOT_PHASE_WARM_RESTORE,    // screen restored after a watchdog reset (see warmboot.h)
+    BOOT_NUM_PHASES
+} boot_phase_t;
+
+
+// Record that we've reached `phase`, unless we already have.
+// Safe to call from either core.
+void boot_mark(boot_phase_t phase);
+
+// Returns the time we reached `phase`, in microseconds since boot, or 0
+// if we haven't reached it yet.
+uint32_t boot_get_us(boot_phase_t phase);
+
+char const * boot_phase_name(boot_phase_t phase);
+
+
+#endif // __BOOT_H__
@@ -0,0 +1,68 @@
+#include "pico/time.h"
+
+#include "dlog.h"
+
+
+static_assert((DLOG_RING_WORDS & (DLOG_RING_WORDS - 1)) == 0, "DLOG_RING_WORDS must be a power of 2");
+
+static uint32_t dlog_ring[DLOG_RING_WORDS];
+
+// Free-running word counters, the ring index is the counter modulo
+// DLOG_RING_WORDS.  `dlog_head` is only written by `dlog_record()`,
+// `dlog_tail` is only written by `dlog_read()`.
+static volatile uint32_t dlog_head;
+static volatile uint32_t dlog_tail;
+
+static uint32_t dlog_dropped;
+
+
+void dlog_record(char const * fmt, uint32_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {
+    uint32_t head = dlog_head;
+    uint32_t offset = (uintptr_t)fmt - XIP_BASE;
+
+    // Not in the first 16 MB of flash, it would turn into some other
+    // format string, or garble nargs.
+    if (offset >= (1u << DLOG_FMT_OFFSET_BITS)) {
+        ++dlog_dropped;
+        return;
+    }
+
+    if ((DLOG_RING_WORDS - (head - dlog_tail)) < (2 + nargs)) {
+        ++dlog_dropped;
+        return;
+    }
+
+    dlog_ring[head++ % DLOG_RING_WORDS] = offset | (nargs << DLOG_FMT_OFFSET_BITS);
+    dlog_ring[head++ % DLOG_RING_WORDS] = time_us_32();
+    if (nargs > 0) dlog_ring[head++ % DLOG_RING_WORDS] = a0;
+    if (nargs > 1) dlog_ring[head++ % DLOG_RING_WORDS] = a1;
+    if (nargs > 2) dlog_ring[head++ % DLOG_RING_WORDS] = a2;
+    if (nargs > 3) dlog_ring[head++ % DLOG_RING_WORDS] = a3;
+
+    dlog_head = head;
+}
+
+
+size_t dlog_read(uint32_t * words, size_t max_words) {
+    uint32_t tail = dlog_tail;
+    uint32_t head = dlog_head;
+    size_t n = 0;
+
+    while (tail != head) {
+        uint32_t record_words = 2 + (dlog_ring[tail % DLOG_RING_WORDS] >> DLOG_FMT_OFFSET_BITS);
+        if (n + record_words > max_words) {
+            break;
+        }
+        for (uint32_t i = 0; i < record_words; ++i) {
+            words[n++] = dlog_ring[tail++ % DLOG_RING_WORDS];
+        }
+    }
+
+    dlog_tail = tail;
+    return n;
+}
+
+
+uint32_t dlog_get_dropped(void) {
+    return dlog_dropped;
+}
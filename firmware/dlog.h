@@ -0,0 +1,72 @@
+#ifndef __DLOG_H__
+#define __DLOG_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pico/types.h"
+
+//
+// Deferred binary logging.
+//
+// `DLOG("fmt", args...)` doesn't format anything on the device.  It
+// records the address of the format string, a timestamp, and up to
+// DLOG_MAX_ARGS raw 32-bit arguments in a RAM ring buffer, which costs
+// a few dozen cycles and never blocks.  If the ring is full the record
+// is dropped and counted.
+//
+// The ring is drained to the host over the USB serial protocol (see
+// usb_proto.h).  Format strings live in flash in static variables
+// named `dlog_fmt`, in section .rodata.dlog so they stay in flash even
+// inside functions placed in RAM (see hot.h); at build time
+// tools/dlog-extract finds them in the ELF and writes the table that
+// tools/dlog-decode uses to turn the records back into text.  A format
+// string whose offset doesn't fit in 24 bits can't be logged, and its
+// records are dropped and counted like those that don't fit in the
+// ring.
+//
+// Arguments are formatted on the host with printf-style conversions,
+// integers only (%d, %u, %x, %c, ...).
+//
+// Each record in the ring is:
+//     header (u32): format string offset from XIP_BASE (bits 0-23), nargs (bits 24-31)
+//     timestamp (u32): microseconds since boot
+//     args (u32 x nargs)
+//
+
+#define DLOG_MAX_ARGS 4
+
+// Format string offsets are this many bits of the record header.
+#define DLOG_FMT_OFFSET_BITS 24
+
+// Size of the ring buffer, in 32-bit words.  Must be a power of 2.
+#ifndef DLOG_RING_WORDS
+#define DLOG_RING_WORDS 512
+#endif
+
+#define DLOG_RECORD_MAX_WORDS (2 + DLOG_MAX_ARGS)
+
+
+void dlog_record(char const * fmt, uint32_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+// Copy as many whole records as fit into `words` (at most `max_words`
+// words) out of the ring.  Returns the number of words copied.
+size_t dlog_read(uint32_t * words, size_t max_words);
+
+// Total number of records dropped because the ring was full.
+uint32_t dlog_get_dropped(void);
+
+
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+#define DLOG_NARGS(...) DLOG_NARGS_(_, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+
+#define DLOG_ARGS_(_, a0, a1, a2, a3, ...) (uint32_t)(a0), (uint32_t)(a1), (uint32_t)(a2), (uint32_t)(a3)
+
+#define DLOG(fmt, ...) do { \
+    static_assert(DLOG_NARGS(__VA_ARGS__) <= DLOG_MAX_ARGS, "too many DLOG arguments"); \
+    static char const dlog_fmt[] __attribute__((used, section(".rodata.dlog"))) = fmt; \
+    dlog_record(dlog_fmt, DLOG_NARGS(__VA_ARGS__), DLOG_ARGS_(_, ##__VA_ARGS__, 0, 0, 0, 0)); \
+} while (0)
+
+
+#endif // __DLOG_H__
@@ -0,0 +1,226 @@
+#include <string.h>
+
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "hardware/watchdog.h"
+#include "pico/stdlib.h"
+
+#include "evlog.h"
+#include "perf.h"
+#include "usb_proto.h"
+
+
+typedef struct {
+    uint32_t ms;            // since boot
+    uint8_t type;           // evlog_event_t
+    uint8_t a;
+    uint16_t b;
+} evlog_record_t;
+
+typedef struct {
+    uint16_t magic;
+    uint16_t boot;
+    uint32_t seq;
+    evlog_record_t records[EVLOG_RECORDS_PER_PAGE];
+} evlog_page_t;
+
+static_assert(sizeof(evlog_page_t) == FLASH_PAGE_SIZE, "an event log page must be a flash page");
+
+#define PAGES_PER_SECTOR (FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE)
+#define NUM_PAGES (EVLOG_FLASH_SECTORS * PAGES_PER_SECTOR)
+
+// USB_PROTO_OP_EVLOG_READ sends half a page at a time.
+#define READ_CHUNK (FLASH_PAGE_SIZE / 2)
+
+static uint32_t flash_offset;
+static uint16_t boot;
+static uint32_t next_seq;
+
+// Events go into ram_pages[filling].  The other one may be full and
+// waiting for `evlog_poll()` to write it.
+static evlog_page_t ram_pages[2];
+static int filling;
+static int num_records;
+static bool full_waiting;
+static absolute_time_t first_record_at;
+static bool write_now;
+
+static uint32_t dropped;
+
+
+static evlog_page_t const * flash_page(uint32_t seq) {
+    return (evlog_page_t const *)(XIP_BASE + flash_offset + ((seq % NUM_PAGES) * FLASH_PAGE_SIZE));
+}
+
+
+static bool flash_page_valid(uint32_t seq) {
+    evlog_page_t const * p = flash_page(seq);
+    return (p->magic == EVLOG_MAGIC) && (p->seq == seq);
+}
+
+
+static void clear_page(evlog_page_t * p) {
+    memset(p, 0xff, sizeof(*p));
+    p->magic = EVLOG_MAGIC;
+    p->boot = boot;
+}
+
+
+// Write `p` as the next page of the ring, erasing the sector first if
+// it's the first page in it.
+static void write_page(evlog_page_t * p) {
+    uint32_t offset = flash_offset + ((next_seq % NUM_PAGES) * FLASH_PAGE_SIZE);
+
+    p->seq = next_seq;
+
+    uint32_t ints = save_and_disable_interrupts();
+    if ((next_seq % PAGES_PER_SECTOR) == 0) {
+        flash_range_erase(offset, FLASH_SECTOR_SIZE);
+    }
+    flash_range_program(offset, (uint8_t const *)p, FLASH_PAGE_SIZE);
+    restore_interrupts(ints);
+
+    perf_flash_written();
+    ++next_seq;
+}
+
+
+// The current page is full, hand it to `evlog_poll()` and start the
+// other one, if that one's been written.
+static void page_full(void) {
+    if (full_waiting) {
+        return;
+    }
+    full_waiting = true;
+    filling ^= 1;
+    clear_page(&ram_pages[filling]);
+    num_records = 0;
+}
+
+
+// The pages, oldest first: what's in flash and then what's still in
+// RAM.  Returns nullptr past the end.
+static uint8_t const * get_page(uint32_t index, uint32_t * num_pages) {
+    uint32_t oldest = (next_seq > NUM_PAGES) ? next_seq - NUM_PAGES : 0;
+    while ((oldest < next_seq) && !flash_page_valid(oldest)) {
+        ++oldest;
+    }
+
+    evlog_page_t const * ram[2];
+    int num_ram = 0;
+    if (full_waiting) {
+        ram[num_ram++] = &ram_pages[filling ^ 1];
+    }
+    if (num_records > 0) {
+        ram[num_ram++] = &ram_pages[filling];
+    }
+
+    uint32_t num_flash = next_seq - oldest;
+    *num_pages = num_flash + num_ram;
+
+    if (index < num_flash) {
+        return (uint8_t const *)flash_page(oldest + index);
+    }
+    if (index < *num_pages) {
+        return (uint8_t const *)ram[index - num_flash];
+    }
+    return nullptr;
+}
+
+
+static void handle_evlog_read(uint8_t seq, uint8_t const * payload, size_t len) {
+    if ((len != 3) || (payload[2] > 1)) {
+        usb_proto_error(USB_PROTO_OP_EVLOG_READ, seq, USB_PROTO_ERROR_BAD_LENGTH);
+        return;
+    }
+
+    uint32_t index = payload[0] | (payload[1] << 8);
+    uint32_t num_pages;
+    uint8_t const * page = get_page(index, &num_pages);
+
+    uint8_t reply[6 + READ_CHUNK];
+    usb_proto_put_u16(&reply[0], num_pages);
+    usb_proto_put_u32(&reply[2], dropped);
+    size_t r = 6;
+    if (page != nullptr) {
+        memcpy(&reply[r], page + (payload[2] * READ_CHUNK), READ_CHUNK);
+        r += READ_CHUNK;
+    }
+
+    usb_proto_reply(USB_PROTO_OP_EVLOG_READ, seq, reply, r);
+}
+
+
+void evlog_init(uint32_t offset) {
+    flash_offset = offset;
+
+    // Find the newest page.
+    bool found = false;
+    uint32_t newest_seq = 0;
+    uint16_t newest_boot = 0;
+    for (uint32_t i = 0; i < NUM_PAGES; ++i) {
+        evlog_page_t const * p = (evlog_page_t const *)(XIP_BASE + flash_offset + (i * FLASH_PAGE_SIZE));
+        if ((p->magic != EVLOG_MAGIC) || ((p->seq % NUM_PAGES) != i)) {
+            continue;
+        }
+        if (!found || (p->seq > newest_seq)) {
+            found = true;
+            newest_seq = p->seq;
+            newest_boot = p->boot;
+        }
+    }
+    next_seq = found ? newest_seq + 1 : 0;
+    boot = found ? newest_boot + 1 : 0;
+
+    filling = 0;
+    num_records = 0;
+    full_waiting = false;
+    clear_page(&ram_pages[0]);
+
+    evlog_add(EVLOG_BOOT, watchdog_caused_reboot() ? 1 : 0, 0);
+    write_now = true;
+
+    usb_proto_add_handler(USB_PROTO_OP_EVLOG_READ, handle_evlog_read);
+}
+
+
+void evlog_add(evlog_event_t type, uint8_t a, uint16_t b) {
+    if (num_records == EVLOG_RECORDS_PER_PAGE) {
+        ++dropped;
+        return;
+    }
+    if (num_records == 0) {
+        first_record_at = get_absolute_time();
+    }
+
+    evlog_record_t * record = &ram_pages[filling].records[num_records++];
+    record->ms = to_ms_since_boot(get_absolute_time());
+    record->type = type;
+    record->a = a;
+    record->b = b;
+
+    if (num_records == EVLOG_RECORDS_PER_PAGE) {
+        page_full();
+    }
+}
+
+
+void evlog_poll(void) {
+    // At most one page (and maybe a sector erase) per run.
+    if (full_waiting) {
+        write_page(&ram_pages[filling ^ 1]);
+        full_waiting = false;
+        if (num_records == EVLOG_RECORDS_PER_PAGE) {
+            page_full();
+        }
+        return;
+    }
+
+    if ((num_records == 0) || !(write_now || (absolute_time_diff_us(first_record_at, get_absolute_time()) >= EVLOG_FLUSH_MS * 1000ll))) {
+        return;
+    }
+    write_page(&ram_pages[filling]);
+    clear_page(&ram_pages[filling]);
+    num_records = 0;
+    write_now = false;
+}
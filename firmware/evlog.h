@@ -0,0 +1,79 @@
+#ifndef __EVLOG_H__
+#define __EVLOG_H__
+
+#include <stdint.h>
+
+//
+// Persistent event log, in a ring of flash pages.
+//
+// Unlike DLOG (see dlog.h), which is for debugging and gone after a
+// reset, this keeps a short history of what happened to the box in the
+// field: boots, the source attaching and detaching, contract changes,
+// PDO selections, bursts of i2c errors, brownouts and overheating.
+//
+// Each event is an 8-byte record: milliseconds since boot (u32), type
+// (u8), and two type-specific arguments (u8, u16).  Records collect in
+// a page-sized RAM buffer, and `evlog_poll()` writes each buffer to
+// flash when it's full, or EVLOG_FLUSH_MS after its first record if
+// things are quiet, so the log costs one page program per 31 events.
+// A boot record gets written right away, so a box that keeps
+// rebooting shows up.
+//
+// The flash area is EVLOG_FLASH_SECTORS sectors, written as a ring of
+// pages; starting a new sector erases it, dropping the oldest 16 pages
+// of events.  Each page starts with a header:
+//
+//     magic u16 (EVLOG_MAGIC), boot number u16, sequence number u32
+//
+// The boot number counts up with every boot (as far as the flash
+// remembers), the sequence number with every page written, and page
+// `seq % pages` is where a page lives, so at boot the newest page is
+// easy to find.
+//
+// The host reads the pages with USB_PROTO_OP_EVLOG_READ (see
+// usb_proto.h), `tools/pd_sink_box.py events` decodes them.
+//
+
+#ifndef EVLOG_FLASH_SECTORS
+#define EVLOG_FLASH_SECTORS 16
+#endif
+
+// Write a page that isn't full after this long anyway.
+#ifndef EVLOG_FLUSH_MS
+#define EVLOG_FLUSH_MS (10 * 60 * 1000)
+#endif
+
+#define EVLOG_MAGIC 0x4c45          // "EL"
+#define EVLOG_RECORDS_PER_PAGE 31
+
+typedef enum {
+    EVLOG_BOOT = 1,         // a: 1 if the watchdog rebooted us
+    EVLOG_ATTACH,
+    EVLOG_DETACH,
+    EVLOG_CONTRACT,         // a: max current / 50 mA, b: millivolts (0: no contract)
+    EVLOG_SELECT,           // the user chose a PDO.  a: PDO id, b: status (i16)
+    EVLOG_RESTORE,          // source restore chose a PDO.  a: PDO id, b: status (i16)
+    EVLOG_I2C_ERRORS,       // a burst just ended.  a: seconds it lasted, b: errors
+    EVLOG_SEQUENCE,         // a: 1 started (b: repeats), 0 ended (b: runs completed)
+    EVLOG_BROWNOUT,         // a: 1 began (b: VSYS mV), 0 ended (b: lowest VSYS mV)
+    EVLOG_OVERTEMP,         // a: 1 began, 0 ended.  b: temperature in 0.1 C
+    EVLOG_EMPTY = 0xff,     // unused record (erased flash)
+} evlog_event_t;
+
+
+// Finds where the log left off in the flash area at `flash_offset`
+// (which must be sector-aligned), records the boot, and registers the
+// USB protocol handler.  Safe to call before it's safe to write the
+// flash.
+void evlog_init(uint32_t flash_offset);
+
+// Add an event.  Never blocks or touches the flash.  If both RAM pages
+// are full the event is dropped and counted.
+void evlog_add(evlog_event_t type, uint8_t a, uint16_t b);
+
+// Background task: writes the RAM pages to flash when they're due.
+// Only run this once nothing else is executing from flash (core1).
+void evlog_poll(void);
+
+
+#endif // __EVLOG_H__
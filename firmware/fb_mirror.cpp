@@ -0,0 +1,172 @@
+#include <string.h>
+
+#include "pico/time.h"
+
+#include "fb_mirror.h"
+#include "fnv1a.h"
+#include "hot.h"
+#include "rle.h"
+#include "sched.h"
+#include "usb_proto.h"
+
+
+#ifndef FB_MIRROR_MAX_BYTES_PER_SEC
+#define FB_MIRROR_MAX_BYTES_PER_SEC (100 * 1000)
+#endif
+
+// Upper bound on how much work we do per trip through the main loop.
+#define FB_MIRROR_ROWS_PER_POLL 8
+
+// How often the task runs while mirroring.  It only runs then.
+#define FB_MIRROR_POLL_US 2000
+
+// The largest dimension of the display in any rotation.
+#define FB_MIRROR_MAX_ROWS 240
+
+// Row frame header: row u16, first x u16.
+#define FB_MIRROR_ROW_HEADER 4
+
+
+static hagl_backend_t * fb_mirror_display;
+static bool fb_mirror_enabled;
+static sched_task_t * fb_mirror_task;
+
+// Hash of each row as we last sent it, 0 means "never sent".
+static uint32_t row_hash[FB_MIRROR_MAX_ROWS];
+
+static int16_t fb_width;
+static int16_t fb_height;
+static int16_t scan_row;
+static bool frame_dirty;
+static uint16_t frame_number;
+
+// Token bucket for the bandwidth cap.
+static int32_t tokens;
+static absolute_time_t tokens_updated;
+
+static void fb_mirror_poll(void);
+
+
+// Never returns 0.
+static uint32_t HOT_FUNC(hash_row)(uint16_t const * pixels, int16_t width) {
+    uint32_t hash = fnv1a(FNV1A_INIT, pixels, width * sizeof(uint16_t));
+    if (hash == 0) {
+        hash = 1;
+    }
+    return hash;
+}
+
+
+// Returns false if the USB buffer filled up before the whole row went
+// out.
+static bool send_row(int16_t row, uint16_t const * pixels) {
+    uint8_t payload[USB_PROTO_MAX_PAYLOAD];
+    int16_t x = 0;
+
+    while (x < fb_width) {
+        size_t consumed;
+        size_t len = rle_encode(
+            &pixels[x],
+            fb_width - x,
+            &payload[FB_MIRROR_ROW_HEADER],
+            sizeof(payload) - FB_MIRROR_ROW_HEADER,
+            &consumed
+        );
+        usb_proto_put_u16(&payload[0], row);
+        usb_proto_put_u16(&payload[2], x);
+        if (!usb_proto_send(USB_PROTO_OP_FB_ROW, payload, FB_MIRROR_ROW_HEADER + len)) {
+            return false;
+        }
+
+        tokens -= FB_MIRROR_ROW_HEADER + len;
+        x += consumed;
+    }
+    return true;
+}
+
+
+static void handle_fb_mirror(uint8_t seq, uint8_t const * payload, size_t len) {
+    if (len != 1) {
+        usb_proto_error(USB_PROTO_OP_FB_MIRROR, seq, USB_PROTO_ERROR_BAD_LENGTH);
+        return;
+    }
+
+    fb_mirror_enabled = (payload[0] != 0);
+
+    // Start over with a full frame.
+    memset(row_hash, 0, sizeof(row_hash));
+    scan_row = 0;
+    frame_dirty = false;
+    tokens = 0;
+    tokens_updated = get_absolute_time();
+
+    if (fb_mirror_enabled) {
+        sched_start_periodic(fb_mirror_task, FB_MIRROR_POLL_US);
+    } else {
+        sched_cancel(fb_mirror_task);
+    }
+
+    usb_proto_reply(USB_PROTO_OP_FB_MIRROR, seq, nullptr, 0);
+}
+
+
+void fb_mirror_init(hagl_backend_t * display) {
+    fb_mirror_display = display;
+    fb_mirror_enabled = false;
+    fb_mirror_task = sched_task_create("fb mirror", fb_mirror_poll);
+    usb_proto_add_handler(USB_PROTO_OP_FB_MIRROR, handle_fb_mirror);
+}
+
+
+// Task: send what changed, within the bandwidth cap.
+static void fb_mirror_poll(void) {
+    if (!fb_mirror_enabled || (fb_mirror_display->buffer == nullptr)) {
+        return;
+    }
+
+    absolute_time_t now = get_absolute_time();
+    int64_t elapsed_us = absolute_time_diff_us(tokens_updated, now);
+    tokens_updated = now;
+    tokens += (elapsed_us * FB_MIRROR_MAX_BYTES_PER_SEC) / 1000000;
+    if (tokens > FB_MIRROR_MAX_BYTES_PER_SEC / 10) {
+        tokens = FB_MIRROR_MAX_BYTES_PER_SEC / 10;
+    }
+
+    // The screen was rotated, everything we sent is stale.
+    if ((fb_mirror_display->width != fb_width) || (fb_mirror_display->height != fb_height)) {
+        fb_width = fb_mirror_display->width;
+        fb_height = fb_mirror_display->height;
+        memset(row_hash, 0, sizeof(row_hash));
+        scan_row = 0;
+    }
+
+    if (fb_height > FB_MIRROR_MAX_ROWS) {
+        return;
+    }
+
+    for (int i = 0; (i < FB_MIRROR_ROWS_PER_POLL) && (tokens > 0); ++i) {
+        uint16_t const * pixels = (uint16_t const *)fb_mirror_display->buffer + (scan_row * fb_width);
+        uint32_t hash = hash_row(pixels, fb_width);
+
+        if (hash != row_hash[scan_row]) {
+            if (!send_row(scan_row, pixels)) {
+                // Try this row again next time.
+                return;
+            }
+            row_hash[scan_row] = hash;
+            frame_dirty = true;
+        }
+
+        ++scan_row;
+        if (scan_row >= fb_height) {
+            scan_row = 0;
+            if (frame_dirty) {
+                uint8_t payload[6];
+                usb_proto_put_u16(&payload[0], frame_number++);
+                usb_proto_put_u16(&payload[2], fb_width);
+                usb_proto_put_u16(&payload[4], fb_height);
+                frame_dirty = !usb_proto_send(USB_PROTO_OP_FB_FRAME, payload, sizeof(payload));
+            }
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef __FB_MIRROR_H__
+#define __FB_MIRROR_H__
+
+#include "hagl/backend.h"
+
+//
+// Mirror the display's framebuffer to the host over the USB serial
+// protocol, for bench automation and remote demos.
+//
+// The host turns mirroring on with USB_PROTO_OP_FB_MIRROR.  After
+// that, a background task walks the HAGL back buffer a few rows at a
+// time (between draws, so it never stalls rendering), hashes each
+// row, and sends the rows whose hash changed since they were last sent
+// as RLE-compressed USB_PROTO_OP_FB_ROW frames.  At the end of each
+// pass over the screen that changed anything it sends a
+// USB_PROTO_OP_FB_FRAME frame.  Enabling the mirror forgets all row
+// hashes, so the first frame is a full frame.
+//
+// The outgoing bandwidth is capped at FB_MIRROR_MAX_BYTES_PER_SEC so
+// mirroring doesn't crowd out the control traffic.
+//
+// tools/fb-mirror is the host side viewer/recorder.
+//
+
+// Registers the USB protocol handler, and creates the task that sends
+// rows while mirroring.
+void fb_mirror_init(hagl_backend_t * display);
+
+
+#endif // __FB_MIRROR_H__
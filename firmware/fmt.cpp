@@ -0,0 +1,63 @@
+#include "fmt.h"
+
+
+char * fmt_uint(char * p, uint32_t value, int min_digits) {
+    char digits[10];
+    int n = 0;
+
+    do {
+        digits[n++] = '0' + (value % 10);
+        value /= 10;
+    } while (value > 0);
+
+    while (min_digits > n) {
+        *p++ = '0';
+        --min_digits;
+    }
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+    *p = '\0';
+    return p;
+}
+
+
+char * fmt_int(char * p, int32_t value) {
+    if (value < 0) {
+        *p++ = '-';
+        return fmt_uint(p, -(uint32_t)value);
+    }
+    return fmt_uint(p, value);
+}
+
+
+char * fmt_fixed(char * p, uint32_t value, int decimals, int digits) {
+    uint32_t scale = 1;
+    for (int i = 0; i < decimals; ++i) {
+        scale *= 10;
+    }
+
+    p = fmt_uint(p, value / scale);
+    if (digits <= 0) {
+        return p;
+    }
+
+    uint32_t frac = value % scale;
+    for (int i = digits; i < decimals; ++i) {
+        frac /= 10;
+    }
+    for (int i = decimals; i < digits; ++i) {
+        frac *= 10;
+    }
+    *p++ = '.';
+    return fmt_uint(p, frac, digits);
+}
+
+
+char * fmt_str(char * p, char const * s) {
+    while (*s != '\0') {
+        *p++ = *s++;
+    }
+    *p = '\0';
+    return p;
+}
@@ -0,0 +1,33 @@
+#ifndef __FMT_H__
+#define __FMT_H__
+
+#include <stdint.h>
+
+//
+// Tiny integer-to-ASCII formatting, for building the strings the
+// windows draw without pulling printf (or floats) into every redraw.
+//
+// Each function writes at `p`, NUL-terminates, and returns a pointer
+// to the terminating NUL so calls can be chained:
+//
+//     char str[16];
+//     char * p = fmt_fixed(str, milliamps, 3, 2);   // "1.25"
+//     fmt_str(p, "A");                              // "1.25A"
+//
+// The caller makes sure the buffer is big enough.
+//
+
+// Decimal, at least `min_digits` digits (zero-padded).
+char * fmt_uint(char * p, uint32_t value, int min_digits = 1);
+
+// Signed decimal.
+char * fmt_int(char * p, int32_t value);
+
+// `value` is a fixed-point number with `decimals` implied decimal
+// places (e.g. milliamps has 3), written with `digits` digits after
+// the point (truncated, not rounded).
+char * fmt_fixed(char * p, uint32_t value, int decimals, int digits);
+
+char * fmt_str(char * p, char const * s);
+
+#endif // __FMT_H__
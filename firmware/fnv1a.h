@@ -0,0 +1,29 @@
+#ifndef __FNV1A_H__
+#define __FNV1A_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// 32-bit FNV-1a, for the cheap hashes that tell things apart: screen
+// rows, menus, sources.  Not for anything an attacker picks.
+//
+// Start from FNV1A_INIT and feed the data in as many pieces as is
+// handy, the result is the same as for one piece.  Inline so a
+// HOT_FUNC() caller (see hot.h) doesn't call out to flash.
+//
+
+#define FNV1A_INIT 2166136261u
+
+
+static inline uint32_t fnv1a(uint32_t hash, void const * data, size_t len) {
+    uint8_t const * p = (uint8_t const *)data;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+#endif // __FNV1A_H__
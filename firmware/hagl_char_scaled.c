@@ -38,10 +38,12 @@ SPDX-License-Identifier: MIT
 #include "hagl.h"
 #include "fontx.h"
 
+#include "hot.h"
+
 uint8_t
-hagl_put_char_scaled(void const *_surface, wchar_t code, int16_t x0, int16_t y0, hagl_color_t color, int scale, const uint8_t *font)
+HOT_FUNC(hagl_put_char_scaled)(void const *_surface, wchar_t code, int16_t x0, int16_t y0, hagl_color_t color, int scale, const uint8_t *font)
 {
-    static uint8_t *buffer = NULL;
+    static uint8_t buffer[HAGL_CHAR_BUFFER_SIZE] __attribute__((aligned(4)));
     const hagl_surface_t *surface = _surface;
     uint8_t set, status;
     hagl_bitmap_t bitmap;
@@ -53,11 +55,6 @@ hagl_put_char_scaled(void const *_surface, wchar_t code, int16_t x0, int16_t y0,
         return 0;
     }
 
-    /* Initialize character buffer when first called. */
-    if (NULL == buffer) {
-        buffer = calloc(HAGL_CHAR_BUFFER_SIZE, sizeof(uint8_t));
-    }
-
     hagl_bitmap_init(&bitmap, glyph.width, glyph.height, surface->depth, (uint8_t *)buffer);
 
     hagl_color_t *ptr = (hagl_color_t *) bitmap.buffer;
@@ -85,9 +82,9 @@ hagl_put_char_scaled(void const *_surface, wchar_t code, int16_t x0, int16_t y0,
  */
 
 uint16_t
-hagl_put_text_scaled(void const *surface, const wchar_t *str, int16_t x0, int16_t y0, hagl_color_t color, int scale, const unsigned char *font)
+HOT_FUNC(hagl_put_text_scaled)(void const *surface, const char *str, int16_t x0, int16_t y0, hagl_color_t color, int scale, const unsigned char *font)
 {
-    wchar_t temp;
+    unsigned char temp;
     uint8_t status;
     uint16_t original = x0;
     fontx_meta_t meta;
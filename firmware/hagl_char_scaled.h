@@ -72,7 +72,7 @@ hagl_put_char_scaled(void const *surface, wchar_t code, int16_t x0, int16_t y0,
  * https://github.com/tuupola/embedded-fonts
  *
  * @param surface
- * @param str pointer to an wide char string
+ * @param str pointer to a narrow (ASCII/Latin-1) string
  * @param x0
  * @param y0
  * @param color
@@ -80,7 +80,7 @@ hagl_put_char_scaled(void const *surface, wchar_t code, int16_t x0, int16_t y0,
  * @return width of the drawn string
  */
 uint16_t
-hagl_put_text_scaled(void const *surface, const wchar_t *str, int16_t x0, int16_t y0, hagl_color_t color, int scale, const unsigned char *font);
+hagl_put_text_scaled(void const *surface, const char *str, int16_t x0, int16_t y0, hagl_color_t color, int scale, const unsigned char *font);
 
 #ifdef __cplusplus
 }
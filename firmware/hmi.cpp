@@ -1,16 +1,207 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
 #include "pico/time.h"
 
 #include "hmi.h"
+#include "hmi_coro.h"
+#include "hot.h"
+#include "perf.h"
+#include "sched.h"
+#include "sysclock.h"
 #include "quadrature_encoder.pio.h"
 #include "button.pio.h"
 
 
-static hmi_window_t * hmi_windows;
+static hmi_window_ops_t const * hmi_ops;
 static int hmi_active_window;
 
+static bool need_redraw;
+static uint32_t hmi_draw_count;
+static uint32_t hmi_ignored_count;
+
+// How long the HMI stays at the boost clock after the last bit of
+// input or drawing.  This keeps us from bouncing the PLL between every
+// detent while the user is spinning the knob.
+#define HMI_BOOST_HOLD_MS 50
+
+// How often to look at the knob: often while the user is at it, and
+// rarely enough to let the core sleep while the HMI is idle (a first
+// click or detent waits at most that long).  The PIO programs count
+// and latch in hardware in the meantime.
+#define HMI_INPUT_POLL_MS 1
+#define HMI_INPUT_IDLE_POLL_MS 20
+
+static sched_task_t * hmi_input_task;
+static sched_task_t * hmi_redraw_task;
+static sched_task_t * hmi_idle_task;
+
+// Polling the knob every HMI_INPUT_POLL_MS, not HMI_INPUT_IDLE_POLL_MS.
+static bool hmi_input_fast;
+
+static int hmi_encoder_count;
+
+static void hmi_poll_input(void);
+
+// Events injected by `hmi_inject_event()`, waiting to be dispatched.
+#define HMI_MAX_INJECTED_EVENTS 8
+static hmi_event_t hmi_injected_events[HMI_MAX_INJECTED_EVENTS];
+static int hmi_injected_head;
+static int hmi_injected_tail;
+
+static void (*hmi_input_observer)(hmi_event_t event);
+
+static bool (*hmi_frame_cache_restore)(int id, uint32_t version);
+static void (*hmi_frame_cache_save)(int id, uint32_t version);
+
+
+// Called whenever the HMI is about to do some real work (handle input
+// or draw), switches to the boost clock if we're not there already.
+static void hmi_activity(void) {
+    sysclock_set_state(SYSCLOCK_BOOST);
+    sched_start_oneshot(hmi_idle_task, HMI_BOOST_HOLD_MS * 1000);
+    if (!hmi_input_fast) {
+        hmi_input_fast = true;
+        sched_start_periodic(hmi_input_task, HMI_INPUT_POLL_MS * 1000);
+    }
+}
+
+
+// Task: the HMI has been quiet for HMI_BOOST_HOLD_MS.
+static void hmi_idle(void) {
+    if (need_redraw) {
+        sched_start_oneshot(hmi_idle_task, HMI_BOOST_HOLD_MS * 1000);
+        return;
+    }
+    sysclock_set_state(SYSCLOCK_IDLE);
+    hmi_input_fast = false;
+    sched_start_periodic(hmi_input_task, HMI_INPUT_IDLE_POLL_MS * 1000);
+}
+
+
+// Task: the active window asked to be redrawn now.
+static void hmi_redraw_due(void) {
+    need_redraw = true;
+}
+
+
+// Deliver an input event to the active window.
+static void hmi_deliver(hmi_event_t event) {
+    hmi_activity();
+
+#if HMI_COROUTINES
+    if (hmi_coro_deliver_event(event)) {
+        need_redraw = true;
+        return;
+    }
+#endif
+
+    if (hmi_ops->event(hmi_active_window, event)) {
+        need_redraw = true;
+    } else {
+        ++hmi_ignored_count;
+    }
+}
+
+// The input task is a polling one, so this is where handling input
+// counts as busy time.
+static void hmi_dispatch(hmi_event_t event) {
+    uint32_t start = time_us_32();
+    hmi_deliver(event);
+    perf_busy_add(time_us_32() - start);
+}
+
+
+//
+// `hmi_window_ops_t` for a table of `hmi_window_t`.
+//
+
+static hmi_window_t * hmi_windows;
+
+static void hmi_table_init(void) {
+    for (int i = 0; hmi_windows[i].id != -1; ++i) {
+        if (hmi_windows[i].init != nullptr) {
+            hmi_windows[i].context = hmi_windows[i].init();
+        }
+    }
+}
+
+static uint32_t hmi_table_draw(int id) {
+    return hmi_windows[id].draw(hmi_windows[id].context);
+}
+
+static void hmi_table_selected(int id) {
+    if (hmi_windows[id].selected != nullptr) {
+        hmi_windows[id].selected(hmi_windows[id].context);
+    }
+}
+
+static bool hmi_table_event(int id, hmi_event_t event) {
+    hmi_window_t * w = &hmi_windows[id];
+    void (*handler)(void * context) = nullptr;
+
+    switch (event) {
+    case HMI_EVENT_CW:
+        handler = w->event_cw;
+        break;
+    case HMI_EVENT_CCW:
+        handler = w->event_ccw;
+        break;
+    case HMI_EVENT_CLICK:
+        handler = w->event_click;
+        break;
+    }
+
+    if (handler == nullptr) {
+        return false;
+    }
+    handler(w->context);
+    return true;
+}
+
+static bool hmi_table_text(int id, hmi_text_t * text) {
+    if (hmi_windows[id].text == nullptr) {
+        return false;
+    }
+    hmi_windows[id].text(hmi_windows[id].context, text);
+    return true;
+}
+
+static bool hmi_table_version(int id, uint32_t * version) {
+    if (hmi_windows[id].version == nullptr) {
+        return false;
+    }
+    *version = hmi_windows[id].version(hmi_windows[id].context);
+    return true;
+}
+
+static hmi_window_ops_t const hmi_table_ops = {
+    .init = hmi_table_init,
+    .draw = hmi_table_draw,
+    .selected = hmi_table_selected,
+    .event = hmi_table_event,
+    .text = hmi_table_text,
+    .version = hmi_table_version,
+};
+
 
 void hmi_init(hmi_window_t * windows) {
     hmi_windows = windows;
+    hmi_init_windows(&hmi_table_ops);
+}
+
+
+void hmi_init_windows(hmi_window_ops_t const * ops) {
+    hmi_ops = ops;
+
+    hmi_input_task = sched_task_create("hmi input", hmi_poll_input);
+    sched_task_set_polling(hmi_input_task, true);
+    hmi_redraw_task = sched_task_create("hmi redraw", hmi_redraw_due);
+    hmi_idle_task = sched_task_create("hmi idle", hmi_idle);
+#if HMI_COROUTINES
+    hmi_coro_init();
+#endif
 
     uint const encoder_gpio_a = 0;
     pio_add_program_at_offset(pio1, &quadrature_encoder_program, 0);
@@ -20,72 +211,191 @@ void hmi_init(hmi_window_t * windows) {
     pio_add_program_at_offset(pio0, &button_program, 0);
     button_init(pio0, 0, button_gpio);
 
-    for (int i = 0; hmi_windows[i].id != -1; ++i) {
-        if (hmi_windows[i].init != nullptr) {
-            hmi_windows[i].context = hmi_windows[i].init();
-        }
-    }
+    hmi_ops->init();
 
     hmi_set_active_window(0);
 }
 
 
+void hmi_request_redraw(void) {
+    need_redraw = true;
+}
+
+
 void hmi_set_active_window(int id) {
     hmi_active_window = id;
-    if (hmi_windows[id].selected != nullptr) {
-        hmi_windows[id].selected(hmi_windows[id].context);
+    need_redraw = true;
+    hmi_ops->selected(id);
+}
+
+
+int hmi_get_active_window(void) {
+    return hmi_active_window;
+}
+
+
+bool hmi_add_background_task(char const * name, void (*task)(void), uint32_t period_ms) {
+    sched_task_t * t = sched_task_create(name, task);
+    if (t == nullptr) {
+        return false;
     }
+    sched_start_periodic(t, period_ms * 1000);
+    return true;
 }
 
 
-void hmi_run(void) {
-    bool need_redraw = true;
-    absolute_time_t next_redraw = at_the_end_of_time;
+bool hmi_inject_event(hmi_event_t event) {
+    int next = (hmi_injected_head + 1) % HMI_MAX_INJECTED_EVENTS;
+    if (next == hmi_injected_tail) {
+        return false;
+    }
+    hmi_injected_events[hmi_injected_head] = event;
+    hmi_injected_head = next;
+    sched_post(hmi_input_task);
+    return true;
+}
 
-    int new_count, delta;
-    int old_count = quadrature_encoder_get_count();
 
-    while (true) {
-        if (!is_at_the_end_of_time(next_redraw)) {
-            if (absolute_time_diff_us(get_absolute_time(), next_redraw) < 0) {
-                need_redraw = true;
-            }
-        }
-        if (need_redraw) {
-            uint32_t ms_until_redraw;
-            need_redraw = false;
-            ms_until_redraw = hmi_windows[hmi_active_window].draw(hmi_windows[hmi_active_window].context);
-            if (ms_until_redraw == 0) {
-                next_redraw = at_the_end_of_time;
-            } else {
-                next_redraw = make_timeout_time_ms(ms_until_redraw);
-            }
+void hmi_set_frame_cache(bool (*restore)(int id, uint32_t version), void (*save)(int id, uint32_t version)) {
+    hmi_frame_cache_restore = restore;
+    hmi_frame_cache_save = save;
+}
+
+
+// Draw the active window, from the frame cache if possible.  Returns
+// the number of ms until the window wants to be redrawn, like `draw()`.
+static uint32_t hmi_draw(void) {
+    int id = hmi_active_window;
+    uint32_t version = 0;
+    bool cached = (hmi_frame_cache_restore != nullptr) && hmi_ops->version(id, &version);
+
+    if (cached && hmi_frame_cache_restore(id, version)) {
+        return 0;
+    }
+
+    uint32_t ms_until_redraw = hmi_ops->draw(id);
+
+    // If what the window shows changed while it was drawing, the frame
+    // doesn't belong to `version`.
+    uint32_t drawn_version;
+    if (cached && (ms_until_redraw == 0) && hmi_ops->version(id, &drawn_version) && (drawn_version == version)) {
+        hmi_frame_cache_save(id, version);
+    }
+
+    return ms_until_redraw;
+}
+
+
+void hmi_set_input_observer(void (*observer)(hmi_event_t event)) {
+    hmi_input_observer = observer;
+}
+
+
+// An event from the knob.
+static void hmi_input(hmi_event_t event) {
+    if (hmi_input_observer != nullptr) {
+        hmi_input_observer(event);
+    }
+    hmi_dispatch(event);
+}
+
+
+// Task: handle input from the knob, and injected events.
+static void hmi_poll_input(void) {
+    int new_count = quadrature_encoder_get_count();
+    int delta = new_count - hmi_encoder_count;
+    if (delta >= 4) {
+        hmi_input(HMI_EVENT_CCW);
+        hmi_encoder_count = new_count;
+    } else if (delta <= -4) {
+        hmi_input(HMI_EVENT_CW);
+        hmi_encoder_count = new_count;
+    }
+
+    uint32_t button_state;
+    if (button_get_state(button_state)) {
+        if (button_state == 0) {
+            hmi_input(HMI_EVENT_CLICK);
         }
+    }
+
+    if (hmi_injected_tail != hmi_injected_head) {
+        hmi_dispatch(hmi_injected_events[hmi_injected_tail]);
+        hmi_injected_tail = (hmi_injected_tail + 1) % HMI_MAX_INJECTED_EVENTS;
+    }
+}
+
+
+uint32_t hmi_get_draw_count(void) {
+    return hmi_draw_count;
+}
+
+
+uint32_t hmi_get_ignored_count(void) {
+    return hmi_ignored_count;
+}
+
+
+bool hmi_text(hmi_text_t * text) {
+    memset(text->cells, ' ', sizeof(text->cells));
+    return hmi_ops->text(hmi_active_window, text);
+}
+
+
+void hmi_text_printf(hmi_text_t * text, int row, int col, char const * fmt, ...) {
+    char str[HMI_TEXT_COLS + 1];
+    va_list ap;
+
+    if ((row < 0) || (row >= HMI_TEXT_ROWS) || (col >= HMI_TEXT_COLS)) {
+        return;
+    }
+
+    va_start(ap, fmt);
+    int len = vsnprintf(str, sizeof(str), fmt, ap);
+    va_end(ap);
+
+    if (len > HMI_TEXT_COLS) {
+        len = HMI_TEXT_COLS;
+    }
+    if (col < 0) {
+        col = (HMI_TEXT_COLS - len) / 2;
+    }
+
+    if (len > HMI_TEXT_COLS - col) {
+        len = HMI_TEXT_COLS - col;
+    }
+    if (len > 0) {
+        memcpy(&text->cells[row][col], str, len);
+    }
+}
+
+
+void HOT_FUNC(hmi_run)(void) {
+    hmi_encoder_count = quadrature_encoder_get_count();
+    hmi_activity();    // starts polling the knob
+
+    need_redraw = true;
+
+    while (true) {
+        sched_run();
 
-        new_count = quadrature_encoder_get_count();
-        delta = new_count - old_count;
-        if (delta >= 4) {
-            if (hmi_windows[hmi_active_window].event_ccw != nullptr) {
-                hmi_windows[hmi_active_window].event_ccw(hmi_windows[hmi_active_window].context);
-                need_redraw = true;
-            }
-            old_count = new_count;
-        } else if (delta <= -4) {
-            if (hmi_windows[hmi_active_window].event_cw != nullptr) {
-                hmi_windows[hmi_active_window].event_cw(hmi_windows[hmi_active_window].context);
-                need_redraw = true;
-            }
-            old_count = new_count;
+        if (!need_redraw) {
+            sched_sleep();
+            continue;
         }
 
-        uint32_t button_state;
-        if (button_get_state(button_state)) {
-            if (button_state == 0) {
-                if (hmi_windows[hmi_active_window].event_click != nullptr) {
-                    hmi_windows[hmi_active_window].event_click(hmi_windows[hmi_active_window].context);
-                    need_redraw = true;
-                }
-            }
+        need_redraw = false;
+        hmi_activity();
+        uint32_t start = time_us_32();
+        uint32_t ms_until_redraw = hmi_draw();
+        uint32_t us = time_us_32() - start;
+        perf_timer_record(PERF_DRAW, us);
+        perf_busy_add(us);
+        ++hmi_draw_count;
+        if (ms_until_redraw == 0) {
+            sched_cancel(hmi_redraw_task);
+        } else {
+            sched_start_oneshot(hmi_redraw_task, ms_until_redraw * 1000);
         }
     }
 }
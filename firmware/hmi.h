@@ -9,6 +9,30 @@
 // There is a list of "windows".  Each window has a draw() function,
 // and handlers for the clockwise/counter-clockwise/click events.
 //
+// The HMI reaches the windows through an `hmi_window_ops_t`.  Windows
+// written as types get one generated with static dispatch, see
+// hmi_window_set.h.  A table of `hmi_window_t` function pointers
+// (below) still works too, `hmi_init()` wraps it.
+//
+
+#include <stdint.h>
+
+
+typedef enum {
+    HMI_EVENT_CW,
+    HMI_EVENT_CCW,
+    HMI_EVENT_CLICK
+} hmi_event_t;
+
+
+// A text rendition of a window, for the serial console (see vt100.h).
+#define HMI_TEXT_ROWS 12
+#define HMI_TEXT_COLS 32
+
+typedef struct {
+    char cells[HMI_TEXT_ROWS][HMI_TEXT_COLS];
+} hmi_text_t;
+
 
 typedef struct {
     int id;
@@ -40,12 +64,102 @@ typedef struct {
     // Called when the user clicks the encoder knob, while this window
     // is active.
     void (*event_click)(void * context);
+
+    // `text()` renders the window as text into `text`, which has been
+    // cleared to all spaces.  Optional, windows without it show up
+    // blank on the serial console.
+    void (*text)(void * context, hmi_text_t * text);
+
+    // `version()` returns a number that changes whenever what `draw()`
+    // would draw changes.  Optional.  When the HMI has a frame cache
+    // (see `hmi_set_frame_cache()`), windows that have it can be
+    // redrawn from a snapshot instead of by calling `draw()`.  Only
+    // frames whose `draw()` returned 0, and whose version was the same
+    // after `draw()` as before, get cached.  It's called on every
+    // redraw, so it should be cheap: no i2c.
+    uint32_t (*version)(void * context);
 } hmi_window_t;
 
 
+// What the HMI does to the windows, by window id.  Window ids are
+// 0, 1, 2, ...
+typedef struct {
+    // Called once, from `hmi_init_windows()`.
+    void (*init)(void);
+
+    uint32_t (*draw)(int id);
+    void (*selected)(int id);
+
+    // Returns false if the window ignores the event, so it needn't be
+    // redrawn.
+    bool (*event)(int id, hmi_event_t event);
+
+    // Returns false if the window doesn't have a text rendition.
+    bool (*text)(int id, hmi_text_t * text);
+
+    // Returns false if the window doesn't have a version (and so can't
+    // be cached), see `hmi_window_t.version()`.
+    bool (*version)(int id, uint32_t * version);
+} hmi_window_ops_t;
+
+void hmi_init_windows(hmi_window_ops_t const * ops);
+
+// Compatibility shim for a table of `hmi_window_t`, ending with one
+// whose id is -1.
 void hmi_init(hmi_window_t * windows);
+
 void hmi_set_active_window(int id);
+
+int hmi_get_active_window(void);
+
+// Redraw the active window at the next opportunity, for when something
+// other than the window's own event handlers changed what it shows
+// (such as a coroutine, see hmi_coro.h).
+void hmi_request_redraw(void);
+
+// The main loop.  Everything other than drawing runs as a task of the
+// scheduler (see sched.h), including polling the knob and the windows'
+// redraw timeouts.  When there's nothing to do it sleeps until the next
+// task is due.
 void hmi_run(void);
 
+// Register a function for `hmi_run()` to call every `period_ms`, for
+// work that is not tied to any window (like talking to the host over
+// USB).  Background tasks must not block.  Returns false if there's no
+// room for another task.
+bool hmi_add_background_task(char const * name, void (*task)(void), uint32_t period_ms);
+
+// Queue an input event, to be handled as if it came from the knob.
+// Returns false if the queue is full.
+bool hmi_inject_event(hmi_event_t event);
+
+// `observer` gets called with every event that came from the knob
+// itself (not the injected ones), just before it's dispatched.  Used
+// for recording input, see replay.h.  nullptr to stop.
+void hmi_set_input_observer(void (*observer)(hmi_event_t event));
+
+// Hook up a frame cache (see snapshot.h).  `restore()` puts window
+// `id`'s cached frame for `version` on the screen and returns true, or
+// returns false if it doesn't have it; `save()` caches what `id` just
+// drew.
+void hmi_set_frame_cache(bool (*restore)(int id, uint32_t version), void (*save)(int id, uint32_t version));
+
+// Number of frames `hmi_run()` has drawn, by calling a window's draw()
+// or from the frame cache.
+uint32_t hmi_get_draw_count(void);
+
+// Number of events (from the knob or injected) that the active window
+// ignored, so that they didn't cause a draw.
+uint32_t hmi_get_ignored_count(void);
+
+// Render the active window as text.  Returns false if the window
+// doesn't have a text rendition.
+bool hmi_text(hmi_text_t * text);
+
+// printf into the text grid at the specified position, clipping at
+// the right edge.  A negative `col` centers the text on the row.
+void hmi_text_printf(hmi_text_t * text, int row, int col, char const * fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
 
 #endif // __HMI_H__
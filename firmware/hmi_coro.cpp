@@ -0,0 +1,168 @@
+#include "hmi_coro.h"
+
+#if HMI_COROUTINES
+
+#include "pico/stdlib.h"
+
+#include "dlog.h"
+#include "i2c_async.h"
+#include "sched.h"
+
+
+typedef enum {
+    WAIT_NONE,
+    WAIT_TIME,
+    WAIT_I2C_BUS,       // for the bus to be free, to start the transaction
+    WAIT_I2C_DONE,
+    WAIT_EVENT,
+} wait_t;
+
+// Every live coroutine waits for at most one thing, so one waiter per
+// frame is enough.
+static struct {
+    wait_t wait;
+    std::coroutine_handle<> handle;
+    absolute_time_t until;
+    hmi_coro_i2c_t * i2c;
+    hmi_coro_event_t * event;
+} waiters[HMI_CORO_MAX_FRAMES];
+
+static uint8_t frames[HMI_CORO_MAX_FRAMES][HMI_CORO_FRAME_BYTES] __attribute__((aligned(8)));
+static bool frame_in_use[HMI_CORO_MAX_FRAMES];
+
+static sched_task_t * resume_task;
+
+// Poll for finished waits this often while there are any.
+#define HMI_CORO_POLL_US 1000
+
+
+void * hmi_coro_alloc(size_t size) {
+    if (size > HMI_CORO_FRAME_BYTES) {
+        DLOG("coroutine frame too big: %u bytes", size);
+        return nullptr;
+    }
+    for (int i = 0; i < HMI_CORO_MAX_FRAMES; ++i) {
+        if (!frame_in_use[i]) {
+            frame_in_use[i] = true;
+            return frames[i];
+        }
+    }
+    DLOG("out of coroutine frames");
+    return nullptr;
+}
+
+
+void hmi_coro_free(void * frame) {
+    for (int i = 0; i < HMI_CORO_MAX_FRAMES; ++i) {
+        if (frame == frames[i]) {
+            frame_in_use[i] = false;
+        }
+    }
+}
+
+
+static int add_waiter(wait_t wait, std::coroutine_handle<> handle) {
+    for (int i = 0; i < HMI_CORO_MAX_FRAMES; ++i) {
+        if (waiters[i].wait == WAIT_NONE) {
+            waiters[i].wait = wait;
+            waiters[i].handle = handle;
+            if ((wait != WAIT_EVENT) && !sched_is_pending(resume_task)) {
+                sched_start_periodic(resume_task, HMI_CORO_POLL_US);
+            }
+            return i;
+        }
+    }
+    // Can't happen, there are as many waiters as frames.
+    return -1;
+}
+
+
+static void resume(int i) {
+    std::coroutine_handle<> handle = waiters[i].handle;
+    waiters[i].wait = WAIT_NONE;
+    handle.resume();
+}
+
+
+void hmi_coro_sleep_t::await_suspend(std::coroutine_handle<> handle) {
+    int i = add_waiter(WAIT_TIME, handle);
+    waiters[i].until = make_timeout_time_ms(ms);
+}
+
+
+void hmi_coro_i2c_t::await_suspend(std::coroutine_handle<> handle) {
+    int i = add_waiter(WAIT_I2C_BUS, handle);
+    waiters[i].i2c = this;
+}
+
+
+void hmi_coro_event_t::await_suspend(std::coroutine_handle<> handle) {
+    int i = add_waiter(WAIT_EVENT, handle);
+    waiters[i].event = this;
+}
+
+
+// Task: resume the coroutines whose wait is over.
+static void hmi_coro_poll(void) {
+    bool polling = false;
+
+    for (int i = 0; i < HMI_CORO_MAX_FRAMES; ++i) {
+        switch (waiters[i].wait) {
+        case WAIT_NONE:
+        case WAIT_EVENT:
+            break;
+
+        case WAIT_TIME:
+            if (time_reached(waiters[i].until)) {
+                resume(i);
+            }
+            break;
+
+        case WAIT_I2C_BUS: {
+            hmi_coro_i2c_t * t = waiters[i].i2c;
+            if (i2c_async_start(t->i2c, t->addr, t->src, t->src_len, t->dst, t->dst_len)) {
+                waiters[i].wait = WAIT_I2C_DONE;
+            }
+            break;
+        }
+
+        case WAIT_I2C_DONE: {
+            int r = i2c_async_poll();
+            if (r != I2C_ASYNC_BUSY) {
+                waiters[i].i2c->result = r;
+                resume(i);
+            }
+            break;
+        }
+        }
+    }
+
+    // Resuming may have added waits, look again.
+    for (int i = 0; i < HMI_CORO_MAX_FRAMES; ++i) {
+        if ((waiters[i].wait != WAIT_NONE) && (waiters[i].wait != WAIT_EVENT)) {
+            polling = true;
+        }
+    }
+    if (!polling) {
+        sched_cancel(resume_task);
+    }
+}
+
+
+void hmi_coro_init(void) {
+    resume_task = sched_task_create("hmi coroutines", hmi_coro_poll);
+}
+
+
+bool hmi_coro_deliver_event(hmi_event_t event) {
+    for (int i = 0; i < HMI_CORO_MAX_FRAMES; ++i) {
+        if (waiters[i].wait == WAIT_EVENT) {
+            waiters[i].event->event = event;
+            resume(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif // HMI_COROUTINES
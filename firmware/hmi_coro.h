@@ -0,0 +1,136 @@
+#ifndef __HMI_CORO_H__
+#define __HMI_CORO_H__
+
+//
+// Coroutine window handlers.
+//
+// Window handlers are plain callbacks that run to completion, so a
+// multi-step operation (select a PDO, wait for the contract, read back
+// the result) either blocks input and drawing for its whole duration,
+// or has to be cut up into a state machine by hand.
+//
+// In builds with HMI_COROUTINES (C++20, off by default, see
+// CMakeLists.txt) a handler can instead start a coroutine: a function
+// returning `hmi_coro_t` that `co_await`s
+//
+//     hmi_coro_sleep_ms(ms)     a timer
+//     hmi_coro_i2c(...)         a non-blocking i2c transaction (see i2c_async.h),
+//                               resuming with PICO_OK or an error
+//     hmi_coro_next_event()     the next knob event, which then doesn't
+//                               go to the active window's handlers
+//
+// and reads top to bottom.  The HMI main loop resumes waiting
+// coroutines from a scheduler task (see sched.h) while it keeps
+// handling input and drawing in between.
+//
+// Coroutines start running right away and free themselves when they
+// finish; nobody waits for them.  Their frames come from a static pool
+// of HMI_CORO_MAX_FRAMES, when that's exhausted (or a frame is bigger
+// than HMI_CORO_FRAME_BYTES) the coroutine doesn't run at all and the
+// returned `hmi_coro_t` has `started` false.  Coroutines must not
+// return while the window they belong to could go away under them;
+// windows here are static, so that's easy.
+//
+
+#ifndef HMI_COROUTINES
+#define HMI_COROUTINES 0
+#endif
+
+#if HMI_COROUTINES
+
+#include <coroutine>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hardware/i2c.h"
+
+#include "hmi.h"
+
+#ifndef HMI_CORO_MAX_FRAMES
+#define HMI_CORO_MAX_FRAMES 4
+#endif
+
+#ifndef HMI_CORO_FRAME_BYTES
+#define HMI_CORO_FRAME_BYTES 256
+#endif
+
+
+void * hmi_coro_alloc(size_t size);
+void hmi_coro_free(void * frame);
+
+struct hmi_coro_t {
+    struct promise_type {
+        hmi_coro_t get_return_object(void) { return hmi_coro_t { true }; }
+        static hmi_coro_t get_return_object_on_allocation_failure(void) { return hmi_coro_t { false }; }
+        std::suspend_never initial_suspend(void) noexcept { return {}; }
+        std::suspend_never final_suspend(void) noexcept { return {}; }
+        void return_void(void) {}
+        void unhandled_exception(void) {}
+
+        static void * operator new(size_t size) noexcept { return hmi_coro_alloc(size); }
+        static void operator delete(void * frame) { hmi_coro_free(frame); }
+    };
+
+    bool started;
+};
+
+
+// Awaiters, use them through the functions below.
+
+struct hmi_coro_sleep_t {
+    uint32_t ms;
+
+    bool await_ready(void) { return ms == 0; }
+    void await_suspend(std::coroutine_handle<> handle);
+    void await_resume(void) {}
+};
+
+struct hmi_coro_i2c_t {
+    i2c_inst_t * i2c;
+    uint8_t addr;
+    uint8_t const * src;
+    size_t src_len;
+    uint8_t * dst;
+    size_t dst_len;
+    int result;
+
+    bool await_ready(void) { return false; }
+    void await_suspend(std::coroutine_handle<> handle);
+    int await_resume(void) { return result; }
+};
+
+struct hmi_coro_event_t {
+    hmi_event_t event;
+
+    bool await_ready(void) { return false; }
+    void await_suspend(std::coroutine_handle<> handle);
+    hmi_event_t await_resume(void) { return event; }
+};
+
+
+static inline hmi_coro_sleep_t hmi_coro_sleep_ms(uint32_t ms) {
+    return hmi_coro_sleep_t { ms };
+}
+
+// Write `src`, then read `dst_len` bytes into `dst`, like
+// `i2c_async_start()`.  Waits for the bus if another coroutine is using
+// it.  The buffers must live in the coroutine (or longer).
+static inline hmi_coro_i2c_t hmi_coro_i2c(i2c_inst_t * i2c, uint8_t addr, uint8_t const * src, size_t src_len, uint8_t * dst, size_t dst_len) {
+    return hmi_coro_i2c_t { i2c, addr, src, src_len, dst, dst_len, PICO_ERROR_GENERIC };
+}
+
+static inline hmi_coro_event_t hmi_coro_next_event(void) {
+    return hmi_coro_event_t { HMI_EVENT_CLICK };
+}
+
+
+// Creates the scheduler task that resumes coroutines.
+void hmi_coro_init(void);
+
+// Called by the HMI with every input event.  Returns true if a
+// coroutine was waiting for it and got it.
+bool hmi_coro_deliver_event(hmi_event_t event);
+
+#endif // HMI_COROUTINES
+
+#endif // __HMI_CORO_H__
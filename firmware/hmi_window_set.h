@@ -0,0 +1,177 @@
+#ifndef __HMI_WINDOW_SET_H__
+#define __HMI_WINDOW_SET_H__
+
+//
+// Windows as types, with static dispatch.
+//
+// A window is a struct that derives from `hmi_window` and hides
+// whichever of its handlers it implements.  Whatever the window keeps
+// between calls is plain members, there's no separate context.
+//
+//     struct window_foo_t : hmi_window {
+//         static constexpr int id = WINDOW_FOO;
+//         int count;
+//
+//         uint32_t draw(void) { ... }
+//         void event_cw(void) { ++count; }
+//     };
+//
+// `hmi_window_set<window_foo_t, window_bar_t, ...>` holds one of each
+// window, by value, in static storage, and its `ops` member is what
+// `hmi_init_windows()` wants.  Those functions pick the window with a
+// chain of id comparisons the compiler turns into a switch, and the
+// handlers are inlined into it, so the knob-to-draw path makes no
+// calls through function pointers other than the one into `ops`.
+//
+// A window's id is its position in the list, and every window type
+// says which one it expects as `static constexpr int id`.
+//
+// Handlers that a window doesn't implement behave like the nullptr
+// ones in an `hmi_window_t`: events it ignores don't cause a redraw,
+// a window without `text()` shows up blank on the serial console, and
+// one without `version()` never gets drawn from the frame cache.
+//
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "hmi.h"
+
+
+// The handlers a window can have, see `hmi_window_t` for what they do.
+struct hmi_window {
+    void init(void) {}
+    uint32_t draw(void) { return 0; }
+    void selected(void) {}
+    void event_cw(void) {}
+    void event_ccw(void) {}
+    void event_click(void) {}
+    void text(hmi_text_t * text) {}
+    uint32_t version(void) { return 0; }
+};
+
+// True if window type `W` has its own `handler` instead of the
+// do-nothing one from `hmi_window`.
+#define HMI_WINDOW_HAS(W, handler) \
+    (!std::is_same<decltype(&W::handler), decltype(&hmi_window::handler)>::value)
+
+
+template <typename... Windows, size_t... I>
+constexpr bool hmi_window_ids_match(std::index_sequence<I...>) {
+    return ((Windows::id == (int)I) && ...);
+}
+
+
+template <typename... Windows>
+struct hmi_window_set {
+    static_assert(
+        hmi_window_ids_match<Windows...>(std::index_sequence_for<Windows...>{}),
+        "each window's id must be its position in the list"
+    );
+
+    static std::tuple<Windows...> windows;
+    static hmi_window_ops_t const ops;
+
+    template <typename W>
+    static W & get(void) {
+        return std::get<W>(windows);
+    }
+
+private:
+    // Call `f` with the window whose id is `id`.
+    template <typename F, size_t... I>
+    static inline void visit(int id, F const & f, std::index_sequence<I...>) {
+        (void)(((id == (int)I) ? (f(std::get<I>(windows)), true) : false) || ...);
+    }
+
+    template <typename F>
+    static inline void visit(int id, F const & f) {
+        visit(id, f, std::index_sequence_for<Windows...>{});
+    }
+
+    static void init(void) {
+        std::apply([](Windows &... w) { (w.init(), ...); }, windows);
+    }
+
+    static uint32_t draw(int id) {
+        uint32_t ms_until_redraw = 0;
+        visit(id, [&](auto & w) { ms_until_redraw = w.draw(); });
+        return ms_until_redraw;
+    }
+
+    static void selected(int id) {
+        visit(id, [](auto & w) { w.selected(); });
+    }
+
+    static bool event(int id, hmi_event_t event) {
+        bool handled = false;
+        visit(id, [&](auto & w) {
+            using W = std::remove_reference_t<decltype(w)>;
+            switch (event) {
+            case HMI_EVENT_CW:
+                if constexpr (HMI_WINDOW_HAS(W, event_cw)) {
+                    w.event_cw();
+                    handled = true;
+                }
+                break;
+            case HMI_EVENT_CCW:
+                if constexpr (HMI_WINDOW_HAS(W, event_ccw)) {
+                    w.event_ccw();
+                    handled = true;
+                }
+                break;
+            case HMI_EVENT_CLICK:
+                if constexpr (HMI_WINDOW_HAS(W, event_click)) {
+                    w.event_click();
+                    handled = true;
+                }
+                break;
+            }
+        });
+        return handled;
+    }
+
+    static bool text(int id, hmi_text_t * text) {
+        bool has_text = false;
+        visit(id, [&](auto & w) {
+            using W = std::remove_reference_t<decltype(w)>;
+            if constexpr (HMI_WINDOW_HAS(W, text)) {
+                w.text(text);
+                has_text = true;
+            }
+        });
+        return has_text;
+    }
+
+    static bool version(int id, uint32_t * version) {
+        bool has_version = false;
+        visit(id, [&](auto & w) {
+            using W = std::remove_reference_t<decltype(w)>;
+            if constexpr (HMI_WINDOW_HAS(W, version)) {
+                *version = w.version();
+                has_version = true;
+            }
+        });
+        return has_version;
+    }
+};
+
+template <typename... Windows>
+std::tuple<Windows...> hmi_window_set<Windows...>::windows;
+
+template <typename... Windows>
+hmi_window_ops_t const hmi_window_set<Windows...>::ops = {
+    .init = init,
+    .draw = draw,
+    .selected = selected,
+    .event = event,
+    .text = text,
+    .version = version,
+};
+
+
+#endif // __HMI_WINDOW_SET_H__
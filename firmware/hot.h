@@ -0,0 +1,30 @@
+#ifndef __HOT_H__
+#define __HOT_H__
+
+#include "pico/platform.h"
+
+//
+// Placement of hot code in SRAM.
+//
+// Everything normally runs straight from flash through the 16 KB XIP
+// cache, so the code that runs for every pixel or every trip through
+// the main loop competes for the cache with cold code like
+// `swprintf()`, and frame times jitter with the cache misses.
+//
+// Wrap the name of a hot function in `HOT_FUNC()` to have it copied to
+// SRAM at boot when the firmware is built with HOT_IN_RAM (the
+// default, see CMakeLists.txt).  Without HOT_IN_RAM it's a no-op, which
+// is handy for comparing XIP cache hit rates (see xip_stats.h).
+//
+// Keep the list short, SRAM is shared with the framebuffers.  The
+// build writes a report of what landed where to
+// `pd-sink-box.placement.txt` (see tools/symbol-placement).
+//
+
+#if HOT_IN_RAM
+#define HOT_FUNC(name) __not_in_flash_func(name)
+#else
+#define HOT_FUNC(name) name
+#endif
+
+#endif // __HOT_H__
@@ -0,0 +1,110 @@
+#include "pico/stdlib.h"
+
+#include "i2c_async.h"
+#include "perf.h"
+
+
+typedef enum {
+    I2C_ASYNC_IDLE,
+    I2C_ASYNC_RUNNING,
+    I2C_ASYNC_DONE,     // finished, result not collected yet
+} i2c_async_state_t;
+
+static i2c_async_state_t state;
+static i2c_hw_t * hw;
+static uint8_t * rx_dst;
+static size_t rx_len;
+static absolute_time_t deadline;
+static int result;
+
+
+bool i2c_async_start(i2c_inst_t * i2c, uint8_t addr, uint8_t const * src, size_t src_len, uint8_t * dst, size_t dst_len) {
+    if ((state != I2C_ASYNC_IDLE) || (src_len == 0) || (src_len + dst_len > I2C_ASYNC_MAX_BYTES)) {
+        return false;
+    }
+
+    hw = i2c_get_hw(i2c);
+    rx_dst = dst;
+    rx_len = dst_len;
+    deadline = make_timeout_time_us(I2C_ASYNC_TIMEOUT_US);
+
+    // Same as the SDK: the target address can only change while the
+    // controller is disabled.
+    hw->enable = 0;
+    hw->tar = addr;
+    hw->enable = I2C_IC_ENABLE_ENABLE_BITS;
+
+    (void)hw->clr_stop_det;
+    (void)hw->clr_tx_abrt;
+
+    for (size_t i = 0; i < src_len; ++i) {
+        bool last = (i == src_len - 1) && (dst_len == 0);
+        hw->data_cmd = (last ? I2C_IC_DATA_CMD_STOP_BITS : 0) | src[i];
+    }
+    for (size_t i = 0; i < dst_len; ++i) {
+        hw->data_cmd =
+            ((i == 0) ? I2C_IC_DATA_CMD_RESTART_BITS : 0)
+            | ((i == dst_len - 1) ? I2C_IC_DATA_CMD_STOP_BITS : 0)
+            | I2C_IC_DATA_CMD_CMD_BITS;
+    }
+
+    perf_i2c_transaction();
+    state = I2C_ASYNC_RUNNING;
+    return true;
+}
+
+
+// Check on the transaction in flight, and collect its result if it's
+// done.
+static void check(void) {
+    if (!(hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS)) {
+        if (time_reached(deadline)) {
+            // Stop the transfer and flush the FIFOs.
+            hw_set_bits(&hw->enable, I2C_IC_ENABLE_ABORT_BITS);
+            while (hw->enable & I2C_IC_ENABLE_ABORT_BITS) {
+                tight_loop_contents();
+            }
+            (void)hw->clr_tx_abrt;
+            result = PICO_ERROR_TIMEOUT;
+            state = I2C_ASYNC_DONE;
+        }
+        return;
+    }
+    (void)hw->clr_stop_det;
+
+    // The controller sends a STOP after an abort (no acknowledge) too.
+    if (hw->tx_abrt_source != 0) {
+        (void)hw->clr_tx_abrt;
+        result = PICO_ERROR_GENERIC;
+    } else {
+        for (size_t i = 0; i < rx_len; ++i) {
+            rx_dst[i] = (uint8_t)hw->data_cmd;
+        }
+        result = PICO_OK;
+    }
+    state = I2C_ASYNC_DONE;
+}
+
+
+int i2c_async_poll(void) {
+    if (state == I2C_ASYNC_RUNNING) {
+        check();
+    }
+    if (state != I2C_ASYNC_DONE) {
+        return I2C_ASYNC_BUSY;
+    }
+    state = I2C_ASYNC_IDLE;
+    return result;
+}
+
+
+bool i2c_async_busy(void) {
+    return state != I2C_ASYNC_IDLE;
+}
+
+
+void i2c_async_finish(void) {
+    while (state == I2C_ASYNC_RUNNING) {
+        check();
+    }
+}
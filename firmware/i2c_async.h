@@ -0,0 +1,51 @@
+#ifndef __I2C_ASYNC_H__
+#define __I2C_ASYNC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hardware/i2c.h"
+
+//
+// Non-blocking i2c transactions.
+//
+// A transaction writes up to a few bytes (typically a register number
+// and maybe a value) and then optionally reads a few bytes back after
+// a repeated start.  The whole thing fits in the controller's 16-entry
+// command FIFO, so starting it just queues the commands, and the
+// caller polls until the controller has sent the STOP.
+//
+// Only one transaction can be in flight.  The blocking SDK functions
+// (wrapped at link time, see perf.cpp) finish it first, so blocking
+// and non-blocking users can share the bus.
+//
+
+#define I2C_ASYNC_MAX_BYTES 16
+
+// `i2c_async_poll()` while the transaction is still going.
+#define I2C_ASYNC_BUSY 1
+
+// Give up on a transaction that hasn't finished after this long.
+#define I2C_ASYNC_TIMEOUT_US 10000
+
+
+// Start writing `src` to `addr`, then reading `dst_len` bytes into
+// `dst`, which must stay valid until the transaction is done.
+// `src_len` must be at least 1, and `src_len + dst_len` at most
+// I2C_ASYNC_MAX_BYTES.  Returns false if a transaction is already in
+// flight.
+bool i2c_async_start(i2c_inst_t * i2c, uint8_t addr, uint8_t const * src, size_t src_len, uint8_t * dst, size_t dst_len);
+
+// Returns I2C_ASYNC_BUSY while the transaction is going, and then
+// PICO_OK, PICO_ERROR_GENERIC if the device didn't acknowledge, or
+// PICO_ERROR_TIMEOUT, once.
+int i2c_async_poll(void);
+
+bool i2c_async_busy(void);
+
+// Busy-wait for the transaction in flight (if any) to finish.  Its
+// result is kept for the next `i2c_async_poll()`.
+void i2c_async_finish(void);
+
+
+#endif // __I2C_ASYNC_H__
@@ -1,7 +1,6 @@
 #include <cstdio>
 #include <string.h>
 #include <stdlib.h>
-#include <wchar.h>
 
 #include <hardware/i2c.h>
 #include <hardware/spi.h>
@@ -10,6 +9,7 @@
 #include <hardware/sync.h>
 
 #include <pico/stdlib.h>
+#include <pico/multicore.h>
 
 #include <hagl_hal.h>
 #include <hagl.h>
@@ -20,9 +20,32 @@
 
 #include "hagl_char_scaled.h"
 
+#include "boot.h"
+#include "dlog.h"
+#include "evlog.h"
+#include "fb_mirror.h"
+#include "fmt.h"
+#include "fnv1a.h"
 #include "hmi.h"
+#include "hmi_coro.h"
+#include "hmi_window_set.h"
 #include "husb238.h"
+#include "memstats.h"
+#include "pd.h"
+#include "pd_bench.h"
+#include "pd_seq.h"
+#include "perf.h"
+#include "replay.h"
+#include "sched.h"
+#include "snapshot.h"
+#include "sysclock.h"
+#include "sysmon.h"
+#include "text_runs.h"
+#include "usb_proto.h"
 #include "version-info.h"
+#include "vt100.h"
+#include "warmboot.h"
+#include "xip_stats.h"
 
 #ifdef RASPBERRYPI_PICO_W
 #include "pico/cyw43_arch.h"
@@ -39,18 +62,42 @@
 
 #define FLASH_OFFSET ((1024 + 512) * 1024)
 
+// The event log (see evlog.h) comes right after the settings sector.
+#define EVLOG_FLASH_OFFSET (FLASH_OFFSET + FLASH_SECTOR_SIZE)
+
+// And the PDO sequencer's script (see pd_seq.h) after that.
+#define PD_SEQ_FLASH_OFFSET (EVLOG_FLASH_OFFSET + (EVLOG_FLASH_SECTORS * FLASH_SECTOR_SIZE))
+
+// Bump this whenever the layout of flash_data changes, so we don't
+// misinterpret data written by older firmware.
+#define FLASH_COOKIE 0x56
+
+// How many USB-PD sources we remember the preferred PDO for.
+#define NUM_SOURCE_PROFILES 8
+
 // This is the data structure we store in flash.
 static struct {
     uint8_t cookie;
     int backlight_duty_cycle;
     int screen_rotation_index;
+
+    // The PDO the user last chose for each source we've seen,
+    // identified by a hash of the PDOs it offers.  Fingerprint 0 means
+    // "unused slot".  Slots are kept in most-recently-used order.
+    struct {
+        uint32_t fingerprint;
+        int pdo_id;
+    } source_profiles[NUM_SOURCE_PROFILES];
+
     uint8_t checksum;
 } flash_data;
 
+static_assert(sizeof(flash_data) <= FLASH_PAGE_SIZE, "flash_data must fit in one flash page");
+
 static void write_flash(void) {
     // Cheesiest checksum ever.
     uint8_t checksum = 0;
-    flash_data.cookie = 0x55;
+    flash_data.cookie = FLASH_COOKIE;
     flash_data.checksum = 0;
     for (uint i = 0; i < sizeof(flash_data); ++i) {
         checksum ^= ((uint8_t *)(&flash_data))[i];
@@ -66,6 +113,8 @@ static void write_flash(void) {
     flash_range_program(FLASH_OFFSET, (uint8_t const *)(&flash_data), FLASH_PAGE_SIZE);
 
     restore_interrupts(ints);
+
+    perf_flash_written();
 }
 
 static bool read_flash(void) {
@@ -78,7 +127,7 @@ static bool read_flash(void) {
         checksum ^= ((uint8_t *)(&flash_data))[i];
     }
 
-    if ((flash_data.cookie == 0x55) && (checksum == 0)) {
+    if ((flash_data.cookie == FLASH_COOKIE) && (checksum == 0)) {
         // Valid flash.
         return true;
     }
@@ -93,6 +142,31 @@ static int i2c_comm_errors = 0;
 
 static hagl_backend_t *display;
 
+// After a watchdog reset, what was on the screen (see warmboot.h).
+static bool warm_boot;
+static warmboot_state_t warm_state;
+
+// The glyph loop reads the font for every pixel it draws, so with
+// HOT_IN_RAM we draw from a copy in SRAM instead of from flash (see
+// hot.h).  main() sets this up before anything is drawn.
+#if HOT_IN_RAM
+static uint8_t font6x9_ram[sizeof(font6x9)];
+#endif
+static uint8_t const * ui_font = font6x9;
+
+// Copy the framebuffer to the display, and keep track of how long it takes.
+static void display_flush(void) {
+    // Core1 paints the first frame of a warm boot (see
+    // `core1_display_boot()`), and only core0 may record.
+    if (get_core_num() != 0) {
+        hagl_flush(display);
+        return;
+    }
+    uint32_t start = time_us_32();
+    hagl_flush(display);
+    perf_timer_record(PERF_FLUSH, time_us_32() - start);
+}
+
 static uint16_t display_width = MIPI_DISPLAY_WIDTH;
 static uint16_t display_height = MIPI_DISPLAY_HEIGHT;
 
@@ -102,12 +176,249 @@ static int backlight_duty_cycle_delta = 1000;  // Duty cycle changes by this muc
 static uint16_t backlight_pwm_slice;
 
 
+//
+// Per-source contract profiles.
+//
+// We fingerprint each USB-PD source by hashing the set of PDOs it
+// offers, and remember (in flash_data) the PDO the user last chose
+// for it.  When a known source attaches we select that PDO right away,
+// without waiting for the user to open the menu.
+//
+
+// Don't wait longer than this for the source to switch voltage.
+#define SOURCE_RESTORE_TIMEOUT_MS 1000
+
+typedef enum {
+    SOURCE_RESTORE_IDLE,     // watching for a source to attach
+    SOURCE_RESTORE_WAITING,  // selected a PDO, waiting for the contract
+} source_restore_state_t;
+
+static struct {
+    source_restore_state_t state;
+    bool attached;
+    int target_millivolts;
+    absolute_time_t start;
+    absolute_time_t next_poll;
+
+    // How long the last restore took to reach the target voltage, or
+    // -1 if we haven't restored a profile yet.
+    int last_restore_ms;
+} source_restore = {
+    .state = SOURCE_RESTORE_IDLE,
+    .last_restore_ms = -1,
+};
+
+// Returns the preferred PDO id for this source, or -1 if we don't know it.
+static int source_profile_lookup(uint32_t fingerprint) {
+    for (int i = 0; i < NUM_SOURCE_PROFILES; ++i) {
+        if (flash_data.source_profiles[i].fingerprint == fingerprint) {
+            return flash_data.source_profiles[i].pdo_id;
+        }
+    }
+    return -1;
+}
+
+// Remember the user's choice of PDO for this source.  Only writes the
+// flash if something changed.
+static void source_profile_remember(uint32_t fingerprint, int pdo_id) {
+    int i;
+
+    if (
+        (flash_data.source_profiles[0].fingerprint == fingerprint)
+        && (flash_data.source_profiles[0].pdo_id == pdo_id)
+    ) {
+        return;
+    }
+
+    // Find this source's slot, or evict the least recently used one,
+    // and move it to the front.
+    for (i = 0; i < NUM_SOURCE_PROFILES - 1; ++i) {
+        if (flash_data.source_profiles[i].fingerprint == fingerprint) {
+            break;
+        }
+    }
+    for (; i > 0; --i) {
+        flash_data.source_profiles[i] = flash_data.source_profiles[i - 1];
+    }
+    flash_data.source_profiles[0].fingerprint = fingerprint;
+    flash_data.source_profiles[0].pdo_id = pdo_id;
+
+    write_flash();
+}
+
+// A source just attached, select its preferred PDO if we know it.
+static void source_restore_start(void) {
+    pd_pdo_t pdos[PD_NUM_PDOS];
+    int current_pdo;
+    int r;
+
+    r = pd_get_pdos(i2c, pdos);
+    if (r != PICO_OK) {
+        ++i2c_comm_errors;
+        return;
+    }
+
+    uint32_t fingerprint = pd_source_fingerprint(pdos);
+    int pdo_id = source_profile_lookup(fingerprint);
+    if (pdo_id < 0) {
+        DLOG("new source %08x", fingerprint);
+        return;
+    }
+
+    source_restore.target_millivolts = -1;
+    for (int i = 0; i < PD_NUM_PDOS; ++i) {
+        if ((pdos[i].id == pdo_id) && (pdos[i].milliamps > 0)) {
+            source_restore.target_millivolts = pdos[i].millivolts;
+        }
+    }
+    if (source_restore.target_millivolts < 0) {
+        return;
+    }
+
+    source_restore.start = get_absolute_time();
+
+    r = husb238_get_current_pdo(i2c, &current_pdo);
+    if (r != PICO_OK) {
+        ++i2c_comm_errors;
+    } else if (current_pdo == pdo_id) {
+        source_restore.last_restore_ms = 0;
+        DLOG("source %08x: PDO %d already active", fingerprint, pdo_id);
+        return;
+    }
+
+    r = husb238_select_pdo(i2c, pdo_id);
+    evlog_add(EVLOG_RESTORE, pdo_id, r);
+    if (r != PICO_OK) {
+        ++i2c_comm_errors;
+        return;
+    }
+    DLOG("source %08x: restoring PDO %d", fingerprint, pdo_id);
+
+    source_restore.state = SOURCE_RESTORE_WAITING;
+}
+
+// Background task: watch for sources attaching, and for the contract
+// to reach the restored voltage.
+static void source_restore_poll(void) {
+    // The benchmark and the sequencer are busy switching PDOs, and the
+    // benchmark puts things back itself.
+    if ((pd_bench_get_state() == PD_BENCH_RUNNING) || (pd_seq_get_state() == PD_SEQ_RUNNING)) {
+        return;
+    }
+
+    if (!time_reached(source_restore.next_poll)) {
+        return;
+    }
+
+    if (source_restore.state == SOURCE_RESTORE_IDLE) {
+        source_restore.next_poll = make_timeout_time_ms(250);
+        bool attached = husb238_connected(i2c);
+        if (attached) {
+            boot_mark(BOOT_PHASE_HUSB238);
+        }
+        if (attached && !source_restore.attached) {
+            source_restore_start();
+        }
+        source_restore.attached = attached;
+        return;
+    }
+
+    source_restore.next_poll = make_timeout_time_ms(5);
+
+    int millivolts;
+    int milliamps;
+    int r = pd_get_contract(i2c, &millivolts, &milliamps);
+    int ms = absolute_time_diff_us(source_restore.start, get_absolute_time()) / 1000;
+    if ((r == PICO_OK) && (millivolts == source_restore.target_millivolts)) {
+        boot_mark(BOOT_PHASE_FIRST_CONTRACT);
+        source_restore.last_restore_ms = ms;
+        source_restore.state = SOURCE_RESTORE_IDLE;
+        DLOG("reached %dmV in %d ms", millivolts, ms);
+        hmi_request_redraw();
+    } else if (ms > SOURCE_RESTORE_TIMEOUT_MS) {
+        source_restore.state = SOURCE_RESTORE_IDLE;
+        DLOG("timed out waiting for %dmV", source_restore.target_millivolts);
+    }
+}
+
+
+//
+// Watch the source and the i2c error count for things worth keeping in
+// the event log (see evlog.h): the source attaching and detaching,
+// contract changes, and bursts of i2c errors.  A burst is a run of
+// polls that each saw new errors, logged when it's over.  The HUSB238
+// is powered by the source, so errors while it's detached don't count.
+//
+
+static struct {
+    bool attached;
+    int millivolts;
+    int milliamps;
+    int i2c_comm_errors;
+    int burst_errors;
+    int burst_polls;
+} pd_events;
+
+static void pd_events_poll(void) {
+    bool attached = husb238_connected(i2c);
+    int errors = i2c_comm_errors - pd_events.i2c_comm_errors;
+    pd_events.i2c_comm_errors = i2c_comm_errors;
+
+    if (attached && pd_events.attached && (errors > 0)) {
+        pd_events.burst_errors += errors;
+        ++pd_events.burst_polls;
+    } else if (pd_events.burst_polls > 0) {
+        evlog_add(
+            EVLOG_I2C_ERRORS,
+            MIN(pd_events.burst_polls, 255),
+            MIN(pd_events.burst_errors, 0xffff)
+        );
+        pd_events.burst_errors = 0;
+        pd_events.burst_polls = 0;
+    }
+
+    if (attached != pd_events.attached) {
+        evlog_add(attached ? EVLOG_ATTACH : EVLOG_DETACH, 0, 0);
+        hmi_request_redraw();
+        pd_events.attached = attached;
+        if (!attached) {
+            pd_events.millivolts = 0;
+            pd_events.milliamps = 0;
+        }
+    }
+    if (!attached) {
+        return;
+    }
+
+    int millivolts;
+    int milliamps;
+    if (pd_get_contract(i2c, &millivolts, &milliamps) != PICO_OK) {
+        ++i2c_comm_errors;
+        return;
+    }
+    if ((millivolts != pd_events.millivolts) || (milliamps != pd_events.milliamps)) {
+        // The benchmark and the sequencer change the contract all the
+        // time, and would fill the log with it.
+        if ((pd_bench_get_state() != PD_BENCH_RUNNING) && (pd_seq_get_state() != PD_SEQ_RUNNING)) {
+            evlog_add(EVLOG_CONTRACT, milliamps / 50, millivolts);
+        }
+        // Whoever changed it, the windows showing the contract don't
+        // redraw by themselves once there is one.
+        hmi_request_redraw();
+        pd_events.millivolts = millivolts;
+        pd_events.milliamps = milliamps;
+    }
+}
+
+
 typedef enum {
     WINDOW_MAIN,
     WINDOW_MENU,
     WINDOW_ROTATE,
     WINDOW_BACKLIGHT,
-    WINDOW_INFO
+    WINDOW_INFO,
+    WINDOW_PERF,
+    WINDOW_BENCH
 } hmi_window_id_t;
 
 
@@ -115,44 +426,148 @@ typedef enum {
 // Main window
 //
 
-static uint32_t window_main_draw(void * void_context) {
+// VSYS and the temperature, the way the main window shows them (see
+// sysmon.h).
+typedef struct {
+    bool valid;             // there are stats yet
+    int vsys_decivolts;     // 0: not measured
+    int celsius;
+    bool alert;             // brownout or overheating
+} window_main_sysmon_t;
+
+// The shown VSYS and temperature only move once a period's mean is
+// this far from them, so ADC noise around a rounding boundary doesn't
+// redraw the main window every period.
+#define WINDOW_MAIN_VSYS_HYSTERESIS_MV 75
+#define WINDOW_MAIN_CELSIUS_HYSTERESIS_DECI_C 8
+
+// What the main window showed last time it drew, for its text rendition.
+static struct {
+    bool connected;
+    int millivolts;
+    int milliamps;
+    window_main_sysmon_t sysmon;
+} window_main_shown;
+
+// `value` rounded to a multiple of `step`, unless it's still within
+// `hysteresis` of `shown`.
+static int window_main_sysmon_round(int value, int step, int shown, int hysteresis) {
+    if (abs(value - (shown * step)) < hysteresis) {
+        return shown;
+    }
+    return (value + (step / 2)) / step;
+}
+
+// What the main window should show now, given what it shows already.
+static window_main_sysmon_t window_main_sysmon_now(void) {
+    window_main_sysmon_t const * shown = &window_main_shown.sysmon;
+    window_main_sysmon_t now;
+    sysmon_stats_t vsys, temperature;
+
+    sysmon_get_stats(&vsys, &temperature);
+    now.valid = (temperature.samples > 0);
+    now.vsys_decivolts = 0;
+    if (vsys.samples > 0) {
+        now.vsys_decivolts = window_main_sysmon_round(vsys.mean, 100, shown->vsys_decivolts, WINDOW_MAIN_VSYS_HYSTERESIS_MV);
+    }
+    now.celsius = window_main_sysmon_round(temperature.mean, 10, shown->celsius, WINDOW_MAIN_CELSIUS_HYSTERESIS_DECI_C);
+    now.alert = sysmon_brownout() || sysmon_overtemp();
+    return now;
+}
+
+static bool window_main_sysmon_same(window_main_sysmon_t const * a, window_main_sysmon_t const * b) {
+    return (a->valid == b->valid)
+        && (a->vsys_decivolts == b->vsys_decivolts)
+        && (a->celsius == b->celsius)
+        && (a->alert == b->alert);
+}
+
+// "VSYS 4.9V 41C", or just the temperature on a Pico W.
+static void window_main_sysmon_str(window_main_sysmon_t const * s, char * str) {
+    char * p = str;
+    if (s->vsys_decivolts > 0) {
+        p = fmt_str(fmt_fixed(fmt_str(p, "VSYS "), s->vsys_decivolts, 1, 1), "V ");
+    }
+    fmt_str(fmt_int(p, s->celsius), "C");
+}
+
+// The VSYS/temperature line along the bottom, red if something's wrong.
+static void window_main_paint_sysmon(uint8_t const * font, int w, int h) {
+    window_main_sysmon_t const * s = &window_main_shown.sysmon;
+    char str[24];
+
+    if (!s->valid) {
+        return;
+    }
+    window_main_sysmon_str(s, str);
+    hagl_color_t color = s->alert ? hagl_color(display, 255, 0, 0) : hagl_color(display, 150, 150, 150);
+    int r = strlen(str);
+    hagl_put_text_scaled(display, str, (display->width - (r * w)) / 2, display->height - h - 2, color, 1, font);
+}
+
+// Sysmon events: show alerts on the main window, and keep its numbers
+// current.
+static void sysmon_event(sysmon_event_t event) {
+    int active = hmi_get_active_window();
+
+    switch (event) {
+    case SYSMON_EVENT_BROWNOUT:
+    case SYSMON_EVENT_OVERTEMP:
+        // Don't pull the Bench window out from under a benchmark.
+        if ((active != WINDOW_MAIN) && (pd_bench_get_state() != PD_BENCH_RUNNING)) {
+            hmi_set_active_window(WINDOW_MAIN);
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (active == WINDOW_MAIN) {
+        window_main_sysmon_t now = window_main_sysmon_now();
+        if (!window_main_sysmon_same(&now, &window_main_shown.sysmon)) {
+            hmi_request_redraw();
+        }
+    }
+}
+
+// Draw the main window for a contract of `millivolts` (0: none, -1:
+// couldn't read it) and `milliamps`.  Returns the redraw wait.
+static uint32_t window_main_paint(bool connected, int millivolts, int milliamps) {
     int r;
     int redraw_wait;
 
-    int volts;
-    float max_current;
-
-    wchar_t str[40];
+    char str[40];
     int16_t x, y;
 
-    uint8_t const * font = font6x9;
+    uint8_t const * font = ui_font;
     int w=6, h=9;
-    int scale=4;
+    int scale=4;    // big text is drawn as rectangles, see text_runs.h
 
     hagl_color_t text_color;
 
     hagl_clear(display);
 
-    if (!husb238_connected(i2c)) {
-        ++i2c_comm_errors;
+    if (!connected) {
         text_color = hagl_color(display, 255, 0, 0);
 
-        r = swprintf(str, sizeof(str), L"No");
+        r = fmt_str(str, "No") - str;
         x = (display->width - (r * w * scale))/2;
-        y = (display->height / 2) - (1.5 * h * scale);
-        hagl_put_text_scaled(display, str, x, y, text_color, scale, font);
+        y = (display->height / 2) - ((3 * h * scale) / 2);
+        text_runs_put_text(display, str, x, y, text_color, scale);
 
-        r = swprintf(str, sizeof(str), L"input");
+        r = fmt_str(str, "input") - str;
         x = (display->width - (r * w * scale))/2;
-        y = (display->height / 2) - (0.5 * h * scale);
-        hagl_put_text_scaled(display, str, x, y, text_color, scale, font);
+        y = (display->height / 2) - ((h * scale) / 2);
+        text_runs_put_text(display, str, x, y, text_color, scale);
 
-        r = swprintf(str, sizeof(str), L"power");
+        r = fmt_str(str, "power") - str;
         x = (display->width - (r * w * scale))/2;
-        y = (display->height / 2) + (0.5 * h * scale);
-        hagl_put_text_scaled(display, str, x, y, text_color, scale, font);
+        y = (display->height / 2) + ((h * scale) / 2);
+        text_runs_put_text(display, str, x, y, text_color, scale);
 
-        hagl_flush(display);
+        window_main_paint_sysmon(font, w, h);
+        display_flush();
 
         // The Pico is running off its own USB power, but the HUSB238
         // does not have power.  Re-check and re-draw soon.
@@ -163,62 +578,125 @@ static uint32_t window_main_draw(void * void_context) {
     // need to redraw again.
     redraw_wait = 0;
 
-    r = husb238_get_contract(i2c, volts, max_current);
-    if (r != PICO_OK) {
-        ++i2c_comm_errors;
-        printf("error reading PD contract from HUSB238\n");
-        volts = -1;
-        max_current = -1.0;
-        redraw_wait = 100;  // Failed to read from HUSB238, re-try soon.
-    }
-    printf("(%d comm errors) PD contract: %dV %4.2fA\n", i2c_comm_errors, volts, max_current);
-
-    if (volts > 0) {
+    if (millivolts > 0) {
         // Got a PD contract, show voltage and current limit in happy green text.
         text_color = hagl_color(display, 0, 255, 0);
 
-        r = swprintf(str, sizeof(str), L"%dV", volts);
+        r = fmt_str(fmt_uint(str, millivolts / 1000), "V") - str;
         x = (display->width - (r * w * scale))/2;
         y = (display->height / 2) - h * scale;
-        hagl_put_text_scaled(display, str, x, y, text_color, scale, font);
+        text_runs_put_text(display, str, x, y, text_color, scale);
 
-        r = swprintf(str, sizeof(str), L"%04.2fA", max_current);
+        r = fmt_str(fmt_fixed(str, milliamps, 3, 2), "A") - str;
         x = (display->width - (r * w * scale))/2;
         y = (display->height / 2) + 2;
-        hagl_put_text_scaled(display, str, x, y, text_color, scale, font6x9);
+        text_runs_put_text(display, str, x, y, text_color, scale);
 
     } else {
         // No PD contract established, sad grayish text.
         text_color = hagl_color(display, 150, 150, 150);
         redraw_wait = 100;  // HUSB238 i2c comm error or HUSB238 reports "no contract", re-try soon.
 
-        r = swprintf(str, sizeof(str), L"waiting");
+        r = fmt_str(str, "waiting") - str;
         x = (display->width - (r * w * scale))/2;
         y = (display->height / 2) - h * scale;
-        hagl_put_text_scaled(display, str, x, y, text_color, scale, font);
+        text_runs_put_text(display, str, x, y, text_color, scale);
 
-        r = swprintf(str, sizeof(str), L"for source");
+        r = fmt_str(str, "for source") - str;
         x = (display->width - (r * w * scale))/2;
         y = (display->height / 2) + 2;
-        hagl_put_text_scaled(display, str, x, y, text_color, scale, font6x9);
+        text_runs_put_text(display, str, x, y, text_color, scale);
     }
 
-    hagl_flush(display);
+    window_main_paint_sysmon(font, w, h);
+    display_flush();
 
     return redraw_wait;
 }
 
-static void window_main_any_interaction(void * void_context) {
+// Paints what `pd_events_poll()` last saw, the same as
+// `window_main_version()` describes, and gets redrawn when that changes.
+static uint32_t window_main_draw(void) {
+    // Until there's a contract, look again on every retry (see
+    // `window_main_paint()`) rather than waiting for the next
+    // pd_events_poll(), so a source shows up quickly.  Those frames
+    // aren't cached.
+    if (!pd_events.attached || (pd_events.millivolts <= 0)) {
+        pd_events_poll();
+    }
+
+    int millivolts = pd_events.millivolts;
+    int milliamps = pd_events.milliamps;
+
+    window_main_shown.connected = pd_events.attached;
+    if (window_main_shown.connected) {
+        DLOG("(%d comm errors) PD contract: %dmV %dmA", i2c_comm_errors, millivolts, milliamps);
+        if (millivolts > 0) {
+            boot_mark(BOOT_PHASE_FIRST_CONTRACT);
+        }
+    }
+    window_main_shown.millivolts = millivolts;
+    window_main_shown.milliamps = milliamps;
+    window_main_shown.sysmon = window_main_sysmon_now();
+
+    return window_main_paint(window_main_shown.connected, millivolts, milliamps);
+}
+
+// The main window shows the contract and the sysmon line.  Packed
+// the way they're drawn: whole volts (5 bits), amps with 2 decimals (9
+// bits), VSYS with 1 decimal (10 bits), degrees (7 bits) and whether
+// the line is red.  No i2c, it goes by what `pd_events_poll()` last
+// saw, which asks for a redraw whenever that changes.
+static uint32_t window_main_version(void) {
+    int millivolts = pd_events.millivolts;
+    int milliamps = pd_events.milliamps;
+
+    if (!pd_events.attached || (millivolts <= 0)) {
+        return 0;  // draw() will want to retry, so this never gets cached
+    }
+
+    window_main_sysmon_t s = window_main_sysmon_now();
+    if (!s.valid) {
+        s.vsys_decivolts = 0;
+        s.celsius = 0;
+        s.alert = false;
+    }
+    return ((uint32_t)(millivolts / 1000) << 27)
+        | ((uint32_t)((milliamps / 10) & 0x1ff) << 18)
+        | ((uint32_t)(s.vsys_decivolts & 0x3ff) << 8)
+        | ((uint32_t)MIN(MAX(s.celsius, 0), 127) << 1)
+        | s.alert;
+}
+
+static void window_main_any_interaction(void) {
     hmi_set_active_window(WINDOW_MENU);
 }
 
+static void window_main_text(hmi_text_t * text) {
+    if (!window_main_shown.connected) {
+        hmi_text_printf(text, 5, -1, "No input power");
+    } else if (window_main_shown.millivolts > 0) {
+        int milliamps = window_main_shown.milliamps;
+        hmi_text_printf(text, 4, -1, "%dV", window_main_shown.millivolts / 1000);
+        hmi_text_printf(text, 6, -1, "%d.%02dA", milliamps / 1000, (milliamps % 1000) / 10);
+    } else {
+        hmi_text_printf(text, 5, -1, "waiting for source");
+    }
+
+    if (window_main_shown.sysmon.valid) {
+        char str[24];
+        window_main_sysmon_str(&window_main_shown.sysmon, str);
+        hmi_text_printf(text, HMI_TEXT_ROWS - 1, -1, "%s%s", str, window_main_shown.sysmon.alert ? " !" : "");
+    }
+}
+
 
 //
 // Menu window
 //
 
 typedef struct {
-    wchar_t text[16];
+    char text[16];
     bool enabled;  // menu items that are !enabled are shown but not selectable
 } menu_item_t;
 
@@ -229,32 +707,26 @@ typedef struct {
 } menu_t;
 
 
+#define MENU_NUM_ITEMS 12  // 6 PDOs, Rotate, Backlight, Info, Performance, PD Bench, Back
+
 typedef struct {
-    husb238_pdo_t pdos[6];
+    pd_pdo_t pdos[PD_NUM_PDOS];
     int current_pdo;       // this is the SRC_PDO identifier
     menu_t menu;
+    menu_item_t items[MENU_NUM_ITEMS];
     int y_start;
+    bool selecting;        // a PDO selection is in progress
 } window_menu_context_t;
 
 // This is how far from the screen edge the Menu starts or ends.
 #define MENU_Y_MARGIN 5
 
 
-static void * window_menu_init(void) {
-    window_menu_context_t * context = (window_menu_context_t*)calloc(1, sizeof(window_menu_context_t));
-    if (context == nullptr) {
-        printf("out of memory\n");
-        return nullptr;
-    }
-
+static void window_menu_init(window_menu_context_t * context) {
     context->y_start = MENU_Y_MARGIN;
 
-    context->menu.num_items = 10;  // 6 PDOs, Rotate, Backlight, Info, Back
-    context->menu.items = (menu_item_t*)calloc(context->menu.num_items, sizeof(menu_item_t));
-    if (context->menu.items == nullptr) {
-        printf("out of memory\n");
-        return nullptr;
-    }
+    context->menu.num_items = MENU_NUM_ITEMS;
+    context->menu.items = context->items;
 
     // The first 6 Menu items are the PDOs.  Because you can run this
     // device without USB-PD connected (by powering the Pico via its
@@ -264,38 +736,28 @@ static void * window_menu_init(void) {
     // state of each PDO).
 
     // The 7th Menu item is the Rotate screen.
-    swprintf(
-        context->menu.items[6].text,
-        sizeof(context->menu.items[6].text),
-        L"Rotate"
-    );
+    fmt_str(context->menu.items[6].text, "Rotate");
     context->menu.items[6].enabled = true;
 
     // The 8th Menu item is the Backlight screen.
-    swprintf(
-        context->menu.items[7].text,
-        sizeof(context->menu.items[7].text),
-        L"Backlight"
-    );
+    fmt_str(context->menu.items[7].text, "Backlight");
     context->menu.items[7].enabled = true;
 
     // The 9th Menu item is the Info screen.
-    swprintf(
-        context->menu.items[8].text,
-        sizeof(context->menu.items[8].text),
-        L"Info"
-    );
+    fmt_str(context->menu.items[8].text, "Info");
     context->menu.items[8].enabled = true;
 
-    // The 10th and final Menu item is Back, to go back to the main window.
-    swprintf(
-        context->menu.items[9].text,
-        sizeof(context->menu.items[9].text),
-        L"Back"
-    );
+    // The 10th Menu item is the Performance screen.
+    fmt_str(context->menu.items[9].text, "Performance");
     context->menu.items[9].enabled = true;
 
-    return context;
+    // The 11th Menu item is the PD source benchmark.
+    fmt_str(context->menu.items[10].text, "PD Bench");
+    context->menu.items[10].enabled = true;
+
+    // The 12th and final Menu item is Back, to go back to the main window.
+    fmt_str(context->menu.items[11].text, "Back");
+    context->menu.items[11].enabled = true;
 }
 
 
@@ -310,10 +772,9 @@ static void * window_menu_init(void) {
 // near the selected item, and the rest is off-screen and invisible.
 //
 
-static uint32_t window_menu_draw(void * void_context) {
-    window_menu_context_t * context = (window_menu_context_t*)void_context;
+static uint32_t window_menu_draw(window_menu_context_t * context) {
 
-    uint8_t const * font = font6x9;
+    uint8_t const * font = ui_font;
     int w=6, h=9;
     int scale=2;
 
@@ -322,11 +783,6 @@ static uint32_t window_menu_draw(void * void_context) {
 
     hagl_clear(display);
 
-    int r = husb238_get_current_pdo(i2c, &context->current_pdo);
-    if (r != PICO_OK) {
-        ++i2c_comm_errors;
-    }
-
     // If we draw the menu in the same place as last time, will the
     // selected item be on the screen?  If not, we need to move the menu
     // up or down.
@@ -371,8 +827,8 @@ static uint32_t window_menu_draw(void * void_context) {
             hagl_put_text_scaled(display, context->menu.items[i].text, x_pos, y_pos, text_color, scale, font);
             if (i == context->menu.selected_item) {
                 hagl_color_t red = hagl_color(display, 255, 0, 0);
-                wchar_t cursor[] = L"<<<";
-                size_t len = wcslen(context->menu.items[i].text);
+                char cursor[] = "<<<";
+                size_t len = strlen(context->menu.items[i].text);
                 hagl_put_text_scaled(display, cursor, x_pos+(len*w*scale), y_pos, red, scale, font);
             }
         }
@@ -380,36 +836,38 @@ static uint32_t window_menu_draw(void * void_context) {
         y_pos += h * scale;
     }
 
-    hagl_flush(display);
+    display_flush();
 
     return 0;
 }
 
 
-// The Menu window was selected, re-read PDOs and regenerate the
-// menu items enabled/disabled state.
-static void window_menu_selected(void * void_context) {
-    window_menu_context_t * context = (window_menu_context_t *)void_context;
+// The Menu window was selected, re-read PDOs and the active PDO, and
+// regenerate the menu items enabled/disabled state.  This runs before
+// the window's version is taken, so everything the menu draws from is
+// read here and not in draw().
+static void window_menu_selected(window_menu_context_t * context) {
     int r;
 
-    r = husb238_get_pdos(i2c, context->pdos);
+    r = pd_get_pdos(i2c, context->pdos);
+    if (r != PICO_OK) {
+        ++i2c_comm_errors;
+        DLOG("error reading PDOs");
+    }
+
+    r = husb238_get_current_pdo(i2c, &context->current_pdo);
     if (r != PICO_OK) {
         ++i2c_comm_errors;
-        printf("error reading PDOs\n");
     }
 
     // Update the first 6 menu items based on the PDOs offered by this
     // USB-PD Source.  All PDOs are displayed, but the ones not available
     // are disabled (grayed out and not selectable).
     for (int i = 0; i < 6; ++i) {
-        r = swprintf(
-            context->menu.items[i].text,
-            sizeof(context->menu.items[i].text),
-            L"%dV/%dA",
-            (int)context->pdos[i].volts,
-            (int)context->pdos[i].max_current
-        );
-        if (context->pdos[i].max_current > 0) {
+        char * p = context->menu.items[i].text;
+        p = fmt_str(fmt_uint(p, context->pdos[i].millivolts / 1000), "V/");
+        fmt_str(fmt_uint(p, context->pdos[i].milliamps / 1000), "A");
+        if (context->pdos[i].milliamps > 0) {
             context->menu.items[i].enabled = true;
         } else {
             context->menu.items[i].enabled = false;
@@ -437,8 +895,19 @@ static void window_menu_selected(void * void_context) {
 }
 
 
-static void window_menu_cw(void * void_context) {
-    window_menu_context_t * context = (window_menu_context_t*)void_context;
+static uint32_t window_menu_version(window_menu_context_t * context) {
+
+    // A hash of everything the menu draws from.
+    uint32_t values[3] = {
+        (uint32_t)context->menu.selected_item,
+        (uint32_t)context->current_pdo,
+        (uint32_t)context->y_start,
+    };
+    uint32_t hash = fnv1a(FNV1A_INIT, context->menu.items, context->menu.num_items * sizeof(menu_item_t));
+    return fnv1a(hash, values, sizeof(values));
+}
+
+static void window_menu_cw(window_menu_context_t * context) {
 
     context->menu.selected_item = (context->menu.selected_item + 1) % context->menu.num_items;
     while (! context->menu.items[context->menu.selected_item].enabled) {
@@ -447,8 +916,7 @@ static void window_menu_cw(void * void_context) {
 }
 
 
-static void window_menu_ccw(void * void_context) {
-    window_menu_context_t * context = (window_menu_context_t*)void_context;
+static void window_menu_ccw(window_menu_context_t * context) {
 
     context->menu.selected_item -= 1;
     if (context->menu.selected_item == -1) {
@@ -462,8 +930,83 @@ static void window_menu_ccw(void * void_context) {
     }
 }
 
-static void window_menu_click(void * void_context) {
-    window_menu_context_t * context = (window_menu_context_t*)void_context;
+static void window_menu_text(window_menu_context_t * context, hmi_text_t * text) {
+
+    for (int i = 0; i < context->menu.num_items; ++i) {
+        hmi_text_printf(
+            text, i + 1, 2, "%s%s%s%s",
+            context->menu.items[i].enabled ? "" : "(",
+            context->menu.items[i].text,
+            context->menu.items[i].enabled ? "" : ")",
+            ((i < 6) && (context->pdos[i].id == context->current_pdo)) ? " *" : ""
+        );
+        if (i == context->menu.selected_item) {
+            hmi_text_printf(text, i + 1, 0, ">");
+        }
+    }
+}
+
+#if HMI_COROUTINES
+
+// Request PDO number `i` of the menu, wait for the source to switch
+// over, then go back to the main window, unless something (a sysmon
+// alert, say) has switched windows in the meantime.  None of the i2c
+// traffic blocks the HMI.
+static hmi_coro_t window_menu_select_pdo(window_menu_context_t * context, int i) {
+    int pdo_id = context->pdos[i].id;
+    int r;
+
+    context->selecting = true;
+
+    uint8_t select[2] = { PD_REG_SRC_PDO, (uint8_t)(pdo_id << 4) };
+    r = co_await hmi_coro_i2c(i2c, PD_I2C_ADDR, select, sizeof(select), nullptr, 0);
+    if (r == PICO_OK) {
+        uint8_t go[2] = { PD_REG_GO_COMMAND, PD_GO_SELECT_PDO };
+        r = co_await hmi_coro_i2c(i2c, PD_I2C_ADDR, go, sizeof(go), nullptr, 0);
+    }
+    if (r != PICO_OK) {
+        ++i2c_comm_errors;
+    }
+    evlog_add(EVLOG_SELECT, pdo_id, r);
+    DLOG("selected PDO %d: %d", pdo_id, r);
+
+    if (r == PICO_OK) {
+        source_profile_remember(pd_source_fingerprint(context->pdos), pdo_id);
+
+        // Wait for the new contract, so the main window shows it right
+        // away.
+        uint8_t reg = PD_REG_PD_STATUS0;
+        uint8_t status;
+        absolute_time_t give_up = make_timeout_time_ms(SOURCE_RESTORE_TIMEOUT_MS);
+        while (!time_reached(give_up)) {
+            r = co_await hmi_coro_i2c(i2c, PD_I2C_ADDR, &reg, 1, &status, 1);
+            if (r != PICO_OK) {
+                ++i2c_comm_errors;
+            } else if (pd_status_millivolts(status) == context->pdos[i].millivolts) {
+                break;
+            }
+            co_await hmi_coro_sleep_ms(5);
+        }
+    }
+
+    uint8_t reg = PD_REG_SRC_PDO;
+    uint8_t value;
+    r = co_await hmi_coro_i2c(i2c, PD_I2C_ADDR, &reg, 1, &value, 1);
+    if (r != PICO_OK) {
+        ++i2c_comm_errors;
+    } else {
+        context->current_pdo = value >> 4;
+    }
+
+    context->selecting = false;
+    if (hmi_get_active_window() == WINDOW_MENU) {
+        hmi_set_active_window(WINDOW_MAIN);
+    }
+}
+
+#endif
+
+static void window_menu_click(window_menu_context_t * context) {
 
     if (context->menu.selected_item == 6) {
         hmi_set_active_window(WINDOW_ROTATE);
@@ -475,18 +1018,38 @@ static void window_menu_click(void * void_context) {
         hmi_set_active_window(WINDOW_INFO);
         return;
     } else if (context->menu.selected_item == 9) {
+        hmi_set_active_window(WINDOW_PERF);
+        return;
+    } else if (context->menu.selected_item == 10) {
+        hmi_set_active_window(WINDOW_BENCH);
+        return;
+    } else if (context->menu.selected_item == 11) {
         hmi_set_active_window(WINDOW_MAIN);
         return;
     }
 
+#if HMI_COROUTINES
+    if (context->selecting) {
+        return;
+    }
+    if (window_menu_select_pdo(context, context->menu.selected_item).started) {
+        return;
+    }
+    // No coroutine frame to spare, do it the blocking way.
+#endif
+
     int r ;
     r = husb238_select_pdo(i2c, context->pdos[context->menu.selected_item].id);
     if (r != PICO_OK) {
         ++i2c_comm_errors;
     }
-    r = husb238_dump_registers(i2c);
-    if (r != PICO_OK) {
-        ++i2c_comm_errors;
+    evlog_add(EVLOG_SELECT, context->pdos[context->menu.selected_item].id, r);
+    DLOG("selected PDO %d: %d", context->pdos[context->menu.selected_item].id, r);
+    if (r == PICO_OK) {
+        source_profile_remember(
+            pd_source_fingerprint(context->pdos),
+            context->pdos[context->menu.selected_item].id
+        );
     }
     r = husb238_get_current_pdo(i2c, &context->current_pdo);
     if (r != PICO_OK) {
@@ -500,103 +1063,108 @@ static void window_menu_click(void * void_context) {
 // Rotate window
 //
 
-typedef struct {
-    struct {
-        uint8_t dcs_address_mode;
-        uint16_t width, height;
-        int16_t x_offset, y_offset;
-    } rotation_info[4];
-    int rotation_index;
-} window_rotate_context_t;
-
-static void set_screen_rotation(window_rotate_context_t * c) {
-    uint8_t mode = c->rotation_info[c->rotation_index].dcs_address_mode;
-
-    hagl_clear(display);
-    hagl_flush(display);
-
-    mipi_display_ioctl(MIPI_DCS_SET_ADDRESS_MODE, &mode, 1);
-
-    hagl_set_resolution(
-        display,
-        c->rotation_info[c->rotation_index].width,
-        c->rotation_info[c->rotation_index].height
-    );
-
-    mipi_display_set_xy_offset(
-        c->rotation_info[c->rotation_index].x_offset,
-        c->rotation_info[c->rotation_index].y_offset
-    );
-
-    display_width = c->rotation_info[c->rotation_index].width;
-    display_height = c->rotation_info[c->rotation_index].height;
-}
-
-static void * window_rotate_init(void) {
-    window_rotate_context_t * c = (window_rotate_context_t *)calloc(1, sizeof(window_rotate_context_t));
-    if (c == nullptr) {
-        printf("out of memory\n");
-        return nullptr;
-    }
-
-    // available constants
-    // MIPI_DCS_ADDRESS_MODE_MIRROR_Y      0x80
-    // MIPI_DCS_ADDRESS_MODE_MIRROR_X      0x40
-    // MIPI_DCS_ADDRESS_MODE_SWAP_XY       0x20
-    // MIPI_DCS_ADDRESS_MODE_BGR           0x08
-    // MIPI_DCS_ADDRESS_MODE_RGB           0x00
-    // MIPI_DCS_ADDRESS_MODE_FLIP_X        0x02
-    // MIPI_DCS_ADDRESS_MODE_FLIP_Y        0x01
+// available constants
+// MIPI_DCS_ADDRESS_MODE_MIRROR_Y      0x80
+// MIPI_DCS_ADDRESS_MODE_MIRROR_X      0x40
+// MIPI_DCS_ADDRESS_MODE_SWAP_XY       0x20
+// MIPI_DCS_ADDRESS_MODE_BGR           0x08
+// MIPI_DCS_ADDRESS_MODE_RGB           0x00
+// MIPI_DCS_ADDRESS_MODE_FLIP_X        0x02
+// MIPI_DCS_ADDRESS_MODE_FLIP_Y        0x01
 
+static struct {
+    uint8_t dcs_address_mode;
+    uint16_t width, height;
+    int16_t x_offset, y_offset;
+} const rotation_info[4] = {
     // 0°, the native orientation of the screen
-    c->rotation_info[0] = {
+    {
         .dcs_address_mode = 0x00,
         .width = MIPI_DISPLAY_WIDTH,
         .height = MIPI_DISPLAY_HEIGHT,
         .x_offset = MIPI_DISPLAY_OFFSET_X,
         .y_offset = MIPI_DISPLAY_OFFSET_Y,
-    };
+    },
 
     // 90°
-    c->rotation_info[1] = {
+    {
         .dcs_address_mode = MIPI_DCS_ADDRESS_MODE_SWAP_XY | MIPI_DCS_ADDRESS_MODE_MIRROR_X,
         .width = MIPI_DISPLAY_HEIGHT,
         .height = MIPI_DISPLAY_WIDTH,
         .x_offset = MIPI_DISPLAY_OFFSET_Y,
         .y_offset = MIPI_DISPLAY_OFFSET_X,
-    };
+    },
 
     // 180°
-    c->rotation_info[2] = {
+    {
         .dcs_address_mode = MIPI_DCS_ADDRESS_MODE_MIRROR_X | MIPI_DCS_ADDRESS_MODE_MIRROR_Y,
         .width = MIPI_DISPLAY_WIDTH,
         .height = MIPI_DISPLAY_HEIGHT,
         .x_offset = MIPI_DISPLAY_OFFSET_X,
         .y_offset = MIPI_DISPLAY_OFFSET_Y,
-    };
+    },
 
     // 270°
-    c->rotation_info[3] = {
+    {
         .dcs_address_mode = MIPI_DCS_ADDRESS_MODE_SWAP_XY | MIPI_DCS_ADDRESS_MODE_MIRROR_Y,
         .width = MIPI_DISPLAY_HEIGHT,
         .height = MIPI_DISPLAY_WIDTH,
         .x_offset = MIPI_DISPLAY_OFFSET_Y,
         .y_offset = MIPI_DISPLAY_OFFSET_X,
-    };
+    },
+};
+
+typedef struct {
+    int rotation_index;
+} window_rotate_context_t;
 
-    c->rotation_index = flash_data.screen_rotation_index;
-    if (c->rotation_index < 0) {
-        c->rotation_index = 0;
-    } else if (c->rotation_index > 3) {
-        c->rotation_index = 3;
+// The rotation the screen is in right now.
+static int screen_rotation_index;
+
+// The rotation index stored in flash, clamped to the valid range.
+static int saved_rotation_index(void) {
+    int rotation_index = flash_data.screen_rotation_index;
+    if (rotation_index < 0) {
+        rotation_index = 0;
+    } else if (rotation_index > 3) {
+        rotation_index = 3;
     }
+    return rotation_index;
+}
 
-    set_screen_rotation(c);
+static void set_screen_rotation(int rotation_index) {
+    uint8_t mode = rotation_info[rotation_index].dcs_address_mode;
 
-    return c;
+    hagl_clear(display);
+    hagl_flush(display);
+
+    // Snapshots of the old orientation are no use any more.
+    snapshot_invalidate_all();
+
+    mipi_display_ioctl(MIPI_DCS_SET_ADDRESS_MODE, &mode, 1);
+
+    hagl_set_resolution(
+        display,
+        rotation_info[rotation_index].width,
+        rotation_info[rotation_index].height
+    );
+
+    mipi_display_set_xy_offset(
+        rotation_info[rotation_index].x_offset,
+        rotation_info[rotation_index].y_offset
+    );
+
+    display_width = rotation_info[rotation_index].width;
+    display_height = rotation_info[rotation_index].height;
+    screen_rotation_index = rotation_index;
+}
+
+static void window_rotate_init(window_rotate_context_t * c) {
+    // The boot code already applied a rotation to the screen.
+    c->rotation_index = screen_rotation_index;
 }
 
-static uint32_t window_rotate_draw(void * void_context) {
+static uint32_t window_rotate_draw(void) {
     hagl_color_t white = hagl_color(display, 255, 255, 255);
     hagl_color_t red = hagl_color(display, 255, 0, 0);
 
@@ -607,37 +1175,39 @@ static uint32_t window_rotate_draw(void * void_context) {
     hagl_draw_rectangle_xyxy(display, 2, 2, display_width-3, display_height-3, white);
 
     int r;
-    wchar_t str[40];
+    char str[40];
     int16_t x, y;
 
-    uint8_t const * font = font6x9;
+    uint8_t const * font = ui_font;
     int w=6;
     int scale=4;
 
-    r = swprintf(str, sizeof(str), L"Top");
+    r = fmt_str(str, "Top") - str;
     x = (display_width - (r * w * scale))/2;
     y = 5;
     hagl_put_text_scaled(display, str, x, y, red, scale, font);
 
-    hagl_flush(display);
+    display_flush();
     return 0;
 }
 
-static void window_rotate_cw(void * void_context) {
-    window_rotate_context_t * c = (window_rotate_context_t *)void_context;
+static void window_rotate_cw(window_rotate_context_t * c) {
     c->rotation_index = (c->rotation_index + 1) % 4;
-    set_screen_rotation(c);
+    set_screen_rotation(c->rotation_index);
 }
 
-static void window_rotate_ccw(void * void_context) {
-    window_rotate_context_t * c = (window_rotate_context_t *)void_context;
+static void window_rotate_ccw(window_rotate_context_t * c) {
     c->rotation_index = c->rotation_index - 1;
     if (c->rotation_index == -1) c->rotation_index = 3;
-    set_screen_rotation(c);
+    set_screen_rotation(c->rotation_index);
 }
 
-static void window_rotate_click(void * void_context) {
-    window_rotate_context_t * c = (window_rotate_context_t *)void_context;
+static void window_rotate_text(window_rotate_context_t * c, hmi_text_t * text) {
+    hmi_text_printf(text, 4, -1, "Rotate screen");
+    hmi_text_printf(text, 6, -1, "%d degrees", c->rotation_index * 90);
+}
+
+static void window_rotate_click(window_rotate_context_t * c) {
     flash_data.screen_rotation_index = c->rotation_index;
     write_flash();  // remember which screen orientation the user likes
     hmi_set_active_window(WINDOW_MAIN);
@@ -648,13 +1218,13 @@ static void window_rotate_click(void * void_context) {
 // Backlight window
 //
 
-static uint32_t window_backlight_draw(void * void_context) {
+static uint32_t window_backlight_draw(void) {
     int r;
 
-    wchar_t str[40];
+    char str[40];
     int16_t x, y;
 
-    uint8_t const * font = font6x9;
+    uint8_t const * font = ui_font;
     int w=6, h=9;
     int scale=2;
 
@@ -662,22 +1232,22 @@ static uint32_t window_backlight_draw(void * void_context) {
 
     hagl_clear(display);
 
-    r = swprintf(str, sizeof(str), L"Backlight");
+    r = fmt_str(str, "Backlight") - str;
     x = (display->width - (r * w * scale))/2;
     y = (display->height / 2) - (1 * h * scale);
     hagl_put_text_scaled(display, str, x, y, text_color, scale, font);
 
-    r = swprintf(str, sizeof(str), L"%d%%", (100 * backlight_duty_cycle)/backlight_duty_cycle_max);
+    r = fmt_str(fmt_uint(str, (100 * backlight_duty_cycle)/backlight_duty_cycle_max), "%") - str;
     x = (display->width - (r * w * scale))/2;
     y = (display->height / 2) + (1 * h * scale);
     hagl_put_text_scaled(display, str, x, y, text_color, scale, font);
 
-    hagl_flush(display);
+    display_flush();
 
     return 0;
 }
 
-static void window_backlight_cw(void * void_context) {
+static void window_backlight_cw(void) {
     backlight_duty_cycle += backlight_duty_cycle_delta;
     if (backlight_duty_cycle > backlight_duty_cycle_max) {
         backlight_duty_cycle = backlight_duty_cycle_max;
@@ -685,7 +1255,7 @@ static void window_backlight_cw(void * void_context) {
     pwm_set_chan_level(backlight_pwm_slice, PWM_CHAN_B, backlight_duty_cycle);
 }
 
-static void window_backlight_ccw(void * void_context) {
+static void window_backlight_ccw(void) {
     backlight_duty_cycle -= backlight_duty_cycle_delta;
     if (backlight_duty_cycle < 0) {
         backlight_duty_cycle = 0;
@@ -693,7 +1263,19 @@ static void window_backlight_ccw(void * void_context) {
     pwm_set_chan_level(backlight_pwm_slice, PWM_CHAN_B, backlight_duty_cycle);
 }
 
-static void window_backlight_click(void * void_context) {
+static void window_backlight_text(hmi_text_t * text) {
+    int percent = (100 * backlight_duty_cycle) / backlight_duty_cycle_max;
+    char bar[11];
+    for (int i = 0; i < 10; ++i) {
+        bar[i] = (i < percent / 10) ? '#' : '.';
+    }
+    bar[10] = '\0';
+
+    hmi_text_printf(text, 4, -1, "Backlight");
+    hmi_text_printf(text, 6, -1, "[%s] %d%%", bar, percent);
+}
+
+static void window_backlight_click(void) {
     flash_data.backlight_duty_cycle = backlight_duty_cycle;
     write_flash();  // remember which backlight brightness the user likes
     hmi_set_active_window(WINDOW_MAIN);
@@ -704,13 +1286,13 @@ static void window_backlight_click(void * void_context) {
 // Info window
 //
 
-static uint32_t window_info_draw(void * void_context) {
+static uint32_t window_info_draw(void) {
     int r;
 
-    wchar_t str[40];
+    char str[40];
     int16_t x, y;
 
-    uint8_t const * font = font6x9;
+    uint8_t const * font = ui_font;
     int w=6, h=9;
     int scale=2;
 
@@ -723,17 +1305,17 @@ static uint32_t window_info_draw(void * void_context) {
     // so it fits even when the screen is in narrow/portrait orientation.
     //
 
-    r = swprintf(str, sizeof(str), L"github.com/");
+    r = fmt_str(str, "github.com/") - str;
     x = (display->width - (r * w))/2;
     y = 2 * h;
     hagl_put_text_scaled(display, str, x, y, text_color, 1, font);
 
-    r = swprintf(str, sizeof(str), L"SebKuzminsky/");
+    r = fmt_str(str, "SebKuzminsky/") - str;
     x = (display->width - (r * w))/2;
     y = 3 * h;
     hagl_put_text_scaled(display, str, x, y, text_color, 1, font);
 
-    r = swprintf(str, sizeof(str), L"pd-sink-box");
+    r = fmt_str(str, "pd-sink-box") - str;
     x = (display->width - (r * w))/2;
     y = 4 * h;
     hagl_put_text_scaled(display, str, x, y, text_color, 1, font);
@@ -746,100 +1328,595 @@ static uint32_t window_info_draw(void * void_context) {
     int16_t y_start = 5 * h;  // This is how many rows are taken up by the URL at the top.
     int16_t y_center = y_start + (display->height - y_start)/2;
 
-    r = swprintf(str, sizeof(str), L"Firmware:");
+    r = fmt_str(str, "Firmware:") - str;
     x = (display->width - (r * w * scale))/2;
     y = y_center - (1 * h * scale);
     hagl_put_text_scaled(display, str, x, y, text_color, scale, font);
 
     // `version` is from version-info.c, generated at build time.
-    r = swprintf(str, sizeof(str), L"%s", version_info_commit);
+    r = fmt_str(str, version_info_commit) - str;
     x = (display->width - (r * w * scale))/2;
     y = y_center + (0 * h * scale);
     hagl_put_text_scaled(display, str, x, y, text_color, scale, font);
 
     // `dirty` is from version-info.c, generated at build time.
     if (strlen(version_info_dirty) > 0) {
-        r = swprintf(str, sizeof(str), L"%s", version_info_dirty);
+        r = fmt_str(str, version_info_dirty) - str;
         x = (display->width - (r * w * scale))/2;
         y = y_center + (1 * h * scale);
         hagl_put_text_scaled(display, str, x, y, text_color, scale, font);
     }
 
-    hagl_flush(display);
+    //
+    // Boot timing, and how long it took to restore the user's favorite
+    // PDO for this source, small at the bottom.
+    //
+
+    char * p;
+    if (warmboot_is_warm()) {
+        p = fmt_str(str, "warm boot: screen back ");
+        r = fmt_str(fmt_uint(p, boot_get_us(BOOT_PHASE_WARM_RESTORE) / 1000), "ms") - str;
+    } else {
+        p = fmt_str(str, "boot: frame ");
+        p = fmt_str(fmt_uint(p, boot_get_us(BOOT_PHASE_FIRST_FRAME) / 1000), "ms, PD ");
+        r = fmt_str(fmt_uint(p, boot_get_us(BOOT_PHASE_FIRST_CONTRACT) / 1000), "ms") - str;
+    }
+    x = (display->width - (r * w))/2;
+    y = display->height - (3 * h);
+    hagl_put_text_scaled(display, str, x, y, text_color, 1, font);
+
+    if (source_restore.last_restore_ms >= 0) {
+        r = fmt_str(fmt_uint(fmt_str(str, "PDO restore: "), source_restore.last_restore_ms), " ms") - str;
+        x = (display->width - (r * w))/2;
+        y = display->height - (2 * h);
+        hagl_put_text_scaled(display, str, x, y, text_color, 1, font);
+    }
+
+    display_flush();
 
     return 0;
 }
 
-static void window_info_any_interaction(void * void_context) {
+static void window_info_any_interaction(void) {
     hmi_set_active_window(WINDOW_MAIN);
 }
 
+static void window_info_text(hmi_text_t * text) {
+    hmi_text_printf(text, 1, -1, "github.com/SebKuzminsky/");
+    hmi_text_printf(text, 2, -1, "pd-sink-box");
+    hmi_text_printf(text, 5, -1, "Firmware:");
+    hmi_text_printf(text, 6, -1, "%s %s", version_info_commit, version_info_dirty);
+    if (source_restore.last_restore_ms >= 0) {
+        hmi_text_printf(text, 7, -1, "PDO restore: %d ms", source_restore.last_restore_ms);
+    }
+    for (int i = 0; i < BOOT_NUM_PHASES; ++i) {
+        hmi_text_printf(
+            text, 8 + (i / 3), (i % 3) * 11, "%.6s %lu",
+            boot_phase_name((boot_phase_t)i),
+            (unsigned long)(boot_get_us((boot_phase_t)i) / 1000)
+        );
+    }
+}
 
-static hmi_window_t windows[] = {
-    {
-        .id = WINDOW_MAIN,
-        .init = nullptr,
-        .draw = &window_main_draw,
-        .selected = nullptr,
-        .event_cw = &window_main_any_interaction,
-        .event_ccw = &window_main_any_interaction,
-        .event_click = &window_main_any_interaction
-    },
 
-    {
-        .id = WINDOW_MENU,
-        .init = &window_menu_init,
-        .draw = &window_menu_draw,
-        .selected = &window_menu_selected,
-        .event_cw = &window_menu_cw,
-        .event_ccw = &window_menu_ccw,
-        .event_click = &window_menu_click
-    },
+//
+// The Performance window shows live numbers for diagnosing a sluggish
+// or flaky unit.  Rates are computed over the time between redraws.
+// It redraws once a second, so its own drawing adds well under 1% to
+// the busy time it reports.
+//
 
-    {
-        .id = WINDOW_ROTATE,
-        .init = &window_rotate_init,
-        .draw = &window_rotate_draw,
-        .selected = nullptr,
-        .event_cw = &window_rotate_cw,
-        .event_ccw = &window_rotate_ccw,
-        .event_click = &window_rotate_click
-    },
+#define PERF_REDRAW_MS 1000
 
-    {
-        .id = WINDOW_BACKLIGHT,
-        .init = nullptr,
-        .draw = &window_backlight_draw,
-        .selected = nullptr,
-        .event_cw = &window_backlight_cw,
-        .event_ccw = &window_backlight_ccw,
-        .event_click = &window_backlight_click
-    },
+typedef struct {
+    bool have_sample;
+    uint64_t time_us;
+    uint64_t busy_us;
+    uint64_t idle_clock_us;
+    uint32_t i2c_transactions;
+    int i2c_comm_errors;
+
+    // Computed from the last two samples.
+    uint32_t busy_permille;
+    uint32_t idle_clock_percent;    // time at the idle clock, see sysclock.h
+    uint32_t i2c_per_sec;
+    uint32_t i2c_errors_per_min;
+
+    memstats_t mem;
+} window_perf_context_t;
+
+static void window_perf_selected(window_perf_context_t * c) {
+    c->have_sample = false;
+}
 
-    {
-        .id = WINDOW_INFO,
-        .init = nullptr,
-        .draw = &window_info_draw,
-        .selected = nullptr,
-        .event_cw = &window_info_any_interaction,
-        .event_ccw = &window_info_any_interaction,
-        .event_click = &window_info_any_interaction
-    },
+static void window_perf_sample(window_perf_context_t * c) {
+    uint64_t now = time_us_64();
+    uint64_t busy = perf_get_busy_us();
+    uint64_t idle_clock = sysclock_get_time_us(SYSCLOCK_IDLE);
+    uint32_t i2c_transactions = perf_get_i2c_transactions();
+
+    if (c->have_sample && (now > c->time_us)) {
+        uint64_t elapsed_us = now - c->time_us;
+        c->busy_permille = ((busy - c->busy_us) * 1000) / elapsed_us;
+        c->idle_clock_percent = ((idle_clock - c->idle_clock_us) * 100) / elapsed_us;
+        c->i2c_per_sec = ((uint64_t)(i2c_transactions - c->i2c_transactions) * 1000000) / elapsed_us;
+        // The count goes back to 0 when the host resets it (see
+        // USB_PROTO_OP_RESET_ERRORS), call that no errors.
+        int errors = i2c_comm_errors - c->i2c_comm_errors;
+        c->i2c_errors_per_min = (errors > 0) ? (((uint64_t)errors * 60000000) / elapsed_us) : 0;
+    } else {
+        c->busy_permille = 0;
+        c->idle_clock_percent = 0;
+        c->i2c_per_sec = 0;
+        c->i2c_errors_per_min = 0;
+    }
 
-    {
-        .id = -1  // secret handshake that means "end of window list"
+    c->have_sample = true;
+    c->time_us = now;
+    c->busy_us = busy;
+    c->idle_clock_us = idle_clock;
+    c->i2c_transactions = i2c_transactions;
+    c->i2c_comm_errors = i2c_comm_errors;
+
+    memstats_get(&c->mem);
+}
+
+// Formats line `i` of the Performance window into `str`, returns false
+// when there are no more lines.  Shared by the display and the text
+// rendition.
+static bool window_perf_line(window_perf_context_t * c, int i, char * str, size_t size) {
+    perf_timer_stats_t t;
+    int32_t ms;
+
+    switch (i) {
+    case 0:
+        snprintf(str, size, "core0 busy %lu.%lu%%",
+            (unsigned long)(c->busy_permille / 10), (unsigned long)(c->busy_permille % 10));
+        break;
+    case 1:
+        // Core1 only helps out during boot, see boot.h.
+        snprintf(str, size, "core1 off after boot");
+        break;
+    case 2:
+        perf_timer_get(PERF_DRAW, &t);
+        snprintf(str, size, "draw  %lu/%lu/%lu ms",
+            (unsigned long)(t.last_us / 1000), (unsigned long)(t.avg_us / 1000), (unsigned long)(t.max_us / 1000));
+        break;
+    case 3:
+        perf_timer_get(PERF_FLUSH, &t);
+        snprintf(str, size, "flush %lu/%lu/%lu ms",
+            (unsigned long)(t.last_us / 1000), (unsigned long)(t.avg_us / 1000), (unsigned long)(t.max_us / 1000));
+        break;
+    case 4:
+        snprintf(str, size, "i2c %lu/s", (unsigned long)c->i2c_per_sec);
+        break;
+    case 5:
+        snprintf(str, size, "i2c err %lu/min (%d)", (unsigned long)c->i2c_errors_per_min, i2c_comm_errors);
+        break;
+    case 6:
+        ms = perf_get_ms_since_flash_write();
+        if (ms < 0) {
+            snprintf(str, size, "flash: not written");
+        } else {
+            snprintf(str, size, "flash: %ld s ago", (long)(ms / 1000));
+        }
+        break;
+    case 7:
+        // Free now (and at the worst point since boot).  Signed, so a
+        // miscounted heap shows up as negative rather than wrapping.
+        snprintf(str, size, "heap free %ldK (%ldK)",
+            ((long)c->mem.heap_size - (long)c->mem.heap_in_use) / 1024,
+            ((long)c->mem.heap_size - (long)c->mem.heap_high_water) / 1024);
+        break;
+    case 8:
+        snprintf(str, size, "stack %lu/%lu",
+            (unsigned long)c->mem.stack0_high_water, (unsigned long)c->mem.stack0_size);
+        break;
+    case 9:
+        // Clock now, share of the time at the idle clock, and switches
+        // to the boost clock since boot.
+        snprintf(str, size, "clk %luM idle %lu%% %lusw",
+            (unsigned long)(sysclock_get_khz(sysclock_get_state()) / 1000),
+            (unsigned long)c->idle_clock_percent,
+            (unsigned long)(sysclock_get_switches(SYSCLOCK_BOOST)));
+        break;
+    case 10: {
+        snapshot_stats_t snap;
+        snapshot_get_stats(&snap);
+        snprintf(str, size, "snap %lu/%lu hit %luK",
+            (unsigned long)snap.hits,
+            (unsigned long)(snap.hits + snap.misses),
+            (unsigned long)(snap.bytes_used / 1024));
+        break;
+    }
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+static uint32_t window_perf_draw(window_perf_context_t * c) {
+
+    uint8_t const * font = ui_font;
+    int w=6, h=9;
+    int line_height = h + 2;
+
+    hagl_color_t title_color = hagl_color(display, 255, 255, 255);
+    hagl_color_t text_color = hagl_color(display, 150, 255, 150);
+
+    window_perf_sample(c);
+
+    hagl_clear(display);
+
+    int r;
+    char str[40];
+    int16_t x, y;
+
+    r = fmt_str(str, "Performance") - str;
+    x = (display->width - (r * w))/2;
+    y = 2;
+    hagl_put_text_scaled(display, str, x, y, title_color, 1, font);
+
+    for (int i = 0; window_perf_line(c, i, str, sizeof(str)); ++i) {
+        y = 2 + ((i + 1) * line_height);
+        hagl_put_text_scaled(display, str, 2, y, text_color, 1, font);
+    }
+
+    display_flush();
+
+    return PERF_REDRAW_MS;
+}
+
+static void window_perf_any_interaction(void) {
+    hmi_set_active_window(WINDOW_MAIN);
+}
+
+static void window_perf_text(window_perf_context_t * c, hmi_text_t * text) {
+    char line[HMI_TEXT_COLS + 1];
+
+    hmi_text_printf(text, 0, -1, "Performance");
+    for (int i = 0; window_perf_line(c, i, line, sizeof(line)); ++i) {
+        hmi_text_printf(text, i + 1, 1, "%s", line);
     }
+}
+
+
+//
+// The PD Bench window runs the source characterization (see
+// pd_bench.h) when it's selected, shows its progress, and then the
+// request-to-contract latencies of each PDO.  Click to stop it early.
+//
+
+#define BENCH_REPEATS 3
+#define BENCH_REDRAW_MS 100
+
+typedef struct {
+    int start_status;
+    uint32_t fingerprint;
+    int num_results;
+    pd_bench_result_t results[PD_NUM_PDOS];
+} window_bench_context_t;
+
+static void window_bench_selected(window_bench_context_t * c) {
+    c->start_status = pd_bench_start(BENCH_REPEATS);
+}
+
+static bool window_bench_line(window_bench_context_t * c, int i, char * str, size_t size) {
+    pd_bench_state_t state = pd_bench_get_state();
+    int run, repeats, millivolts;
+
+    if (c->start_status != PICO_OK) {
+        if (i > 0) {
+            return false;
+        }
+        snprintf(str, size, "needs a source with 2+ PDOs");
+        return true;
+    }
+
+    if (i == 0) {
+        pd_bench_get_progress(&run, &repeats, &millivolts);
+        if (state == PD_BENCH_RUNNING) {
+            if (millivolts > 0) {
+                snprintf(str, size, "run %d/%d: %dV", run, repeats, millivolts / 1000);
+            } else {
+                snprintf(str, size, "run %d/%d", run, repeats);
+            }
+        } else {
+            snprintf(str, size, "%s, source %08lx",
+                (state == PD_BENCH_ABORTED) ? "stopped" : "done", (unsigned long)c->fingerprint);
+        }
+        return true;
+    }
+    if (i == 1) {
+        snprintf(str, size, "    min/avg/max ms");
+        return true;
+    }
+
+    // A line of latencies per PDO, then a line for each PDO that had
+    // trouble.
+    i -= 2;
+    if (i < c->num_results) {
+        pd_bench_result_t * r = &c->results[i];
+        if (r->samples == 0) {
+            snprintf(str, size, "%2dV -", r->millivolts / 1000);
+        } else {
+            uint32_t avg_us = r->total_us / r->samples;
+            snprintf(str, size, "%2dV %lu.%lu/%lu.%lu/%lu.%lu",
+                r->millivolts / 1000,
+                (unsigned long)(r->min_us / 1000), (unsigned long)((r->min_us / 100) % 10),
+                (unsigned long)(avg_us / 1000), (unsigned long)((avg_us / 100) % 10),
+                (unsigned long)(r->max_us / 1000), (unsigned long)((r->max_us / 100) % 10));
+        }
+        return true;
+    }
+    i -= c->num_results;
+    for (int j = 0; j < c->num_results; ++j) {
+        pd_bench_result_t * r = &c->results[j];
+        if ((r->rejects == 0) && (r->resets == 0) && (r->timeouts == 0) && (r->i2c_errors == 0)) {
+            continue;
+        }
+        if (i-- == 0) {
+            // Only the counts that aren't 0, so it fits across the
+            // screen in portrait.
+            int n = snprintf(str, size, "%2dV", r->millivolts / 1000);
+            struct { int count; char const * name; } counts[] = {
+                { r->rejects, "rej" },
+                { r->resets, "rst" },
+                { r->timeouts, "t/o" },
+                { r->i2c_errors, "i2c" },
+            };
+            for (size_t k = 0; (k < count_of(counts)) && (n < (int)size); ++k) {
+                if (counts[k].count != 0) {
+                    n += snprintf(str + n, size - n, " %d %s", counts[k].count, counts[k].name);
+                }
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t window_bench_draw(window_bench_context_t * c) {
+    uint8_t const * font = ui_font;
+    int w=6, h=9;
+    int line_height = h + 2;
+
+    hagl_color_t title_color = hagl_color(display, 255, 255, 255);
+    hagl_color_t text_color = hagl_color(display, 150, 255, 150);
+
+    c->num_results = pd_bench_get_results(c->results, &c->fingerprint);
+
+    hagl_clear(display);
+
+    int r;
+    char str[40];
+    int16_t x, y;
+
+    r = fmt_str(str, "PD Bench") - str;
+    x = (display->width - (r * w))/2;
+    y = 2;
+    hagl_put_text_scaled(display, str, x, y, title_color, 1, font);
+
+    for (int i = 0; window_bench_line(c, i, str, sizeof(str)); ++i) {
+        y = 2 + ((i + 1) * line_height);
+        hagl_put_text_scaled(display, str, 2, y, text_color, 1, font);
+    }
+
+    display_flush();
+
+    if (pd_bench_get_state() == PD_BENCH_RUNNING) {
+        return BENCH_REDRAW_MS;
+    }
+    return 0;
+}
+
+static void window_bench_click(void) {
+    if (pd_bench_get_state() == PD_BENCH_RUNNING) {
+        pd_bench_stop();
+    } else {
+        hmi_set_active_window(WINDOW_MAIN);
+    }
+}
+
+static void window_bench_text(window_bench_context_t * c, hmi_text_t * text) {
+    char line[HMI_TEXT_COLS + 1];
+
+    c->num_results = pd_bench_get_results(c->results, &c->fingerprint);
+
+    hmi_text_printf(text, 0, -1, "PD Bench");
+    for (int i = 0; window_bench_line(c, i, line, sizeof(line)); ++i) {
+        hmi_text_printf(text, i + 1, 1, "%s", line);
+    }
+}
+
+
+//
+// The windows, in the order of hmi_window_id_t.  See hmi_window_set.h.
+//
+
+struct window_main_t : hmi_window {
+    static constexpr int id = WINDOW_MAIN;
+
+    uint32_t draw(void) { return window_main_draw(); }
+    void event_cw(void) { window_main_any_interaction(); }
+    void event_ccw(void) { window_main_any_interaction(); }
+    void event_click(void) { window_main_any_interaction(); }
+    void text(hmi_text_t * text) { window_main_text(text); }
+    uint32_t version(void) { return window_main_version(); }
+};
+
+struct window_menu_t : hmi_window {
+    static constexpr int id = WINDOW_MENU;
+    window_menu_context_t context;
+
+    void init(void) { window_menu_init(&context); }
+    uint32_t draw(void) { return window_menu_draw(&context); }
+    void selected(void) { window_menu_selected(&context); }
+    void event_cw(void) { window_menu_cw(&context); }
+    void event_ccw(void) { window_menu_ccw(&context); }
+    void event_click(void) { window_menu_click(&context); }
+    void text(hmi_text_t * text) { window_menu_text(&context, text); }
+    uint32_t version(void) { return window_menu_version(&context); }
+};
+
+struct window_rotate_t : hmi_window {
+    static constexpr int id = WINDOW_ROTATE;
+    window_rotate_context_t context;
+
+    void init(void) { window_rotate_init(&context); }
+    uint32_t draw(void) { return window_rotate_draw(); }
+    void event_cw(void) { window_rotate_cw(&context); }
+    void event_ccw(void) { window_rotate_ccw(&context); }
+    void event_click(void) { window_rotate_click(&context); }
+    void text(hmi_text_t * text) { window_rotate_text(&context, text); }
+};
+
+struct window_backlight_t : hmi_window {
+    static constexpr int id = WINDOW_BACKLIGHT;
+
+    uint32_t draw(void) { return window_backlight_draw(); }
+    void event_cw(void) { window_backlight_cw(); }
+    void event_ccw(void) { window_backlight_ccw(); }
+    void event_click(void) { window_backlight_click(); }
+    void text(hmi_text_t * text) { window_backlight_text(text); }
+};
+
+struct window_info_t : hmi_window {
+    static constexpr int id = WINDOW_INFO;
+
+    uint32_t draw(void) { return window_info_draw(); }
+    void event_cw(void) { window_info_any_interaction(); }
+    void event_ccw(void) { window_info_any_interaction(); }
+    void event_click(void) { window_info_any_interaction(); }
+    void text(hmi_text_t * text) { window_info_text(text); }
 };
 
+struct window_perf_t : hmi_window {
+    static constexpr int id = WINDOW_PERF;
+    window_perf_context_t context;
+
+    uint32_t draw(void) { return window_perf_draw(&context); }
+    void selected(void) { window_perf_selected(&context); }
+    void event_cw(void) { window_perf_any_interaction(); }
+    void event_ccw(void) { window_perf_any_interaction(); }
+    void event_click(void) { window_perf_any_interaction(); }
+    void text(hmi_text_t * text) { window_perf_text(&context, text); }
+};
+
+struct window_bench_t : hmi_window {
+    static constexpr int id = WINDOW_BENCH;
+    window_bench_context_t context;
+
+    uint32_t draw(void) { return window_bench_draw(&context); }
+    void selected(void) { window_bench_selected(&context); }
+    void event_click(void) { window_bench_click(); }
+    void text(hmi_text_t * text) { window_bench_text(&context, text); }
+};
+
+typedef hmi_window_set<
+    window_main_t,
+    window_menu_t,
+    window_rotate_t,
+    window_backlight_t,
+    window_info_t,
+    window_perf_t,
+    window_bench_t
+> windows_t;
+
+
+#if SNAPSHOT_CACHE_BYTES > 0
+// Frame cache hook for the HMI, see snapshot.h.
+static bool frame_cache_restore(int id, uint32_t version) {
+    if (!snapshot_restore(id, version)) {
+        return false;
+    }
+    display_flush();
+    return true;
+}
+#endif
+
+
+//
+// Display bring-up.  This runs on core1 at boot, so the (slow) display
+// reset and init sequence overlaps with i2c and HUSB238 discovery on
+// core0.  It puts a splash screen up as soon as the display is ready,
+// then tells core0 it's done.
+//
+
+static void core1_display_boot(void) {
+    display = hagl_init();
+    boot_mark(BOOT_PHASE_DISPLAY);
+
+    // This also clears the screen.
+    if (warm_boot && (warm_state.rotation_index < 4)) {
+        set_screen_rotation(warm_state.rotation_index);
+    } else {
+        set_screen_rotation(saved_rotation_index());
+    }
+
+    if (warm_boot) {
+        // Put what we showed before the reset back up, instead of the
+        // splash screen.
+        window_main_paint(warm_state.connected, warm_state.millivolts, warm_state.milliamps);
+        pwm_set_chan_level(backlight_pwm_slice, PWM_CHAN_B, backlight_duty_cycle);
+        boot_mark(BOOT_PHASE_FIRST_FRAME);
+        boot_mark(BOOT_PHASE_WARM_RESTORE);
+        multicore_fifo_push_blocking(0);
+        return;
+    }
+
+    uint8_t const * font = ui_font;
+    int w=6, h=9;
+    int scale=2;
+    char str[40];
+    int r;
+
+    r = fmt_str(str, "pd-sink-box") - str;
+    hagl_put_text_scaled(
+        display,
+        str,
+        (display->width - (r * w * scale))/2,
+        (display->height - (h * scale))/2,
+        hagl_color(display, 150, 150, 150),
+        scale,
+        font
+    );
+    hagl_flush(display);
+
+    // Now that there's something to look at, turn on the backlight.
+    pwm_set_chan_level(backlight_pwm_slice, PWM_CHAN_B, backlight_duty_cycle);
+    boot_mark(BOOT_PHASE_FIRST_FRAME);
+
+    multicore_fifo_push_blocking(0);
+}
+
+
+// What to put back after a watchdog reset, see warmboot.h.
+static void warmboot_get_state(warmboot_state_t * state) {
+    state->window = hmi_get_active_window();
+    state->rotation_index = screen_rotation_index;
+    state->connected = pd_events.attached;
+    state->millivolts = pd_events.attached ? pd_events.millivolts : 0;
+    state->milliamps = pd_events.attached ? pd_events.milliamps : 0;
+}
+
 
 int main() {
+    boot_mark(BOOT_PHASE_MAIN);
+    memstats_paint();
+
+    warm_boot = warmboot_init(&warm_state);
+
     stdio_init_all();
     // sleep_ms(3000);
+    boot_mark(BOOT_PHASE_STDIO);
 
     if (!read_flash()) {
         // Invalid flash, initialize to sane defaults.
         flash_data.backlight_duty_cycle = backlight_duty_cycle_max;
         flash_data.screen_rotation_index = 0;
+        memset(flash_data.source_profiles, 0, sizeof(flash_data.source_profiles));
     }
 
     backlight_duty_cycle = flash_data.backlight_duty_cycle;
@@ -848,17 +1925,28 @@ int main() {
     } else if (backlight_duty_cycle < 0) {
         backlight_duty_cycle = 0;
     }
+    boot_mark(BOOT_PHASE_SETTINGS);
 
-    display = hagl_init();
+    evlog_init(EVLOG_FLASH_OFFSET);
+
+#if HOT_IN_RAM
+    memcpy(font6x9_ram, font6x9, sizeof(font6x9_ram));
+    ui_font = font6x9_ram;
+#endif
 
-    // PWM control of backlight.
+    // PWM control of backlight.  Core1 turns the backlight on once
+    // it's drawn the first frame.
     gpio_set_function(MIPI_DISPLAY_PIN_BL, GPIO_FUNC_PWM);
     backlight_pwm_slice = pwm_gpio_to_slice_num(MIPI_DISPLAY_PIN_BL);
     pwm_set_wrap(backlight_pwm_slice, backlight_duty_cycle_max);
     // PWM channel A is not used.
-    pwm_set_chan_level(backlight_pwm_slice, PWM_CHAN_B, backlight_duty_cycle);
+    pwm_set_chan_level(backlight_pwm_slice, PWM_CHAN_B, 0);
     pwm_set_enabled(backlight_pwm_slice, true);
 
+    // Bring up the display on core1 while we get on with the rest.
+    // Core0 must not touch `display` until core1 reports back below.
+    multicore_launch_core1(core1_display_boot);
+
 #if defined RASPBERRYPI_PICO_W
     if (cyw43_arch_init()) {
         printf("failed to initialise\n");
@@ -876,9 +1964,10 @@ int main() {
 
     const uint sda_gpio = 16;  // pin 21
     const uint scl_gpio = 17;  // pin 22
+    const uint i2c_baudrate = 100*1000;  // run i2c at 100 kHz
 
     i2c = i2c0;
-    i2c_init(i2c, 100*1000);  // run i2c at 100 kHz
+    i2c_init(i2c, i2c_baudrate);
 
     // Initialize I2C pins
     gpio_set_function(sda_gpio, GPIO_FUNC_I2C);
@@ -886,13 +1975,98 @@ int main() {
 
     gpio_pull_up(sda_gpio);
     gpio_pull_up(scl_gpio);
+    boot_mark(BOOT_PHASE_I2C);
+
+
+    //
+    // If a source we know is attached, switch it to the user's favorite
+    // PDO before we draw anything.
+    //
+
+    // After a watchdog reset the HUSB238 still has the contract it had,
+    // so leave it be.
+    if (warm_boot) {
+        source_restore.attached = warm_state.connected;
+        pd_events.attached = warm_state.connected;
+        pd_events.millivolts = warm_state.millivolts;
+        pd_events.milliamps = warm_state.milliamps;
+    } else {
+        source_restore_poll();
+        while (source_restore.state == SOURCE_RESTORE_WAITING) {
+            source_restore_poll();
+        }
+    }
+
+
+    //
+    // Wait for core1 to finish with the display, then put core1 back
+    // to sleep in the bootrom so it's not running from flash when we
+    // write our settings.
+    //
+
+    multicore_fifo_pop_blocking();
+    multicore_reset_core1();
 
 
     //
     // Initialize the HMI.
     //
 
-    hmi_init(windows);
+    hmi_init_windows(&windows_t::ops);
+
+    // Back to the window we were in, unless it was the benchmark, which
+    // would start over.
+    if (warm_boot && (warm_state.window != WINDOW_BENCH) && (warm_state.window <= WINDOW_BENCH)) {
+        hmi_set_active_window(warm_state.window);
+    }
+
+
+    //
+    // Listen for the host on the USB serial port.
+    //
+
+    sched_init();
+    usb_proto_init(i2c, &i2c_comm_errors);
+
+    fb_mirror_init(display);
+
+    vt100_init();
+    hmi_add_background_task("vt100", vt100_poll, 10);
+
+    hmi_add_background_task("source restore", source_restore_poll, 5);
+
+    replay_init(WINDOW_MAIN);
+
+    hmi_add_background_task("pd events", pd_events_poll, 1000);
+    hmi_add_background_task("event log", evlog_poll, 1000);
+
+#if SNAPSHOT_CACHE_BYTES > 0
+    snapshot_init(display);
+    hmi_set_frame_cache(frame_cache_restore, snapshot_save);
+#endif
+
+    xip_stats_init();
+    memstats_init();
+    pd_bench_init(i2c, &i2c_comm_errors);
+    pd_seq_init(i2c, &i2c_comm_errors, PD_SEQ_FLASH_OFFSET);
+
+    text_runs_init(display, ui_font);
+
+    sysmon_init();
+    sysmon_set_handler(sysmon_event);
+    hmi_add_background_task("sysmon", sysmon_poll, 20);
+
+    warmboot_start(warmboot_get_state);
+
+    boot_mark(BOOT_PHASE_HMI);
+
+
+    //
+    // From here on the HMI decides the system clock: slow while idle,
+    // fast while handling input and drawing.
+    //
+
+    sysclock_init(MIPI_DISPLAY_SPI_PORT, MIPI_DISPLAY_SPI_CLOCK_SPEED_HZ, i2c, i2c_baudrate);
 
 
     //
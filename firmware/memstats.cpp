@@ -0,0 +1,107 @@
+#include <malloc.h>
+#include <unistd.h>
+
+#include "pico/platform.h"
+
+#include "memstats.h"
+#include "usb_proto.h"
+
+
+// Provided by the linker script (memmap_default.ld).
+extern "C" {
+    extern uint32_t __StackBottom;
+    extern uint32_t __StackTop;
+    extern uint32_t __StackOneBottom;
+    extern uint32_t __StackOneTop;
+    extern uint32_t end;
+    // The heap runs from `end` up to here, that's as far as the SDK's
+    // `_sbrk()` grows it.  __HeapLimit only marks the end of the
+    // PICO_HEAP_SIZE reservation, the least the heap can be.
+    extern uint32_t __StackLimit;
+}
+
+#define MEMSTATS_PAINT 0x5a5aa5a5
+
+// Leave this much of the live stack alone when painting core0's stack.
+#define MEMSTATS_STACK_MARGIN_WORDS 16
+
+// Where painting the heap started, everything below was in use at boot.
+static uint32_t * heap_paint_start;
+
+
+static void paint(uint32_t * start, uint32_t * stop) {
+    for (uint32_t * p = start; p < stop; ++p) {
+        *p = MEMSTATS_PAINT;
+    }
+}
+
+
+// Stacks grow down, so this finds the lowest word that's been written.
+static uint32_t stack_used(uint32_t * bottom, uint32_t * top) {
+    uint32_t * p = bottom;
+    while ((p < top) && (*p == MEMSTATS_PAINT)) {
+        ++p;
+    }
+    return (top - p) * sizeof(uint32_t);
+}
+
+
+void memstats_paint(void) {
+    uint32_t * sp = (uint32_t *)__builtin_frame_address(0);
+    paint(&__StackBottom, sp - MEMSTATS_STACK_MARGIN_WORDS);
+    paint(&__StackOneBottom, &__StackOneTop);
+
+    heap_paint_start = (uint32_t *)(((uintptr_t)sbrk(0) + 3) & ~3);
+    paint(heap_paint_start, &__StackLimit);
+}
+
+
+static void handle_get_mem_stats(uint8_t seq, uint8_t const * payload, size_t len) {
+    memstats_t stats;
+    memstats_get(&stats);
+
+    uint8_t reply[8 * 4];
+    usb_proto_put_u32(&reply[0], stats.static_bytes);
+    usb_proto_put_u32(&reply[4], stats.heap_size);
+    usb_proto_put_u32(&reply[8], stats.heap_high_water);
+    usb_proto_put_u32(&reply[12], stats.heap_in_use);
+    usb_proto_put_u32(&reply[16], stats.stack0_size);
+    usb_proto_put_u32(&reply[20], stats.stack0_high_water);
+    usb_proto_put_u32(&reply[24], stats.stack1_size);
+    usb_proto_put_u32(&reply[28], stats.stack1_high_water);
+    usb_proto_reply(USB_PROTO_OP_GET_MEM_STATS, seq, reply, sizeof(reply));
+}
+
+
+void memstats_init(void) {
+    usb_proto_add_handler(USB_PROTO_OP_GET_MEM_STATS, handle_get_mem_stats);
+}
+
+
+void memstats_get(memstats_t * stats) {
+    uintptr_t heap_start = (uintptr_t)&end;
+    uintptr_t heap_limit = (uintptr_t)&__StackLimit;
+
+    stats->static_bytes = heap_start - SRAM_BASE;
+    stats->heap_size = heap_limit - heap_start;
+
+    // The heap grows up.  Memory that was malloc'd but never written
+    // still looks painted, so also count everything below the current
+    // break.
+    uint32_t * p = &__StackLimit;
+    while ((p > heap_paint_start) && (p[-1] == MEMSTATS_PAINT)) {
+        --p;
+    }
+    uintptr_t high = (uintptr_t)p;
+    uintptr_t brk = (uintptr_t)sbrk(0);
+    if (brk > high) {
+        high = brk;
+    }
+    stats->heap_high_water = high - heap_start;
+    stats->heap_in_use = mallinfo().uordblks;
+
+    stats->stack0_size = (uintptr_t)&__StackTop - (uintptr_t)&__StackBottom;
+    stats->stack0_high_water = stack_used(&__StackBottom, &__StackTop);
+    stats->stack1_size = (uintptr_t)&__StackOneTop - (uintptr_t)&__StackOneBottom;
+    stats->stack1_high_water = stack_used(&__StackOneBottom, &__StackOneTop);
+}
@@ -0,0 +1,47 @@
+#ifndef __MEMSTATS_H__
+#define __MEMSTATS_H__
+
+#include <stdint.h>
+
+//
+// RAM usage and high-water marks.
+//
+// All of the firmware's own data is statically allocated; the heap is
+// only used by the display HAL (for the framebuffer) and by newlib.
+// `tools/memory-budget` prints the build-time budget of static data,
+// heap and stacks.
+//
+// At boot `memstats_paint()` fills both core stacks and the unused
+// part of the heap with a known pattern.  The high-water marks are
+// found later by looking for the deepest overwritten word, so they
+// include everything that happened since boot (including core1's
+// part in bringing up the display, see boot.h).
+//
+// The host reads the numbers with USB_PROTO_OP_GET_MEM_STATS (see
+// usb_proto.h), `tools/pd_sink_box.py mem` prints them.
+//
+
+typedef struct {
+    uint32_t static_bytes;          // .data + .bss, incl. code copied to SRAM
+    uint32_t heap_size;
+    uint32_t heap_high_water;       // most heap ever in use, in bytes
+    uint32_t heap_in_use;           // malloc'd right now
+    uint32_t stack0_size;
+    uint32_t stack0_high_water;
+    uint32_t stack1_size;
+    uint32_t stack1_high_water;
+} memstats_t;
+
+
+// Call this first thing in main(), before core1 is started.
+void memstats_paint(void);
+
+// Registers the USB protocol handler.
+void memstats_init(void);
+
+// This scans the painted regions, which takes a while (~1 ms), so
+// don't call it on every frame.
+void memstats_get(memstats_t * stats);
+
+
+#endif // __MEMSTATS_H__
@@ -0,0 +1,111 @@
+#include "fnv1a.h"
+#include "pd.h"
+
+
+#define PD_REG_SRC_PDO_5V 0x02  // then 9V, 12V, 15V, 18V, 20V
+
+// PD_STATUS0 bits 3:0 and SRC_PDO_xV bits 3:0.
+static uint16_t const current_code_ma[16] = {
+    500, 700, 1000, 1250, 1500, 1750, 2000, 2250,
+    2500, 2750, 3000, 3250, 3500, 4000, 4500, 5000,
+};
+
+// PD_STATUS0 bits 7:4, 0 means no contract.
+static uint16_t const voltage_code_mv[16] = {
+    0, 5000, 9000, 12000, 15000, 18000, 20000,
+};
+
+// The SRC_PDO_xV registers, in order.
+static struct {
+    uint8_t id;             // SRC_PDO selection code
+    uint16_t millivolts;
+} const pdo_info[PD_NUM_PDOS] = {
+    { 0x1, 5000 },
+    { 0x2, 9000 },
+    { 0x3, 12000 },
+    { 0x8, 15000 },
+    { 0x9, 18000 },
+    { 0xa, 20000 },
+};
+
+#define SRC_PDO_DETECTED 0x80
+
+
+static int read_reg(i2c_inst_t * i2c, uint8_t reg, uint8_t * value) {
+    int r = i2c_write_blocking(i2c, PD_I2C_ADDR, &reg, 1, true);
+    if (r != 1) {
+        return (r < 0) ? r : PICO_ERROR_GENERIC;
+    }
+    r = i2c_read_blocking(i2c, PD_I2C_ADDR, value, 1, false);
+    if (r != 1) {
+        return (r < 0) ? r : PICO_ERROR_GENERIC;
+    }
+    return PICO_OK;
+}
+
+
+int pd_status_millivolts(uint8_t pd_status0) {
+    return voltage_code_mv[pd_status0 >> 4];
+}
+
+
+bool pd_response_is_rejection(int response) {
+    return (response == PD_RESPONSE_INVALID)
+        || (response == PD_RESPONSE_NOT_SUPPORTED)
+        || (response == PD_RESPONSE_FAILED);
+}
+
+
+int pd_get_contract(i2c_inst_t * i2c, int * millivolts, int * milliamps) {
+    uint8_t status;
+    int r = read_reg(i2c, PD_REG_PD_STATUS0, &status);
+    if (r != PICO_OK) {
+        return r;
+    }
+    *millivolts = pd_status_millivolts(status);
+    *milliamps = (*millivolts > 0) ? current_code_ma[status & 0x0f] : 0;
+    return PICO_OK;
+}
+
+
+int pd_get_status(i2c_inst_t * i2c, uint8_t * status0, uint8_t * status1) {
+    int r = read_reg(i2c, PD_REG_PD_STATUS0, status0);
+    if (r != PICO_OK) {
+        return r;
+    }
+    return read_reg(i2c, PD_REG_PD_STATUS1, status1);
+}
+
+
+int pd_get_pdos(i2c_inst_t * i2c, pd_pdo_t pdos[PD_NUM_PDOS]) {
+    for (int i = 0; i < PD_NUM_PDOS; ++i) {
+        uint8_t reg;
+        int r = read_reg(i2c, PD_REG_SRC_PDO_5V + i, &reg);
+        if (r != PICO_OK) {
+            return r;
+        }
+        pdos[i].id = pdo_info[i].id;
+        pdos[i].millivolts = pdo_info[i].millivolts;
+        pdos[i].milliamps = (reg & SRC_PDO_DETECTED) ? current_code_ma[reg & 0x0f] : 0;
+    }
+    return PICO_OK;
+}
+
+
+uint32_t pd_source_fingerprint(pd_pdo_t const pdos[PD_NUM_PDOS]) {
+    // Over the id, volts and centiamps of each PDO, little-endian like
+    // the RP2040, so fingerprints saved before stay the same.
+    uint32_t hash = FNV1A_INIT;
+    for (int i = 0; i < PD_NUM_PDOS; ++i) {
+        uint32_t values[3] = {
+            (uint32_t)pdos[i].id,
+            (uint32_t)(pdos[i].millivolts / 1000),
+            (uint32_t)(pdos[i].milliamps / 10),
+        };
+        hash = fnv1a(hash, values, sizeof(values));
+    }
+    if (hash == 0) {
+        hash = 1;
+    }
+    return hash;
+}
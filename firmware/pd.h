@@ -0,0 +1,69 @@
+#ifndef __PD_H__
+#define __PD_H__
+
+#include "hardware/i2c.h"
+
+//
+// Integer access to the HUSB238's USB-PD status.
+//
+// The RP2040 has no FPU, and the HUSB238 driver reports currents as
+// floats, so anything that went through it pulled in soft-float code
+// on every redraw.  These read the HUSB238's status registers directly
+// and report whole millivolts and milliamps.
+//
+// PDO ids are the HUSB238's SRC_PDO selection codes, the same ones
+// `husb238_select_pdo()` and `husb238_get_current_pdo()` use.
+//
+
+#define PD_NUM_PDOS 6
+
+// For code that talks to the HUSB238 itself, such as coroutines that
+// use non-blocking i2c (see hmi_coro.h).
+#define PD_I2C_ADDR 0x08
+#define PD_REG_PD_STATUS0 0x00
+#define PD_REG_PD_STATUS1 0x01
+#define PD_REG_SRC_PDO 0x08        // PDO to request in bits 7:4
+#define PD_REG_GO_COMMAND 0x09
+#define PD_GO_SELECT_PDO 0x01      // request the PDO in SRC_PDO
+
+// PD_STATUS1 bits.
+#define PD_STATUS1_ATTACH 0x40
+#define PD_STATUS1_RESPONSE(status1) (((status1) >> 3) & 0x7)
+
+// PD_STATUS1 response codes, the source's answer to the last request.
+#define PD_RESPONSE_NONE 0
+#define PD_RESPONSE_SUCCESS 1
+#define PD_RESPONSE_INVALID 3
+#define PD_RESPONSE_NOT_SUPPORTED 4
+#define PD_RESPONSE_FAILED 5
+
+typedef struct {
+    int id;
+    int millivolts;
+    int milliamps;      // max current, 0 if the source doesn't offer this PDO
+} pd_pdo_t;
+
+
+// Reads the current contract.  `*millivolts` is 0 if there's no
+// contract.  Returns PICO_OK or an i2c error.
+int pd_get_contract(i2c_inst_t * i2c, int * millivolts, int * milliamps);
+
+// The contract voltage in a PD_STATUS0 value, 0 if there's no contract.
+int pd_status_millivolts(uint8_t pd_status0);
+
+// Whether a PD_STATUS1_RESPONSE() code means the source turned the
+// last request down.
+bool pd_response_is_rejection(int response);
+
+// Reads PD_STATUS0 and PD_STATUS1.  Returns PICO_OK or an i2c error.
+int pd_get_status(i2c_inst_t * i2c, uint8_t * status0, uint8_t * status1);
+
+// Reads the PDOs the source offers, lowest voltage first.  Returns
+// PICO_OK or an i2c error.
+int pd_get_pdos(i2c_inst_t * i2c, pd_pdo_t pdos[PD_NUM_PDOS]);
+
+// A hash of the PDOs a source offers, to tell sources apart.  Never 0.
+uint32_t pd_source_fingerprint(pd_pdo_t const pdos[PD_NUM_PDOS]);
+
+
+#endif // __PD_H__
@@ -0,0 +1,294 @@
+#include "pico/stdlib.h"
+
+#include "dlog.h"
+#include "husb238.h"
+#include "pd_bench.h"
+#include "pd_seq.h"
+#include "sched.h"
+#include "usb_proto.h"
+
+
+typedef enum {
+    PHASE_SETTLE,   // waiting to make the next request
+    PHASE_WAIT,     // requested a PDO, waiting for the contract
+} pd_bench_phase_t;
+
+static i2c_inst_t * bench_i2c;
+static int * bench_i2c_comm_errors;
+static sched_task_t * bench_task;
+
+static pd_bench_state_t state = PD_BENCH_IDLE;
+static pd_bench_phase_t phase;
+
+static pd_bench_result_t results[PD_NUM_PDOS];
+static int num_results;
+static uint32_t fingerprint;
+
+// The PDO that was active before the benchmark, to go back to.
+static int original_pdo;
+
+static int repeats;
+static int run;         // 1 .. repeats
+static int step;        // 0 .. num_results-1 within a run
+static int first;       // the result each run starts with
+
+static absolute_time_t settle_until;
+static uint32_t request_us;
+static uint8_t response_before;     // PD_STATUS1 response code before the request
+static bool saw_reset;
+
+
+static pd_bench_result_t * current(void) {
+    return &results[(first + step) % num_results];
+}
+
+
+static void finish(pd_bench_state_t final_state) {
+    sched_cancel(bench_task);
+    state = final_state;
+
+    if (original_pdo > 0) {
+        if (husb238_select_pdo(bench_i2c, original_pdo) != PICO_OK) {
+            ++*bench_i2c_comm_errors;
+        }
+    }
+
+    for (int i = 0; i < num_results; ++i) {
+        pd_bench_result_t * r = &results[i];
+        uint32_t avg_us = (r->samples > 0) ? r->total_us / r->samples : 0;
+        DLOG("bench %dmV: min %u avg %u max %u us", r->millivolts, r->min_us, avg_us, r->max_us);
+        DLOG("bench %dmV: %d rejects, %d resets, %d timeouts", r->millivolts, r->rejects, r->resets, r->timeouts);
+        DLOG("bench %dmV: %d i2c errors", r->millivolts, r->i2c_errors);
+    }
+}
+
+
+static void next_step(void) {
+    phase = PHASE_SETTLE;
+    settle_until = make_timeout_time_ms(PD_BENCH_SETTLE_MS);
+
+    if (++step < num_results) {
+        return;
+    }
+    step = 0;
+    if (++run > repeats) {
+        run = repeats;
+        finish(PD_BENCH_DONE);
+    }
+}
+
+
+static void request(void) {
+    pd_bench_result_t * r = current();
+    uint8_t status0, status1;
+
+    response_before = PD_RESPONSE_NONE;
+    if (pd_get_status(bench_i2c, &status0, &status1) == PICO_OK) {
+        response_before = PD_STATUS1_RESPONSE(status1);
+    }
+
+    if (husb238_select_pdo(bench_i2c, r->id) != PICO_OK) {
+        ++*bench_i2c_comm_errors;
+        ++r->i2c_errors;
+        next_step();
+        return;
+    }
+
+    request_us = time_us_32();
+    saw_reset = false;
+    phase = PHASE_WAIT;
+}
+
+
+// Task: one step of the benchmark.
+static void pd_bench_poll(void) {
+    if (phase == PHASE_SETTLE) {
+        if (time_reached(settle_until)) {
+            request();
+        }
+        return;
+    }
+
+    pd_bench_result_t * r = current();
+    uint32_t elapsed_us = time_us_32() - request_us;
+    uint8_t status0, status1;
+    int response = PD_RESPONSE_NONE;
+
+    if (pd_get_status(bench_i2c, &status0, &status1) != PICO_OK) {
+        ++*bench_i2c_comm_errors;
+    } else {
+        int millivolts = pd_status_millivolts(status0);
+        response = PD_STATUS1_RESPONSE(status1);
+
+        if ((!(status1 & PD_STATUS1_ATTACH) || (millivolts == 0)) && !saw_reset) {
+            saw_reset = true;
+            ++r->resets;
+            DLOG("bench %dmV: source reset after %u us", r->millivolts, elapsed_us);
+        }
+
+        if (millivolts == r->millivolts) {
+            ++r->samples;
+            r->total_us += elapsed_us;
+            if ((r->samples == 1) || (elapsed_us < r->min_us)) {
+                r->min_us = elapsed_us;
+            }
+            if (elapsed_us > r->max_us) {
+                r->max_us = elapsed_us;
+            }
+            next_step();
+            return;
+        }
+
+        // An error code that was already there before the request may
+        // be left over from an earlier one, wait and see.
+        if (pd_response_is_rejection(response) && (response != response_before)) {
+            ++r->rejects;
+            DLOG("bench %dmV: rejected (%d)", r->millivolts, response);
+            next_step();
+            return;
+        }
+    }
+
+    if (elapsed_us >= PD_BENCH_TIMEOUT_MS * 1000) {
+        if (pd_response_is_rejection(response)) {
+            ++r->rejects;
+        } else {
+            ++r->timeouts;
+        }
+        next_step();
+    }
+}
+
+
+static void handle_pd_bench_start(uint8_t seq, uint8_t const * payload, size_t len) {
+    if (len != 1) {
+        usb_proto_error(USB_PROTO_OP_PD_BENCH_START, seq, USB_PROTO_ERROR_BAD_LENGTH);
+        return;
+    }
+    int8_t status = pd_bench_start(payload[0]);
+    usb_proto_reply(USB_PROTO_OP_PD_BENCH_START, seq, (uint8_t const *)&status, 1);
+}
+
+
+static void handle_pd_bench_results(uint8_t seq, uint8_t const * payload, size_t len) {
+    uint8_t reply[8 + (PD_NUM_PDOS * 20)];
+    size_t r = 0;
+
+    reply[r++] = state;
+    usb_proto_put_u32(&reply[r], fingerprint);
+    r += 4;
+    reply[r++] = run;
+    reply[r++] = repeats;
+    reply[r++] = num_results;
+
+    for (int i = 0; i < num_results; ++i) {
+        pd_bench_result_t * res = &results[i];
+        reply[r++] = res->id;
+        usb_proto_put_u16(&reply[r], res->millivolts);
+        r += 2;
+        reply[r++] = res->samples;
+        usb_proto_put_u32(&reply[r], res->min_us);
+        usb_proto_put_u32(&reply[r + 4], (res->samples > 0) ? res->total_us / res->samples : 0);
+        usb_proto_put_u32(&reply[r + 8], res->max_us);
+        r += 12;
+        reply[r++] = res->rejects;
+        reply[r++] = res->resets;
+        reply[r++] = res->timeouts;
+        reply[r++] = res->i2c_errors;
+    }
+
+    usb_proto_reply(USB_PROTO_OP_PD_BENCH_RESULTS, seq, reply, r);
+}
+
+
+void pd_bench_init(i2c_inst_t * i2c, int * i2c_comm_errors) {
+    bench_i2c = i2c;
+    bench_i2c_comm_errors = i2c_comm_errors;
+    bench_task = sched_task_create("pd bench", pd_bench_poll);
+    usb_proto_add_handler(USB_PROTO_OP_PD_BENCH_START, handle_pd_bench_start);
+    usb_proto_add_handler(USB_PROTO_OP_PD_BENCH_RESULTS, handle_pd_bench_results);
+}
+
+
+int pd_bench_start(int n) {
+    pd_pdo_t pdos[PD_NUM_PDOS];
+    int r;
+
+    if (
+        (state == PD_BENCH_RUNNING)
+        || (pd_seq_get_state() == PD_SEQ_RUNNING)
+        || !husb238_connected(bench_i2c)
+    ) {
+        return PICO_ERROR_GENERIC;
+    }
+
+    r = pd_get_pdos(bench_i2c, pdos);
+    if (r == PICO_OK) {
+        r = husb238_get_current_pdo(bench_i2c, &original_pdo);
+    }
+    if (r != PICO_OK) {
+        ++*bench_i2c_comm_errors;
+        return r;
+    }
+
+    fingerprint = pd_source_fingerprint(pdos);
+    num_results = 0;
+    first = 0;
+    for (int i = 0; i < PD_NUM_PDOS; ++i) {
+        if (pdos[i].milliamps == 0) {
+            continue;
+        }
+        if (pdos[i].id == original_pdo) {
+            first = num_results + 1;
+        }
+        results[num_results] = (pd_bench_result_t) {
+            .id = pdos[i].id,
+            .millivolts = pdos[i].millivolts,
+        };
+        ++num_results;
+    }
+    if (num_results < 2) {
+        num_results = 0;
+        return PICO_ERROR_GENERIC;
+    }
+    first %= num_results;
+
+    repeats = (n < 1) ? 1 : (n > PD_BENCH_MAX_REPEATS) ? PD_BENCH_MAX_REPEATS : n;
+    run = 1;
+    step = 0;
+    phase = PHASE_SETTLE;
+    settle_until = get_absolute_time();
+    state = PD_BENCH_RUNNING;
+    DLOG("bench source %08x: %d PDOs, %d runs", fingerprint, num_results, repeats);
+
+    sched_start_periodic(bench_task, PD_BENCH_POLL_US);
+    return PICO_OK;
+}
+
+
+void pd_bench_stop(void) {
+    if (state == PD_BENCH_RUNNING) {
+        finish(PD_BENCH_ABORTED);
+    }
+}
+
+
+pd_bench_state_t pd_bench_get_state(void) {
+    return state;
+}
+
+
+void pd_bench_get_progress(int * run_number, int * num_repeats, int * millivolts) {
+    *run_number = run;
+    *num_repeats = repeats;
+    *millivolts = ((state == PD_BENCH_RUNNING) && (phase == PHASE_WAIT)) ? current()->millivolts : 0;
+}
+
+
+int pd_bench_get_results(pd_bench_result_t out[PD_NUM_PDOS], uint32_t * source_fingerprint) {
+    for (int i = 0; i < num_results; ++i) {
+        out[i] = results[i];
+    }
+    *source_fingerprint = fingerprint;
+    return num_results;
+}
@@ -0,0 +1,90 @@
+#ifndef __PD_BENCH_H__
+#define __PD_BENCH_H__
+
+#include <stdint.h>
+
+#include "hardware/i2c.h"
+
+#include "pd.h"
+
+//
+// USB-PD source characterization: how fast does a source renegotiate?
+//
+// A run walks every PDO the source offers, starting with the one after
+// the current contract so that every request really changes the
+// voltage.  For each PDO it calls `husb238_select_pdo()` and then polls
+// PD_STATUS0/1 every PD_BENCH_POLL_US until the contract reaches the
+// PDO's voltage.  The time from the request to the first poll that
+// sees the new contract is the latency.  Along the way it watches
+// for the source rejecting the request (PD_STATUS1 response code),
+// for resets (the HUSB238 dropping the attach bit or the contract), and
+// for requests that never complete.  Requests that never reach the
+// HUSB238 (an i2c error) are counted separately, they say nothing
+// about the source.  Repeat runs give min/avg/max.
+// When it's done it goes back to the PDO that was active before.
+//
+// The benchmark runs from a scheduler task, so the HMI stays live.
+// The Bench window (from the menu) runs it and shows the results,
+// the host runs it with USB_PROTO_OP_PD_BENCH_START and reads the
+// results with USB_PROTO_OP_PD_BENCH_RESULTS (see usb_proto.h),
+// `tools/pd_sink_box.py bench` does both.  Each PDO's results also go
+// to the log.
+//
+
+// The latencies are accurate to about this plus the ~1 ms it takes
+// to read the two status registers at 100 kHz.
+#define PD_BENCH_POLL_US 1000
+#define PD_BENCH_TIMEOUT_MS 2000
+
+// Let the source's output settle between requests.
+#define PD_BENCH_SETTLE_MS 250
+
+#define PD_BENCH_MAX_REPEATS 20
+
+
+typedef enum {
+    PD_BENCH_IDLE,
+    PD_BENCH_RUNNING,
+    PD_BENCH_DONE,
+    PD_BENCH_ABORTED,
+} pd_bench_state_t;
+
+typedef struct {
+    int id;
+    int millivolts;
+    int samples;        // requests that reached the contract
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    int rejects;
+    int resets;
+    int timeouts;
+    int i2c_errors;     // requests that failed on the i2c bus
+} pd_bench_result_t;
+
+
+// Registers the USB protocol handlers.  `i2c_comm_errors` is the
+// firmware's running count of failed HUSB238 transactions.
+void pd_bench_init(i2c_inst_t * i2c, int * i2c_comm_errors);
+
+// Start `repeats` runs.  Returns PICO_OK, PICO_ERROR_GENERIC if
+// there's no source offering at least two PDOs or a benchmark or a
+// PDO sequence (see pd_seq.h) is already running, or an i2c error.
+int pd_bench_start(int repeats);
+
+// Stop a benchmark that's running and go back to the original PDO.
+void pd_bench_stop(void);
+
+pd_bench_state_t pd_bench_get_state(void);
+
+// Where a running benchmark is: run number (from 1), of how many, and
+// the voltage it's waiting for (0 while settling).
+void pd_bench_get_progress(int * run, int * repeats, int * millivolts);
+
+// Copies out the results so far, one per PDO the source offers,
+// lowest voltage first.  Returns the number of results.  `*fingerprint`
+// identifies the source, see `pd_source_fingerprint()`.
+int pd_bench_get_results(pd_bench_result_t results[PD_NUM_PDOS], uint32_t * fingerprint);
+
+
+#endif // __PD_BENCH_H__
@@ -0,0 +1,400 @@
+#include <string.h>
+
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+
+#include "dlog.h"
+#include "evlog.h"
+#include "hmi.h"
+#include "husb238.h"
+#include "pd.h"
+#include "pd_bench.h"
+#include "pd_seq.h"
+#include "perf.h"
+#include "sched.h"
+#include "usb_proto.h"
+
+
+#define PD_SEQ_MAGIC 0x71657370     // "pseq"
+
+// Shortest hold time a step may have.
+#define MIN_HOLD_MS 10
+
+// How the script is stored in flash.
+typedef struct {
+    uint32_t magic;
+    pd_seq_script_t script;
+    uint32_t checksum;
+} stored_script_t;
+
+static_assert(sizeof(stored_script_t) <= FLASH_PAGE_SIZE, "the stored script must fit in one flash page");
+
+static i2c_inst_t * seq_i2c;
+static int * seq_i2c_comm_errors;
+static uint32_t seq_flash_offset;
+static sched_task_t * seq_task;
+
+static pd_seq_script_t script;
+static int pdo_ids[PD_SEQ_MAX_STEPS];   // for the script's voltages, found at start
+
+static pd_seq_state_t state = PD_SEQ_IDLE;
+
+// The next transition, and when it's due.
+static uint16_t next_run;
+static uint8_t next_step;
+static absolute_time_t next_due;
+
+// The last transition, while we wait for its contract.
+static bool verifying;
+static absolute_time_t requested_at;
+static uint8_t response_before;     // PD_STATUS1 response code before the request
+
+static pd_seq_transition_t transitions[PD_SEQ_LOG_SIZE];
+static uint32_t num_transitions;
+static int32_t jitter_min_us;
+static int32_t jitter_max_us;
+static int64_t jitter_total_us;
+
+
+static uint32_t checksum(pd_seq_script_t const * s) {
+    uint32_t sum = PD_SEQ_MAGIC;
+    for (size_t i = 0; i < sizeof(*s); ++i) {
+        sum = (sum << 1 | sum >> 31) ^ ((uint8_t const *)s)[i];
+    }
+    return sum;
+}
+
+
+static bool valid(pd_seq_script_t const * s) {
+    if ((s->num_steps == 0) || (s->num_steps > PD_SEQ_MAX_STEPS)) {
+        return false;
+    }
+    for (int i = 0; i < s->num_steps; ++i) {
+        if (s->steps[i].hold_ms < MIN_HOLD_MS) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static void store(void) {
+    static uint8_t page[FLASH_PAGE_SIZE];
+    stored_script_t stored;
+
+    memset(&stored, 0, sizeof(stored));
+    stored.magic = PD_SEQ_MAGIC;
+    stored.script = script;
+    stored.checksum = checksum(&script);
+
+    memset(page, 0xff, sizeof(page));
+    memcpy(page, &stored, sizeof(stored));
+
+    uint32_t ints = save_and_disable_interrupts();
+    flash_range_erase(seq_flash_offset, FLASH_SECTOR_SIZE);
+    flash_range_program(seq_flash_offset, page, FLASH_PAGE_SIZE);
+    restore_interrupts(ints);
+
+    perf_flash_written();
+}
+
+
+static pd_seq_transition_t * last_transition(void) {
+    return &transitions[(num_transitions - 1) % PD_SEQ_LOG_SIZE];
+}
+
+
+// The last transition is over, one way or another.
+static void transition_done(pd_seq_result_t result) {
+    pd_seq_transition_t * t = last_transition();
+
+    verifying = false;
+    t->result = result;
+    if (result == PD_SEQ_OK) {
+        t->contract_us = absolute_time_diff_us(requested_at, get_absolute_time());
+        hmi_request_redraw();
+    }
+    DLOG("seq run %d step %d: %dmV, jitter %d us", t->run, t->step, t->millivolts, t->jitter_us);
+    DLOG("seq run %d step %d: contract after %u us, result %d", t->run, t->step, t->contract_us, t->result);
+}
+
+
+static void finish(pd_seq_state_t final_state) {
+    sched_cancel(seq_task);
+    if (verifying) {
+        transition_done(PD_SEQ_SUPERSEDED);
+    }
+    state = final_state;
+    evlog_add(EVLOG_SEQUENCE, 0, next_run - 1);
+}
+
+
+// Make the transition that's due now.
+static void transition(void) {
+    if (verifying) {
+        transition_done(PD_SEQ_SUPERSEDED);
+    }
+
+    int32_t jitter_us = absolute_time_diff_us(next_due, get_absolute_time());
+    requested_at = get_absolute_time();
+    int r = husb238_select_pdo(seq_i2c, pdo_ids[next_step]);
+
+    pd_seq_transition_t * t = &transitions[num_transitions % PD_SEQ_LOG_SIZE];
+    *t = (pd_seq_transition_t) {
+        .run = next_run,
+        .step = next_step,
+        .millivolts = script.steps[next_step].millivolts,
+        .jitter_us = jitter_us,
+        .contract_us = 0,
+        .result = PD_SEQ_VERIFYING,
+    };
+    ++num_transitions;
+
+    if ((num_transitions == 1) || (jitter_us < jitter_min_us)) {
+        jitter_min_us = jitter_us;
+    }
+    if ((num_transitions == 1) || (jitter_us > jitter_max_us)) {
+        jitter_max_us = jitter_us;
+    }
+    jitter_total_us += jitter_us;
+
+    verifying = true;
+    if (r != PICO_OK) {
+        ++*seq_i2c_comm_errors;
+        transition_done(PD_SEQ_I2C_ERROR);
+    }
+
+    next_due = delayed_by_ms(next_due, script.steps[next_step].hold_ms);
+    if (++next_step == script.num_steps) {
+        next_step = 0;
+        ++next_run;
+    }
+}
+
+
+// Check on the contract for the last transition.
+static void verify(void) {
+    pd_seq_transition_t * t = last_transition();
+    uint8_t status0, status1;
+
+    if (pd_get_status(seq_i2c, &status0, &status1) != PICO_OK) {
+        ++*seq_i2c_comm_errors;
+    } else if (pd_status_millivolts(status0) == t->millivolts) {
+        transition_done(PD_SEQ_OK);
+        return;
+    } else if (pd_response_is_rejection(PD_STATUS1_RESPONSE(status1)) && (PD_STATUS1_RESPONSE(status1) != response_before)) {
+        transition_done(PD_SEQ_REJECTED);
+        return;
+    }
+
+    if (absolute_time_diff_us(requested_at, get_absolute_time()) >= PD_SEQ_CONTRACT_TIMEOUT_MS * 1000ll) {
+        transition_done(PD_SEQ_TIMEOUT);
+    }
+}
+
+
+// Task: make transitions when they're due, and verify them.  Always
+// reschedules itself for the next thing it has to do.
+static void pd_seq_poll(void) {
+    if (absolute_time_diff_us(get_absolute_time(), next_due) <= SCHED_TICK_US) {
+        if ((script.repeats != 0) && (next_run > script.repeats)) {
+            finish(PD_SEQ_DONE);
+            return;
+        }
+
+        // Get the response code out of the way before the deadline.
+        uint8_t status0, status1;
+        response_before = PD_RESPONSE_NONE;
+        if (pd_get_status(seq_i2c, &status0, &status1) == PICO_OK) {
+            response_before = PD_STATUS1_RESPONSE(status1);
+        }
+
+        busy_wait_until(next_due);
+        transition();
+    } else if (verifying) {
+        verify();
+    }
+
+    // Wake up a tick early for the next transition, so we can hit it
+    // exactly.
+    int64_t until_due_us = absolute_time_diff_us(get_absolute_time(), next_due) - SCHED_TICK_US;
+    if (until_due_us < 0) {
+        until_due_us = 0;
+    }
+    if (verifying && (until_due_us > PD_SEQ_POLL_US)) {
+        until_due_us = PD_SEQ_POLL_US;
+    }
+    sched_start_oneshot(seq_task, until_due_us);
+}
+
+
+static void handle_pd_seq_write(uint8_t seq, uint8_t const * payload, size_t len) {
+    if ((len < 2 + 6) || (((len - 2) % 6) != 0) || (((len - 2) / 6) > PD_SEQ_MAX_STEPS)) {
+        usb_proto_error(USB_PROTO_OP_PD_SEQ_WRITE, seq, USB_PROTO_ERROR_BAD_LENGTH);
+        return;
+    }
+
+    pd_seq_script_t s;
+    memset(&s, 0, sizeof(s));
+    s.repeats = payload[0] | (payload[1] << 8);
+    s.num_steps = (len - 2) / 6;
+    for (int i = 0; i < s.num_steps; ++i) {
+        uint8_t const * p = &payload[2 + (i * 6)];
+        s.steps[i].millivolts = p[0] | (p[1] << 8);
+        s.steps[i].hold_ms = p[2] | (p[3] << 8) | (p[4] << 16) | ((uint32_t)p[5] << 24);
+    }
+
+    int8_t status = pd_seq_set_script(&s);
+    usb_proto_reply(USB_PROTO_OP_PD_SEQ_WRITE, seq, (uint8_t const *)&status, 1);
+}
+
+
+static void handle_pd_seq_control(uint8_t seq, uint8_t const * payload, size_t len) {
+    if (len != 1) {
+        usb_proto_error(USB_PROTO_OP_PD_SEQ_CONTROL, seq, USB_PROTO_ERROR_BAD_LENGTH);
+        return;
+    }
+
+    int8_t status = PICO_OK;
+    if (payload[0]) {
+        status = pd_seq_start();
+    } else {
+        pd_seq_stop();
+    }
+    usb_proto_reply(USB_PROTO_OP_PD_SEQ_CONTROL, seq, (uint8_t const *)&status, 1);
+}
+
+
+static void handle_pd_seq_status(uint8_t seq, uint8_t const * payload, size_t len) {
+    if (len != 4) {
+        usb_proto_error(USB_PROTO_OP_PD_SEQ_STATUS, seq, USB_PROTO_ERROR_BAD_LENGTH);
+        return;
+    }
+
+    uint32_t first = payload[0] | (payload[1] << 8) | (payload[2] << 16) | ((uint32_t)payload[3] << 24);
+    if ((num_transitions > PD_SEQ_LOG_SIZE) && (first < num_transitions - PD_SEQ_LOG_SIZE)) {
+        first = num_transitions - PD_SEQ_LOG_SIZE;
+    }
+
+    uint8_t reply[27 + (12 * 14)];
+    size_t r = 0;
+
+    reply[r++] = state;
+    usb_proto_put_u16(&reply[r], next_run);
+    usb_proto_put_u16(&reply[r + 2], script.repeats);
+    r += 4;
+    reply[r++] = script.num_steps;
+    usb_proto_put_u32(&reply[r], num_transitions);
+    usb_proto_put_u32(&reply[r + 4], jitter_min_us);
+    usb_proto_put_u32(&reply[r + 8], jitter_max_us);
+    usb_proto_put_u32(&reply[r + 12], (num_transitions > 0) ? (int32_t)(jitter_total_us / num_transitions) : 0);
+    usb_proto_put_u32(&reply[r + 16], first);
+    r += 20;
+
+    uint8_t * n = &reply[r++];
+    *n = 0;
+    for (uint32_t i = first; (i < num_transitions) && (*n < 12); ++i) {
+        pd_seq_transition_t const * t = &transitions[i % PD_SEQ_LOG_SIZE];
+        usb_proto_put_u16(&reply[r], t->run);
+        reply[r + 2] = t->step;
+        usb_proto_put_u16(&reply[r + 3], t->millivolts);
+        usb_proto_put_u32(&reply[r + 5], t->jitter_us);
+        usb_proto_put_u32(&reply[r + 9], t->contract_us);
+        reply[r + 13] = t->result;
+        r += 14;
+        ++*n;
+    }
+
+    usb_proto_reply(USB_PROTO_OP_PD_SEQ_STATUS, seq, reply, r);
+}
+
+
+void pd_seq_init(i2c_inst_t * i2c, int * i2c_comm_errors, uint32_t flash_offset) {
+    seq_i2c = i2c;
+    seq_i2c_comm_errors = i2c_comm_errors;
+    seq_flash_offset = flash_offset;
+    seq_task = sched_task_create("pd sequence", pd_seq_poll);
+
+    stored_script_t const * stored = (stored_script_t const *)(XIP_BASE + flash_offset);
+    if ((stored->magic == PD_SEQ_MAGIC) && (stored->checksum == checksum(&stored->script)) && valid(&stored->script)) {
+        script = stored->script;
+    } else {
+        memset(&script, 0, sizeof(script));
+    }
+
+    usb_proto_add_handler(USB_PROTO_OP_PD_SEQ_WRITE, handle_pd_seq_write);
+    usb_proto_add_handler(USB_PROTO_OP_PD_SEQ_CONTROL, handle_pd_seq_control);
+    usb_proto_add_handler(USB_PROTO_OP_PD_SEQ_STATUS, handle_pd_seq_status);
+}
+
+
+int pd_seq_set_script(pd_seq_script_t const * s) {
+    if ((state == PD_SEQ_RUNNING) || !valid(s)) {
+        return PICO_ERROR_GENERIC;
+    }
+    script = *s;
+    store();
+    return PICO_OK;
+}
+
+
+int pd_seq_start(void) {
+    pd_pdo_t pdos[PD_NUM_PDOS];
+
+    if (
+        (state == PD_SEQ_RUNNING)
+        || (pd_bench_get_state() == PD_BENCH_RUNNING)
+        || (script.num_steps == 0)
+        || !husb238_connected(seq_i2c)
+    ) {
+        return PICO_ERROR_GENERIC;
+    }
+
+    int r = pd_get_pdos(seq_i2c, pdos);
+    if (r != PICO_OK) {
+        ++*seq_i2c_comm_errors;
+        return r;
+    }
+    for (int i = 0; i < script.num_steps; ++i) {
+        pdo_ids[i] = -1;
+        for (int j = 0; j < PD_NUM_PDOS; ++j) {
+            if ((pdos[j].millivolts == script.steps[i].millivolts) && (pdos[j].milliamps > 0)) {
+                pdo_ids[i] = pdos[j].id;
+            }
+        }
+        if (pdo_ids[i] < 0) {
+            return PICO_ERROR_GENERIC;
+        }
+    }
+
+    next_run = 1;
+    next_step = 0;
+    verifying = false;
+    num_transitions = 0;
+    jitter_total_us = 0;
+    jitter_min_us = 0;
+    jitter_max_us = 0;
+
+    // Leave a little room to hit the first transition on time.
+    next_due = make_timeout_time_us(2 * SCHED_TICK_US);
+    state = PD_SEQ_RUNNING;
+
+    evlog_add(EVLOG_SEQUENCE, 1, script.repeats);
+    DLOG("seq start: %d steps, %d runs", script.num_steps, script.repeats);
+
+    sched_start_oneshot(seq_task, SCHED_TICK_US);
+    return PICO_OK;
+}
+
+
+void pd_seq_stop(void) {
+    if (state == PD_SEQ_RUNNING) {
+        finish(PD_SEQ_STOPPED);
+    }
+}
+
+
+pd_seq_state_t pd_seq_get_state(void) {
+    return state;
+}
@@ -0,0 +1,102 @@
+#ifndef __PD_SEQ_H__
+#define __PD_SEQ_H__
+
+#include <stdint.h>
+
+#include "hardware/i2c.h"
+
+//
+// Scripted PDO sequences, for power-cycling a device under test.
+//
+// A script is a list of steps, each a voltage and how long to hold it,
+// run `repeats` times over (0: until stopped).  For example 5V for 2 s,
+// 20V for 10 s, 9V for 2 s, 100 times.  The host uploads it with
+// USB_PROTO_OP_PD_SEQ_WRITE (see usb_proto.h), which also stores it in
+// flash, and starts and stops it with USB_PROTO_OP_PD_SEQ_CONTROL;
+// `tools/pd_sink_box.py sequence` does all that and follows along.
+//
+// Transitions are scheduled against the sequence's start time, so the
+// hold times don't drift: step k of run n is due at the sum of all the
+// hold times before it.  A scheduler task wakes one tick
+// (SCHED_TICK_US) before each transition and busy-waits for the exact
+// time, then calls `husb238_select_pdo()`.  How late that call was is
+// the transition's jitter; it's small unless the main loop was busy
+// drawing when the transition came due.
+//
+// After each request the task polls PD_STATUS0/1 every PD_SEQ_POLL_US
+// until the contract is at the step's voltage, the source rejects the
+// request, or PD_SEQ_CONTRACT_TIMEOUT_MS goes by.  Each transition's
+// jitter, time to contract and outcome go into a log of the last
+// PD_SEQ_LOG_SIZE transitions, which the host reads with
+// USB_PROTO_OP_PD_SEQ_STATUS, and to DLOG.  Starting and finishing a
+// sequence go to the event log (see evlog.h).
+//
+// Everything runs from the scheduler between other tasks, so the knob
+// and the display keep working while a sequence runs.  The source
+// restore and the PD benchmark stay out of its way.
+//
+
+#define PD_SEQ_MAX_STEPS 16
+#define PD_SEQ_LOG_SIZE 32
+
+#define PD_SEQ_POLL_US 2000
+#define PD_SEQ_CONTRACT_TIMEOUT_MS 2000
+
+typedef struct {
+    uint16_t millivolts;
+    uint32_t hold_ms;
+} pd_seq_step_t;
+
+typedef struct {
+    uint16_t repeats;       // 0: forever
+    uint8_t num_steps;
+    pd_seq_step_t steps[PD_SEQ_MAX_STEPS];
+} pd_seq_script_t;
+
+typedef enum {
+    PD_SEQ_IDLE,
+    PD_SEQ_RUNNING,
+    PD_SEQ_DONE,
+    PD_SEQ_STOPPED,
+} pd_seq_state_t;
+
+typedef enum {
+    PD_SEQ_VERIFYING,       // still waiting for the contract
+    PD_SEQ_OK,
+    PD_SEQ_REJECTED,        // the source said no
+    PD_SEQ_TIMEOUT,         // no contract at the new voltage in time
+    PD_SEQ_SUPERSEDED,      // the next step came before the contract
+    PD_SEQ_I2C_ERROR,       // couldn't make the request
+} pd_seq_result_t;
+
+typedef struct {
+    uint16_t run;           // from 1
+    uint8_t step;           // from 0
+    uint16_t millivolts;
+    int32_t jitter_us;      // request time - scheduled time
+    uint32_t contract_us;   // request to verified contract
+    uint8_t result;         // pd_seq_result_t
+} pd_seq_transition_t;
+
+
+// Loads the stored script from the flash sector at `flash_offset`
+// and registers the USB protocol handlers.  `i2c_comm_errors` is the
+// firmware's running count of failed HUSB238 transactions.
+void pd_seq_init(i2c_inst_t * i2c, int * i2c_comm_errors, uint32_t flash_offset);
+
+// Replace the script, and store it in flash.  Returns PICO_OK, or
+// PICO_ERROR_GENERIC if a sequence is running or the script is
+// invalid.
+int pd_seq_set_script(pd_seq_script_t const * script);
+
+// Start the stored script.  Returns PICO_OK, or PICO_ERROR_GENERIC if
+// there's no script, no source, the source doesn't offer one of its
+// voltages, or something else is switching PDOs.
+int pd_seq_start(void);
+
+void pd_seq_stop(void);
+
+pd_seq_state_t pd_seq_get_state(void);
+
+
+#endif // __PD_SEQ_H__
@@ -0,0 +1,111 @@
+#include "hardware/i2c.h"
+#include "pico/time.h"
+
+#include "i2c_async.h"
+#include "perf.h"
+
+
+static perf_timer_stats_t timers[PERF_NUM_TIMERS];
+
+static uint64_t busy_us;
+
+static uint32_t i2c_transactions;
+
+static bool flash_written;
+static absolute_time_t flash_written_at;
+
+
+void perf_timer_record(perf_timer_t timer, uint32_t us) {
+    perf_timer_stats_t * t = &timers[timer];
+
+    t->last_us = us;
+    if (t->count == 0) {
+        t->avg_us = us;
+    } else {
+        t->avg_us = (int32_t)t->avg_us + ((int32_t)us - (int32_t)t->avg_us) / 8;
+    }
+    if (us > t->max_us) {
+        t->max_us = us;
+    }
+    ++t->count;
+}
+
+
+void perf_timer_get(perf_timer_t timer, perf_timer_stats_t * stats) {
+    *stats = timers[timer];
+}
+
+
+void perf_busy_add(uint32_t us) {
+    busy_us += us;
+}
+
+
+uint64_t perf_get_busy_us(void) {
+    return busy_us;
+}
+
+
+uint32_t perf_get_i2c_transactions(void) {
+    return i2c_transactions;
+}
+
+
+void perf_i2c_transaction(void) {
+    ++i2c_transactions;
+}
+
+
+void perf_flash_written(void) {
+    flash_written = true;
+    flash_written_at = get_absolute_time();
+}
+
+
+int32_t perf_get_ms_since_flash_write(void) {
+    if (!flash_written) {
+        return -1;
+    }
+    return absolute_time_diff_us(flash_written_at, get_absolute_time()) / 1000;
+}
+
+
+//
+// Link-time wrappers (`-Wl,--wrap=...`) that count i2c transactions.
+// The `_until` variants are what the SDK's `_timeout_us` functions
+// call.  They also let a non-blocking transaction in flight (see
+// i2c_async.h) finish before touching the controller.
+//
+
+extern "C" {
+
+int __real_i2c_write_blocking(i2c_inst_t * i2c, uint8_t addr, uint8_t const * src, size_t len, bool nostop);
+int __real_i2c_read_blocking(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop);
+int __real_i2c_write_blocking_until(i2c_inst_t * i2c, uint8_t addr, uint8_t const * src, size_t len, bool nostop, absolute_time_t until);
+int __real_i2c_read_blocking_until(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop, absolute_time_t until);
+
+int __wrap_i2c_write_blocking(i2c_inst_t * i2c, uint8_t addr, uint8_t const * src, size_t len, bool nostop) {
+    i2c_async_finish();
+    ++i2c_transactions;
+    return __real_i2c_write_blocking(i2c, addr, src, len, nostop);
+}
+
+int __wrap_i2c_read_blocking(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop) {
+    i2c_async_finish();
+    ++i2c_transactions;
+    return __real_i2c_read_blocking(i2c, addr, dst, len, nostop);
+}
+
+int __wrap_i2c_write_blocking_until(i2c_inst_t * i2c, uint8_t addr, uint8_t const * src, size_t len, bool nostop, absolute_time_t until) {
+    i2c_async_finish();
+    ++i2c_transactions;
+    return __real_i2c_write_blocking_until(i2c, addr, src, len, nostop, until);
+}
+
+int __wrap_i2c_read_blocking_until(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop, absolute_time_t until) {
+    i2c_async_finish();
+    ++i2c_transactions;
+    return __real_i2c_read_blocking_until(i2c, addr, dst, len, nostop, until);
+}
+
+}
@@ -0,0 +1,54 @@
+#ifndef __PERF_H__
+#define __PERF_H__
+
+#include <stdint.h>
+
+//
+// Cheap run-time performance counters, shown on the Performance window.
+//
+// Everything here is cumulative or a running average, readers sample
+// the counters periodically and compute rates from the differences.
+// Only core0 may record.
+//
+
+typedef enum {
+    PERF_DRAW,      // a window's draw(), including the flush
+    PERF_FLUSH,     // copying the framebuffer to the display
+    PERF_NUM_TIMERS
+} perf_timer_t;
+
+typedef struct {
+    uint32_t last_us;
+    uint32_t avg_us;    // exponential moving average over ~8 samples
+    uint32_t max_us;
+    uint32_t count;
+} perf_timer_stats_t;
+
+
+void perf_timer_record(perf_timer_t timer, uint32_t us);
+void perf_timer_get(perf_timer_t timer, perf_timer_stats_t * stats);
+
+// The HMI main loop reports the time it spends doing real work (drawing,
+// handling input, running background tasks), as opposed to waiting
+// for something to do.  Polling for input that isn't there doesn't
+// count, see `sched_task_set_polling()`.
+void perf_busy_add(uint32_t us);
+uint64_t perf_get_busy_us(void);
+
+// Number of i2c transactions since boot.  Counted by wrapping the SDK's
+// i2c functions at link time (see CMakeLists.txt), so it includes the
+// ones the HUSB238 driver makes.
+uint32_t perf_get_i2c_transactions(void);
+
+// Count a transaction that didn't go through the SDK's blocking
+// functions (see i2c_async.h).
+void perf_i2c_transaction(void);
+
+void perf_flash_written(void);
+
+// Milliseconds since the settings were last written to flash, or -1 if
+// they haven't been since boot.
+int32_t perf_get_ms_since_flash_write(void);
+
+
+#endif // __PERF_H__
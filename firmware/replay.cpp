@@ -0,0 +1,251 @@
+#include "pico/time.h"
+
+#include "perf.h"
+#include "replay.h"
+#include "sched.h"
+#include "usb_proto.h"
+
+
+// How often the task runs during a replay.  It only runs then.
+#define REPLAY_POLL_US 1000
+
+static int replay_home_window;
+static sched_task_t * replay_task;
+
+static replay_state_t replay_state;
+
+static replay_event_t events[REPLAY_MAX_EVENTS];
+static int num_events;
+
+// Draw times during the last replay.
+static uint32_t draw_us[REPLAY_MAX_DRAWS];
+static int num_draws;
+
+// When the current recording/replay started.
+static uint32_t start_us;
+
+// Index of the next event to replay.
+static int next_event;
+
+// Draw and ignored event counts the last time we looked, to spot new
+// ones.
+static uint32_t seen_draws;
+static uint32_t seen_ignored;
+
+// True while we're waiting for the draw caused by the last injected
+// event, and when that event was injected.
+static bool waiting_for_draw;
+static uint32_t injected_us;
+
+// True until the home window has been drawn at the start of a replay.
+// That draw isn't timed, and the replay clock starts after it.
+static bool settling;
+
+
+static void record_event(hmi_event_t event) {
+    if (num_events >= REPLAY_MAX_EVENTS) {
+        return;
+    }
+    events[num_events].time_us = time_us_32() - start_us;
+    events[num_events].event = event;
+    ++num_events;
+}
+
+
+void replay_start(replay_state_t state) {
+    hmi_set_input_observer(nullptr);
+
+    if (state != REPLAY_IDLE) {
+        hmi_set_active_window(replay_home_window);
+    }
+
+    switch (state) {
+    case REPLAY_IDLE:
+        break;
+
+    case REPLAY_RECORDING:
+        num_events = 0;
+        hmi_set_input_observer(record_event);
+        break;
+
+    case REPLAY_REPLAYING:
+    case REPLAY_REPLAYING_FAST:
+        num_draws = 0;
+        next_event = 0;
+        waiting_for_draw = false;
+        settling = true;
+        seen_draws = hmi_get_draw_count();
+        seen_ignored = hmi_get_ignored_count();
+        break;
+    }
+
+    start_us = time_us_32();
+    replay_state = state;
+
+    if ((state == REPLAY_REPLAYING) || (state == REPLAY_REPLAYING_FAST)) {
+        sched_start_periodic(replay_task, REPLAY_POLL_US);
+    } else {
+        sched_cancel(replay_task);
+    }
+}
+
+
+replay_state_t replay_get_state(void) {
+    return replay_state;
+}
+
+
+// Task: inject the next event when it's due.
+static void replay_poll(void) {
+    if ((replay_state != REPLAY_REPLAYING) && (replay_state != REPLAY_REPLAYING_FAST)) {
+        sched_cancel(replay_task);
+        return;
+    }
+
+    uint32_t draws = hmi_get_draw_count();
+    if (settling) {
+        if (draws != seen_draws) {
+            seen_draws = draws;
+            settling = false;
+            start_us = time_us_32();
+        }
+        return;
+    }
+
+    if (draws != seen_draws) {
+        perf_timer_stats_t t;
+        perf_timer_get(PERF_DRAW, &t);
+        if (num_draws < REPLAY_MAX_DRAWS) {
+            draw_us[num_draws++] = t.last_us;
+        }
+        seen_draws = draws;
+        waiting_for_draw = false;
+    }
+
+    // Not every event makes the window draw (turning the knob past the
+    // end of a menu, say), so don't wait for ever.
+    uint32_t ignored = hmi_get_ignored_count();
+    if (ignored != seen_ignored) {
+        seen_ignored = ignored;
+        waiting_for_draw = false;
+    }
+    if (waiting_for_draw && ((time_us_32() - injected_us) >= REPLAY_DRAW_TIMEOUT_US)) {
+        waiting_for_draw = false;
+    }
+
+    if (next_event >= num_events) {
+        if (!waiting_for_draw) {
+            replay_state = REPLAY_IDLE;
+            sched_cancel(replay_task);
+        }
+        return;
+    }
+
+    if (replay_state == REPLAY_REPLAYING_FAST) {
+        if (waiting_for_draw) {
+            return;
+        }
+    } else if ((time_us_32() - start_us) < events[next_event].time_us) {
+        return;
+    }
+
+    if (hmi_inject_event((hmi_event_t)events[next_event].event)) {
+        ++next_event;
+        waiting_for_draw = true;
+        injected_us = time_us_32();
+    }
+}
+
+
+//
+// USB protocol handlers.
+//
+
+static void handle_replay_control(uint8_t seq, uint8_t const * payload, size_t len) {
+    if ((len != 1) || (payload[0] > REPLAY_REPLAYING_FAST)) {
+        usb_proto_error(USB_PROTO_OP_REPLAY_CONTROL, seq, USB_PROTO_ERROR_BAD_LENGTH);
+        return;
+    }
+    replay_start((replay_state_t)payload[0]);
+    usb_proto_reply(USB_PROTO_OP_REPLAY_CONTROL, seq, nullptr, 0);
+}
+
+
+static void handle_replay_status(uint8_t seq, uint8_t const * payload, size_t len) {
+    uint8_t reply[7];
+    reply[0] = replay_state;
+    usb_proto_put_u16(&reply[1], num_events);
+    usb_proto_put_u16(&reply[3], next_event);
+    usb_proto_put_u16(&reply[5], num_draws);
+    usb_proto_reply(USB_PROTO_OP_REPLAY_STATUS, seq, reply, sizeof(reply));
+}
+
+
+// Events go over the wire as 5 bytes each: { time us u32, event u8 }.
+#define REPLAY_EVENT_WIRE_SIZE 5
+#define REPLAY_CHUNK_EVENTS ((USB_PROTO_MAX_PAYLOAD - 4) / REPLAY_EVENT_WIRE_SIZE)
+#define REPLAY_CHUNK_DRAWS ((USB_PROTO_MAX_PAYLOAD - 4) / 4)
+
+static void handle_replay_read(uint8_t seq, uint8_t const * payload, size_t len) {
+    if (len != 3) {
+        usb_proto_error(USB_PROTO_OP_REPLAY_READ, seq, USB_PROTO_ERROR_BAD_LENGTH);
+        return;
+    }
+
+    uint8_t reply[USB_PROTO_MAX_PAYLOAD];
+    size_t reply_len = 4;
+    int offset = usb_proto_get_u16(&payload[1]);
+
+    if (payload[0] == 0) {
+        usb_proto_put_u16(&reply[0], num_events);
+        for (int i = offset; (i < num_events) && (i < offset + REPLAY_CHUNK_EVENTS); ++i) {
+            usb_proto_put_u32(&reply[reply_len], events[i].time_us);
+            reply[reply_len + 4] = events[i].event;
+            reply_len += REPLAY_EVENT_WIRE_SIZE;
+        }
+    } else {
+        usb_proto_put_u16(&reply[0], num_draws);
+        for (int i = offset; (i < num_draws) && (i < offset + REPLAY_CHUNK_DRAWS); ++i) {
+            usb_proto_put_u32(&reply[reply_len], draw_us[i]);
+            reply_len += 4;
+        }
+    }
+    usb_proto_put_u16(&reply[2], offset);
+
+    usb_proto_reply(USB_PROTO_OP_REPLAY_READ, seq, reply, reply_len);
+}
+
+
+static void handle_replay_write(uint8_t seq, uint8_t const * payload, size_t len) {
+    if ((len < 2) || (((len - 2) % REPLAY_EVENT_WIRE_SIZE) != 0)) {
+        usb_proto_error(USB_PROTO_OP_REPLAY_WRITE, seq, USB_PROTO_ERROR_BAD_LENGTH);
+        return;
+    }
+
+    int offset = usb_proto_get_u16(&payload[0]);
+    int n = (len - 2) / REPLAY_EVENT_WIRE_SIZE;
+    if ((offset > num_events) || (offset + n > REPLAY_MAX_EVENTS)) {
+        usb_proto_error(USB_PROTO_OP_REPLAY_WRITE, seq, USB_PROTO_ERROR_BAD_LENGTH);
+        return;
+    }
+
+    replay_start(REPLAY_IDLE);
+    for (int i = 0; i < n; ++i) {
+        uint8_t const * p = &payload[2 + (i * REPLAY_EVENT_WIRE_SIZE)];
+        events[offset + i].time_us = usb_proto_get_u32(p);
+        events[offset + i].event = p[4];
+    }
+    num_events = offset + n;
+
+    usb_proto_reply(USB_PROTO_OP_REPLAY_WRITE, seq, nullptr, 0);
+}
+
+
+void replay_init(int home_window) {
+    replay_home_window = home_window;
+    replay_task = sched_task_create("replay", replay_poll);
+    usb_proto_add_handler(USB_PROTO_OP_REPLAY_CONTROL, handle_replay_control);
+    usb_proto_add_handler(USB_PROTO_OP_REPLAY_STATUS, handle_replay_status);
+    usb_proto_add_handler(USB_PROTO_OP_REPLAY_READ, handle_replay_read);
+    usb_proto_add_handler(USB_PROTO_OP_REPLAY_WRITE, handle_replay_write);
+}
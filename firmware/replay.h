@@ -0,0 +1,62 @@
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include <stdint.h>
+
+#include "hmi.h"
+
+//
+// Input record & replay, for repeatable latency regression runs.
+//
+// While recording, every event from the knob is stored with its time
+// (microseconds since the recording started) in a RAM buffer.  A
+// replay feeds the recorded events back in through the HMI's normal
+// dispatch path (`hmi_inject_event()`), bypassing the PIO FIFOs,
+// either with the original timing or as fast as possible, and records
+// how long each draw() took while it runs.  As-fast-as-possible mode
+// waits for the draw that each event causes before injecting the next
+// one, so every event that draws gets exactly one timed draw.  Events
+// that the window ignores don't draw, so it moves on to the next one
+// as soon as the HMI reports an event ignored, and in any case after
+// REPLAY_DRAW_TIMEOUT_US, without a draw time.
+//
+// Both recording and replay start by switching to the "home" window,
+// so a replay sees the same screens as the recording did.
+//
+// The host uploads and downloads recordings and reads the draw times
+// over USB, see the USB_PROTO_OP_REPLAY_* ops in usb_proto.h and the
+// `record` and `replay` commands of tools/pd_sink_box.py.
+//
+
+#define REPLAY_MAX_EVENTS 512
+#define REPLAY_MAX_DRAWS 512
+
+// Longest wait for the draw an event causes.  Selecting a PDO from the
+// menu draws once the new contract is up, which can take a second.
+#define REPLAY_DRAW_TIMEOUT_US (2000 * 1000)
+
+typedef enum {
+    REPLAY_IDLE = 0,
+    REPLAY_RECORDING = 1,
+    REPLAY_REPLAYING = 2,
+    REPLAY_REPLAYING_FAST = 3,
+} replay_state_t;
+
+typedef struct {
+    uint32_t time_us;
+    uint8_t event;  // hmi_event_t
+} replay_event_t;
+
+
+// Registers the USB protocol handlers, and creates the task that runs
+// replays.
+void replay_init(int home_window);
+
+// Start recording or replaying, stops whatever was going on before.
+// REPLAY_IDLE stops.
+void replay_start(replay_state_t state);
+
+replay_state_t replay_get_state(void);
+
+
+#endif // __REPLAY_H__
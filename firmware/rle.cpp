@@ -0,0 +1,50 @@
+#include <string.h>
+
+#include "hot.h"
+#include "rle.h"
+
+
+size_t HOT_FUNC(rle_encode)(uint16_t const * pixels, size_t num_pixels, uint8_t * out, size_t out_size, size_t * pixels_consumed) {
+    size_t in_index = 0;
+    size_t out_index = 0;
+
+    while ((in_index < num_pixels) && (out_index + RLE_RUN_BYTES <= out_size)) {
+        uint16_t pixel = pixels[in_index];
+        size_t run = 1;
+        while (
+            (in_index + run < num_pixels)
+            && (run < RLE_MAX_RUN)
+            && (pixels[in_index + run] == pixel)
+        ) {
+            ++run;
+        }
+
+        out[out_index] = run - 1;
+        memcpy(&out[out_index + 1], &pixel, sizeof(pixel));
+        out_index += RLE_RUN_BYTES;
+        in_index += run;
+    }
+
+    *pixels_consumed = in_index;
+    return out_index;
+}
+
+
+size_t rle_decode(uint8_t const * in, size_t len, uint16_t * pixels, size_t max_pixels) {
+    size_t out_index = 0;
+
+    for (size_t i = 0; i + RLE_RUN_BYTES <= len; i += RLE_RUN_BYTES) {
+        size_t run = in[i] + 1;
+        uint16_t pixel;
+        memcpy(&pixel, &in[i + 1], sizeof(pixel));
+
+        if (out_index + run > max_pixels) {
+            run = max_pixels - out_index;
+        }
+        for (size_t j = 0; j < run; ++j) {
+            pixels[out_index++] = pixel;
+        }
+    }
+
+    return out_index;
+}
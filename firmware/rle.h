@@ -0,0 +1,31 @@
+#ifndef __RLE_H__
+#define __RLE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Run-length encoding of 16-bit pixels, used for framebuffer mirroring
+// and snapshots.  Our screens are mostly solid black with a bit of
+// text, so this compresses very well.
+//
+// The encoded data is a sequence of runs, each 3 bytes:
+//     (run length - 1) u8, pixel u16 (in memory byte order)
+//
+
+#define RLE_RUN_BYTES 3
+#define RLE_MAX_RUN 256
+
+
+// Encode up to `num_pixels` pixels into `out`, stopping early if the
+// next run would not fit in `out_size` bytes.  Returns the number of
+// bytes written and stores the number of pixels consumed in
+// `*pixels_consumed`.
+size_t rle_encode(uint16_t const * pixels, size_t num_pixels, uint8_t * out, size_t out_size, size_t * pixels_consumed);
+
+// Decode `len` bytes of runs into `pixels`, writing at most
+// `max_pixels` pixels.  Returns the number of pixels written.
+size_t rle_decode(uint8_t const * in, size_t len, uint16_t * pixels, size_t max_pixels);
+
+
+#endif // __RLE_H__
@@ -0,0 +1,306 @@
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "hot.h"
+#include "perf.h"
+#include "sched.h"
+#include "usb_proto.h"
+
+
+static_assert((SCHED_WHEEL_SLOTS & (SCHED_WHEEL_SLOTS - 1)) == 0, "SCHED_WHEEL_SLOTS must be a power of 2");
+static_assert(SCHED_MAX_TASKS <= 32, "sched_post() keeps a bit per task in a u32");
+
+struct sched_task {
+    char const * name;
+    void (*run)(void);
+    uint32_t period_us;     // 0 for one-shot
+    bool polling;           // run time isn't busy time, see sched_task_set_polling()
+
+    bool pending;
+    uint64_t deadline_us;
+    sched_task_t * next;    // next in the same wheel slot
+
+    sched_task_stats_t stats;
+};
+
+static sched_task_t tasks[SCHED_MAX_TASKS];
+static int num_tasks;
+
+// Each slot is a list of pending tasks sorted by deadline.
+static sched_task_t * wheel[SCHED_WHEEL_SLOTS];
+static int num_pending;
+
+// The tick `sched_run()` has dispatched everything up to (but not
+// necessarily including).  No pending task has a deadline before it.
+static uint64_t current_tick;
+
+// Bit i: `tasks[i]` was posted, see `sched_post()`.  Interrupt handlers
+// set bits, only `sched_run()` clears them.
+static volatile uint32_t posted;
+
+
+static inline uint64_t tick_of(uint64_t us) {
+    return us / SCHED_TICK_US;
+}
+
+
+static inline sched_task_t ** slot_of(uint64_t us) {
+    return &wheel[tick_of(us) & (SCHED_WHEEL_SLOTS - 1)];
+}
+
+
+static void insert(sched_task_t * task, uint64_t deadline_us) {
+    sched_task_t ** p = slot_of(deadline_us);
+    while ((*p != nullptr) && ((*p)->deadline_us <= deadline_us)) {
+        p = &(*p)->next;
+    }
+    task->deadline_us = deadline_us;
+    task->next = *p;
+    *p = task;
+    task->pending = true;
+    ++num_pending;
+}
+
+
+static void unlink(sched_task_t * task) {
+    sched_task_t ** p = slot_of(task->deadline_us);
+    while (*p != task) {
+        p = &(*p)->next;
+    }
+    *p = task->next;
+    task->next = nullptr;
+    task->pending = false;
+    --num_pending;
+}
+
+
+static void handle_get_task_stats(uint8_t seq, uint8_t const * payload, size_t len) {
+    if (len != 1) {
+        usb_proto_error(USB_PROTO_OP_GET_TASK_STATS, seq, USB_PROTO_ERROR_BAD_LENGTH);
+        return;
+    }
+
+    uint8_t reply[1 + 6 * 4 + 32];
+    size_t r = 0;
+    char const * name;
+    uint32_t period_us;
+    sched_task_stats_t stats;
+
+    reply[r++] = num_tasks;
+    if (sched_get_task_stats(payload[0], &name, &period_us, &stats)) {
+        usb_proto_put_u32(&reply[r], period_us);
+        usb_proto_put_u32(&reply[r + 4], stats.runs);
+        usb_proto_put_u32(&reply[r + 8], stats.total_us > UINT32_MAX ? UINT32_MAX : stats.total_us);
+        usb_proto_put_u32(&reply[r + 12], stats.max_us);
+        usb_proto_put_u32(&reply[r + 16], stats.max_late_us);
+        usb_proto_put_u32(&reply[r + 20], stats.skipped);
+        r += 24;
+        for (int i = 0; (name[i] != '\0') && (r < sizeof(reply)); ++i) {
+            reply[r++] = name[i];
+        }
+    }
+
+    usb_proto_reply(USB_PROTO_OP_GET_TASK_STATS, seq, reply, r);
+}
+
+
+void sched_init(void) {
+    current_tick = tick_of(time_us_64());
+    usb_proto_add_handler(USB_PROTO_OP_GET_TASK_STATS, handle_get_task_stats);
+}
+
+
+sched_task_t * sched_task_create(char const * name, void (*run)(void)) {
+    if (num_tasks >= SCHED_MAX_TASKS) {
+        return nullptr;
+    }
+    sched_task_t * task = &tasks[num_tasks++];
+    task->name = name;
+    task->run = run;
+    return task;
+}
+
+
+void sched_task_set_polling(sched_task_t * task, bool polling) {
+    task->polling = polling;
+}
+
+
+void sched_start_oneshot(sched_task_t * task, uint32_t delay_us) {
+    if (task->pending) {
+        unlink(task);
+    }
+    task->period_us = 0;
+    insert(task, time_us_64() + delay_us);
+}
+
+
+void sched_start_periodic(sched_task_t * task, uint32_t period_us) {
+    if (task->pending) {
+        unlink(task);
+    }
+    task->period_us = period_us;
+    insert(task, time_us_64());
+}
+
+
+void sched_cancel(sched_task_t * task) {
+    if (task->pending) {
+        unlink(task);
+    }
+    task->period_us = 0;
+}
+
+
+bool sched_is_pending(sched_task_t const * task) {
+    return task->pending;
+}
+
+
+void sched_post(sched_task_t * task) {
+    uint32_t save = save_and_disable_interrupts();
+    posted = posted | (1u << (task - tasks));
+    restore_interrupts(save);
+
+    // If this lands between `sched_run()` and the WFE in
+    // `sched_sleep()`, the WFE returns right away.
+    __sev();
+}
+
+
+// Move the posted tasks' deadlines to now.
+static void take_posted(uint64_t now_us) {
+    uint32_t save = save_and_disable_interrupts();
+    uint32_t p = posted;
+    posted = 0;
+    restore_interrupts(save);
+
+    for (int i = 0; p != 0; ++i, p >>= 1) {
+        if (p & 1) {
+            if (tasks[i].pending) {
+                unlink(&tasks[i]);
+            }
+            insert(&tasks[i], now_us);
+        }
+    }
+}
+
+
+// The earliest deadline of all pending tasks.  Only the heads of the
+// slots need looking at, each slot is sorted.
+static uint64_t earliest_deadline_us(void) {
+    uint64_t earliest = UINT64_MAX;
+    for (int i = 0; i < SCHED_WHEEL_SLOTS; ++i) {
+        if ((wheel[i] != nullptr) && (wheel[i]->deadline_us < earliest)) {
+            earliest = wheel[i]->deadline_us;
+        }
+    }
+    return earliest;
+}
+
+
+static void dispatch(sched_task_t * task, uint64_t now_us) {
+    uint64_t deadline_us = task->deadline_us;
+    uint32_t late_us = now_us - deadline_us;
+
+    unlink(task);
+
+    // Reschedule a periodic task before running it, so it can cancel
+    // or restart itself.
+    if (task->period_us != 0) {
+        uint64_t next_us = deadline_us + task->period_us;
+        if (next_us <= now_us) {
+            uint32_t missed = (now_us - next_us) / task->period_us + 1;
+            task->stats.skipped += missed;
+            next_us += (uint64_t)missed * task->period_us;
+        }
+        insert(task, next_us);
+    }
+
+    uint32_t start = time_us_32();
+    task->run();
+    uint32_t us = time_us_32() - start;
+
+    if (!task->polling) {
+        perf_busy_add(us);
+    }
+    ++task->stats.runs;
+    task->stats.total_us += us;
+    if (us > task->stats.max_us) {
+        task->stats.max_us = us;
+    }
+    if (late_us > task->stats.max_late_us) {
+        task->stats.max_late_us = late_us;
+    }
+}
+
+
+void HOT_FUNC(sched_run)(void) {
+    uint64_t now_us = time_us_64();
+    uint64_t now_tick = tick_of(now_us);
+
+    if (posted != 0) {
+        take_posted(now_us);
+    }
+
+    if (num_pending == 0) {
+        current_tick = now_tick;
+        return;
+    }
+
+    // After a long sleep, skip straight to the first tick that has
+    // anything in it instead of visiting every empty one.
+    uint64_t earliest_tick = tick_of(earliest_deadline_us());
+    if (earliest_tick > current_tick) {
+        current_tick = (earliest_tick < now_tick) ? earliest_tick : now_tick;
+    }
+
+    while (true) {
+        sched_task_t ** slot = &wheel[current_tick & (SCHED_WHEEL_SLOTS - 1)];
+
+        // Tasks from later trips around the wheel, or from later in the
+        // current tick, sort after the ones that are due now.
+        while ((*slot != nullptr) && ((*slot)->deadline_us <= now_us)) {
+            dispatch(*slot, now_us);
+        }
+
+        if (current_tick >= now_tick) {
+            break;
+        }
+        ++current_tick;
+    }
+}
+
+
+absolute_time_t sched_next_deadline(void) {
+    if (num_pending == 0) {
+        return at_the_end_of_time;
+    }
+    absolute_time_t t;
+    update_us_since_boot(&t, earliest_deadline_us());
+    return t;
+}
+
+
+void sched_sleep(void) {
+    absolute_time_t until = sched_next_deadline();
+    if (!time_reached(until)) {
+        best_effort_wfe_or_timeout(until);
+    }
+}
+
+
+int sched_get_num_tasks(void) {
+    return num_tasks;
+}
+
+
+bool sched_get_task_stats(int i, char const ** name, uint32_t * period_us, sched_task_stats_t * stats) {
+    if ((i < 0) || (i >= num_tasks)) {
+        return false;
+    }
+    *name = tasks[i].name;
+    *period_us = tasks[i].period_us;
+    *stats = tasks[i].stats;
+    return true;
+}
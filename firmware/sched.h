@@ -0,0 +1,107 @@
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include <stdint.h>
+
+#include "pico/time.h"
+
+//
+// Cooperative task scheduler.
+//
+// Tasks are functions that run to completion on the main loop, either
+// once after a delay or periodically.  Pending tasks sit in a hashed
+// timer wheel: SCHED_WHEEL_SLOTS lists, one per SCHED_TICK_US tick,
+// with a task in the slot of its deadline's tick modulo the number of
+// slots.  Each slot is kept sorted by deadline, so `sched_run()` can
+// walk the ticks in order and dispatch due tasks earliest first.
+//
+// In between, `sched_sleep()` waits (WFE) until the earliest deadline
+// or until an interrupt comes in, whichever happens first.  Interrupt
+// handlers hand work to a task with `sched_post()`, so the task doesn't
+// have to poll for it.
+//
+// Every task keeps statistics on how often it ran, how long it took
+// and how late it was dispatched.  The host reads them with
+// USB_PROTO_OP_GET_TASK_STATS (see usb_proto.h),
+// `tools/pd_sink_box.py tasks` shows them.
+//
+
+#ifndef SCHED_MAX_TASKS
+#define SCHED_MAX_TASKS 16
+#endif
+
+// Number of slots in the wheel, must be a power of 2.
+#ifndef SCHED_WHEEL_SLOTS
+#define SCHED_WHEEL_SLOTS 64
+#endif
+
+#define SCHED_TICK_US 1000
+
+
+typedef struct sched_task sched_task_t;
+
+typedef struct {
+    uint32_t runs;
+    uint64_t total_us;
+    uint32_t max_us;
+
+    // How long after its deadline the task got to run, at worst.
+    uint32_t max_late_us;
+
+    // Periods a periodic task missed entirely because it ran too late.
+    uint32_t skipped;
+} sched_task_stats_t;
+
+
+// Registers the USB protocol handler.
+void sched_init(void);
+
+// Returns a new task that calls `run`, or nullptr if there are already
+// SCHED_MAX_TASKS.  The task doesn't run until it's started.  `name`
+// is for the stats and must outlive the task (a string literal).
+sched_task_t * sched_task_create(char const * name, void (*run)(void));
+
+// A polling task runs often and usually finds nothing to do, so its
+// run time doesn't count as busy time (see `perf_busy_add()`).  It
+// adds the time of the real work it finds itself.
+void sched_task_set_polling(sched_task_t * task, bool polling);
+
+// Run `task` once, `delay_us` from now.  (Re)starting a task that is
+// already pending moves it, and makes it a one-shot.
+void sched_start_oneshot(sched_task_t * task, uint32_t delay_us);
+
+// Run `task` every `period_us`, starting now.  If a run comes too late
+// for one or more whole periods, those runs are skipped rather than
+// made up.
+void sched_start_periodic(sched_task_t * task, uint32_t period_us);
+
+// A task may cancel itself while it runs, this also stops a periodic
+// task from being rescheduled.
+void sched_cancel(sched_task_t * task);
+
+bool sched_is_pending(sched_task_t const * task);
+
+// Run `task` at the next `sched_run()`, and wake the core if it's in
+// `sched_sleep()`.  A periodic task carries on a period from then, a
+// one-shot or stopped one runs once.  Safe to call from interrupt
+// handlers.
+void sched_post(sched_task_t * task);
+
+// Run every task whose deadline has passed, earliest deadline first.
+// Tasks that come due while this is running wait for the next call.
+void sched_run(void);
+
+// The earliest deadline of all pending tasks, or `at_the_end_of_time`.
+absolute_time_t sched_next_deadline(void);
+
+// Sleep until the earliest deadline, or until an interrupt or event
+// wakes the core.  May return early, callers loop around sched_run().
+void sched_sleep(void);
+
+int sched_get_num_tasks(void);
+
+// Returns false if there's no task number `i`.
+bool sched_get_task_stats(int i, char const ** name, uint32_t * period_us, sched_task_stats_t * stats);
+
+
+#endif // __SCHED_H__
@@ -0,0 +1,178 @@
+#include <string.h>
+
+#include "rle.h"
+#include "snapshot.h"
+
+
+typedef struct {
+    bool valid;
+    int id;
+    uint32_t version;
+    int16_t width;
+    int16_t height;
+    uint32_t offset;        // into `arena`
+    uint32_t len;
+    uint32_t last_used;
+} snapshot_entry_t;
+
+static hagl_backend_t * snapshot_display;
+
+// Snapshots are packed at the start of the arena, in no particular
+// order, with the free space after them.
+static uint8_t arena[SNAPSHOT_CACHE_BYTES > 0 ? SNAPSHOT_CACHE_BYTES : 1];
+static uint32_t arena_used;
+
+static snapshot_entry_t entries[SNAPSHOT_MAX_ENTRIES];
+
+// Bumped on every use, for LRU eviction.
+static uint32_t use_counter;
+
+static snapshot_stats_t stats;
+
+
+static snapshot_entry_t * find(int id) {
+    for (int i = 0; i < SNAPSHOT_MAX_ENTRIES; ++i) {
+        if (entries[i].valid && (entries[i].id == id)) {
+            return &entries[i];
+        }
+    }
+    return nullptr;
+}
+
+
+// Free an entry and close the gap it leaves in the arena.
+static void remove_entry(snapshot_entry_t * e) {
+    uint32_t end = e->offset + e->len;
+    memmove(&arena[e->offset], &arena[end], arena_used - end);
+    arena_used -= e->len;
+
+    for (int i = 0; i < SNAPSHOT_MAX_ENTRIES; ++i) {
+        if (entries[i].valid && (entries[i].offset > e->offset)) {
+            entries[i].offset -= e->len;
+        }
+    }
+    e->valid = false;
+}
+
+
+// Evict the least recently used entry.  Returns false if the cache is
+// empty.
+static bool evict_one(void) {
+    snapshot_entry_t * lru = nullptr;
+    for (int i = 0; i < SNAPSHOT_MAX_ENTRIES; ++i) {
+        if (entries[i].valid && ((lru == nullptr) || (entries[i].last_used < lru->last_used))) {
+            lru = &entries[i];
+        }
+    }
+    if (lru == nullptr) {
+        return false;
+    }
+    remove_entry(lru);
+    ++stats.evictions;
+    return true;
+}
+
+
+void snapshot_init(hagl_backend_t * display) {
+    snapshot_display = display;
+    snapshot_invalidate_all();
+}
+
+
+bool snapshot_restore(int id, uint32_t version) {
+    snapshot_entry_t * e = find(id);
+
+    if (
+        (e == nullptr)
+        || (e->version != version)
+        || (e->width != snapshot_display->width)
+        || (e->height != snapshot_display->height)
+    ) {
+        ++stats.misses;
+        return false;
+    }
+
+    size_t num_pixels = e->width * e->height;
+    size_t n = rle_decode(&arena[e->offset], e->len, (uint16_t *)snapshot_display->buffer, num_pixels);
+    if (n != num_pixels) {
+        // Can't happen unless the arena got corrupted.
+        remove_entry(e);
+        ++stats.misses;
+        return false;
+    }
+
+    e->last_used = ++use_counter;
+    ++stats.hits;
+    return true;
+}
+
+
+void snapshot_save(int id, uint32_t version) {
+    if (SNAPSHOT_CACHE_BYTES == 0) {
+        return;
+    }
+
+    snapshot_entry_t * e = find(id);
+    if (e != nullptr) {
+        remove_entry(e);
+    }
+
+    e = nullptr;
+    while (e == nullptr) {
+        for (int i = 0; i < SNAPSHOT_MAX_ENTRIES; ++i) {
+            if (!entries[i].valid) {
+                e = &entries[i];
+                break;
+            }
+        }
+        if (e == nullptr) {
+            evict_one();
+        }
+    }
+
+    uint16_t const * pixels = (uint16_t const *)snapshot_display->buffer;
+    size_t num_pixels = snapshot_display->width * snapshot_display->height;
+
+    while (true) {
+        size_t consumed;
+        size_t len = rle_encode(pixels, num_pixels, &arena[arena_used], sizeof(arena) - arena_used, &consumed);
+        if (consumed == num_pixels) {
+            e->valid = true;
+            e->id = id;
+            e->version = version;
+            e->width = snapshot_display->width;
+            e->height = snapshot_display->height;
+            e->offset = arena_used;
+            e->len = len;
+            e->last_used = ++use_counter;
+            arena_used += len;
+            return;
+        }
+
+        // Didn't fit, make room and try again.
+        if (!evict_one()) {
+            ++stats.too_big;
+            return;
+        }
+    }
+}
+
+
+void snapshot_invalidate_all(void) {
+    for (int i = 0; i < SNAPSHOT_MAX_ENTRIES; ++i) {
+        entries[i].valid = false;
+    }
+    arena_used = 0;
+}
+
+
+void snapshot_get_stats(snapshot_stats_t * s) {
+    *s = stats;
+    s->bytes_used = arena_used;
+    s->entries = 0;
+    for (int i = 0; i < SNAPSHOT_MAX_ENTRIES; ++i) {
+        if (entries[i].valid) {
+            ++s->entries;
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <stdint.h>
+
+#include "hagl/backend.h"
+
+//
+// Per-window frame snapshot cache.
+//
+// After a window draws, the HMI saves an RLE-compressed copy of the
+// framebuffer, tagged with the window's id and its current "version"
+// (see `hmi_window_t.version`).  The next time that window needs
+// drawing and its version hasn't changed (typically when bouncing
+// between the main window and the menu), the snapshot is decompressed
+// straight into the framebuffer instead of rendering the window again.
+//
+// Snapshots live in a static arena of SNAPSHOT_CACHE_BYTES.  When a new
+// snapshot doesn't fit, the least recently used ones are evicted.  A
+// snapshot is only good for the screen geometry it was taken with;
+// rotating the screen throws them all away.
+//
+// Build with SNAPSHOT_CACHE_BYTES=0 to disable the cache.
+//
+
+#ifndef SNAPSHOT_CACHE_BYTES
+#define SNAPSHOT_CACHE_BYTES (32 * 1024)
+#endif
+
+#define SNAPSHOT_MAX_ENTRIES 8
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t too_big;       // frames that didn't fit even in an empty cache
+    uint32_t bytes_used;
+    uint32_t entries;
+} snapshot_stats_t;
+
+
+void snapshot_init(hagl_backend_t * display);
+
+// Decompress window `id`'s snapshot into the back buffer, if there is
+// one for `version`.  Returns false on a cache miss.  Doesn't flush.
+bool snapshot_restore(int id, uint32_t version);
+
+// Save the back buffer as window `id`'s snapshot for `version`,
+// replacing any older snapshot of that window.
+void snapshot_save(int id, uint32_t version);
+
+void snapshot_invalidate_all(void);
+
+void snapshot_get_stats(snapshot_stats_t * stats);
+
+
+#endif // __SNAPSHOT_H__
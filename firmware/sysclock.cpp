@@ -0,0 +1,117 @@
+#include <cstdio>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/vreg.h"
+
+#include "i2c_async.h"
+#include "sysclock.h"
+
+
+#ifndef SYSCLOCK_IDLE_KHZ
+#define SYSCLOCK_IDLE_KHZ 48000
+#endif
+
+#ifndef SYSCLOCK_BOOST_KHZ
+#define SYSCLOCK_BOOST_KHZ 125000
+#endif
+
+// The RP2040 is only specified up to 133 MHz at the default core
+// voltage.  Above that we bump the voltage regulator, once, at init.
+#define SYSCLOCK_MAX_KHZ_AT_DEFAULT_VOLTAGE 133000
+
+
+static uint32_t const sysclock_khz[SYSCLOCK_NUM_STATES] = {
+    SYSCLOCK_IDLE_KHZ,   // SYSCLOCK_IDLE
+    SYSCLOCK_BOOST_KHZ,  // SYSCLOCK_BOOST
+};
+
+static spi_inst_t * sysclock_spi;
+static uint sysclock_spi_baudrate;
+static i2c_inst_t * sysclock_i2c;
+static uint sysclock_i2c_baudrate;
+
+static sysclock_state_t sysclock_state = SYSCLOCK_BOOST;
+static absolute_time_t sysclock_state_start;
+static uint64_t sysclock_time_us[SYSCLOCK_NUM_STATES];
+static uint32_t sysclock_switches[SYSCLOCK_NUM_STATES];
+
+
+void sysclock_init(spi_inst_t * spi, uint spi_baudrate, i2c_inst_t * i2c, uint i2c_baudrate) {
+    sysclock_spi = spi;
+    sysclock_spi_baudrate = spi_baudrate;
+    sysclock_i2c = i2c;
+    sysclock_i2c_baudrate = i2c_baudrate;
+
+    for (int i = 0; i < SYSCLOCK_NUM_STATES; ++i) {
+        uint vco, postdiv1, postdiv2;
+        if (!check_sys_clock_khz(sysclock_khz[i], &vco, &postdiv1, &postdiv2)) {
+            printf("sysclock: %lu kHz is not achievable\n", (unsigned long)sysclock_khz[i]);
+        }
+    }
+
+    if (sysclock_khz[SYSCLOCK_BOOST] > SYSCLOCK_MAX_KHZ_AT_DEFAULT_VOLTAGE) {
+        vreg_set_voltage(VREG_VOLTAGE_1_15);
+        sleep_ms(10);  // let the core voltage settle before overclocking
+    }
+
+    // We boot at the SDK's default clock, which we treat as the boost
+    // state until we drop to idle for the first time.
+    sysclock_state = SYSCLOCK_BOOST;
+    sysclock_state_start = get_absolute_time();
+    sysclock_set_state(SYSCLOCK_IDLE);
+}
+
+
+void sysclock_set_state(sysclock_state_t state) {
+    if (state == sysclock_state) {
+        return;
+    }
+
+    // Changing clk_peri and `i2c_set_baudrate()` (which disables the
+    // controller) would abort a non-blocking transaction in flight, so
+    // let it finish first.
+    i2c_async_finish();
+
+    if (!set_sys_clock_khz(sysclock_khz[state], false)) {
+        return;
+    }
+
+    // clk_peri now follows the new clk_sys, fix up the dividers.
+    if (sysclock_spi != nullptr) {
+        spi_set_baudrate(sysclock_spi, sysclock_spi_baudrate);
+    }
+    if (sysclock_i2c != nullptr) {
+        i2c_set_baudrate(sysclock_i2c, sysclock_i2c_baudrate);
+    }
+
+    absolute_time_t now = get_absolute_time();
+    sysclock_time_us[sysclock_state] += absolute_time_diff_us(sysclock_state_start, now);
+    sysclock_state_start = now;
+    sysclock_state = state;
+    ++sysclock_switches[state];
+}
+
+
+sysclock_state_t sysclock_get_state(void) {
+    return sysclock_state;
+}
+
+
+uint32_t sysclock_get_khz(sysclock_state_t state) {
+    return sysclock_khz[state];
+}
+
+
+uint64_t sysclock_get_time_us(sysclock_state_t state) {
+    uint64_t us = sysclock_time_us[state];
+    if (state == sysclock_state) {
+        us += absolute_time_diff_us(sysclock_state_start, get_absolute_time());
+    }
+    return us;
+}
+
+
+uint32_t sysclock_get_switches(sysclock_state_t state) {
+    return sysclock_switches[state];
+}
@@ -0,0 +1,55 @@
+#ifndef __SYSCLOCK_H__
+#define __SYSCLOCK_H__
+
+#include "hardware/i2c.h"
+#include "hardware/spi.h"
+
+//
+// Dynamic system clock scaling.
+//
+// The HMI spends nearly all its time waiting for the user to touch
+// the knob, so we run the system clock slow while idle and boost it
+// (optionally overclocked) while handling input and drawing.
+//
+// The SDK's `set_sys_clock_khz()` re-parents clk_peri to clk_sys, so
+// every time the system clock changes we re-derive the SPI and I2C
+// dividers to keep the display and the HUSB238 at their configured
+// rates.
+//
+// The idle and boost frequencies are set at build time with
+// SYSCLOCK_IDLE_KHZ and SYSCLOCK_BOOST_KHZ.  The boost frequency must
+// be at least twice the display SPI clock (SPI runs at most at
+// clk_peri/2).
+//
+
+typedef enum {
+    SYSCLOCK_IDLE,
+    SYSCLOCK_BOOST,
+    SYSCLOCK_NUM_STATES
+} sysclock_state_t;
+
+
+// Remember which SPI and I2C peripherals need their baud rate
+// re-derived on clock changes, and switch to the idle clock.  Call
+// this after the peripherals have been initialized.
+void sysclock_init(spi_inst_t * spi, uint spi_baudrate, i2c_inst_t * i2c, uint i2c_baudrate);
+
+// Switch the system clock to the specified state.  Does nothing if
+// we're already there.
+void sysclock_set_state(sysclock_state_t state);
+
+sysclock_state_t sysclock_get_state(void);
+
+// Returns the system clock frequency used in the specified state.
+uint32_t sysclock_get_khz(sysclock_state_t state);
+
+// Returns the total number of microseconds spent in the specified
+// state since `sysclock_init()`, including the current stretch if
+// that's the state we're in now.
+uint64_t sysclock_get_time_us(sysclock_state_t state);
+
+// Returns the number of times we've switched into the specified state.
+uint32_t sysclock_get_switches(sysclock_state_t state);
+
+
+#endif // __SYSCLOCK_H__
@@ -0,0 +1,271 @@
+#include <string.h>
+
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "pico/stdlib.h"
+
+#include "dlog.h"
+#include "evlog.h"
+#include "sysmon.h"
+
+
+static_assert((SYSMON_RING_SIZE & (SYSMON_RING_SIZE - 1)) == 0, "SYSMON_RING_SIZE must be a power of 2");
+
+#define VSYS_GPIO 29
+#define VSYS_INPUT 3
+#define TEMPERATURE_INPUT 4
+
+#if SYSMON_HAVE_VSYS
+#define NUM_INPUTS 2
+#else
+#define NUM_INPUTS 1
+#endif
+
+// The ADC clock is 48 MHz, and a conversion takes 96 cycles of it.
+// Set the divider directly, `adc_set_clkdiv()` takes a float.
+#define ADC_CLOCK_HZ 48000000
+#define ADC_DIV ((ADC_CLOCK_HZ / (SYSMON_SAMPLE_HZ * NUM_INPUTS)) - 1)
+static_assert(ADC_DIV >= 96, "SYSMON_SAMPLE_HZ is more than the ADC can do");
+
+// The DMA wraps its write address at a boundary of the ring's size,
+// so the ring must be aligned to it.
+#define RING_BYTES (SYSMON_RING_SIZE * sizeof(uint16_t))
+static uint16_t ring[SYSMON_RING_SIZE] __attribute__((aligned(RING_BYTES)));
+
+// What the control channel writes into the data channel's transfer
+// count (and trigger) register to start it over.
+static uint32_t ring_transfers = SYSMON_RING_SIZE;
+
+static int data_channel;
+static int control_channel;
+
+// Where `sysmon_poll()` picks up next.
+static uint32_t tail;
+
+// Running sums for the current period.
+typedef struct {
+    uint32_t samples;
+    int min;
+    int max;
+    int64_t sum;
+    uint64_t sum_of_squares;
+} accumulator_t;
+
+static accumulator_t vsys_acc;
+static accumulator_t temperature_acc;
+static absolute_time_t period_end;
+
+static sysmon_stats_t vsys_stats;
+static sysmon_stats_t temperature_stats;
+
+static bool brownout;
+static int brownout_min_mv;
+static bool overtemp;
+
+static void (*event_handler)(sysmon_event_t event);
+
+
+// VSYS is divided by 3 on the Pico, and the ADC's reference is 3.3V.
+static inline int vsys_millivolts(uint16_t raw) {
+    return (raw * 3 * 3300) >> 12;
+}
+
+// From the RP2040 datasheet: T = 27 - (V - 0.706) / 0.001721.
+static inline int temperature_deci_c(uint16_t raw) {
+    int microvolts = (raw * 103125) >> 7;  // raw * 3.3V / 4096
+    return 270 - (((microvolts - 706000) * 10) / 1721);
+}
+
+
+static uint32_t isqrt(uint32_t x) {
+    uint32_t root = 0;
+    uint32_t bit = 1u << 30;
+
+    while (bit > x) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+
+static inline void accumulate(accumulator_t * acc, int value) {
+    if ((acc->samples == 0) || (value < acc->min)) {
+        acc->min = value;
+    }
+    if ((acc->samples == 0) || (value > acc->max)) {
+        acc->max = value;
+    }
+    ++acc->samples;
+    acc->sum += value;
+    acc->sum_of_squares += (int64_t)value * value;
+}
+
+
+static void publish(accumulator_t * acc, sysmon_stats_t * stats) {
+    stats->samples = acc->samples;
+    if (acc->samples > 0) {
+        stats->min = acc->min;
+        stats->max = acc->max;
+        stats->mean = acc->sum / (int64_t)acc->samples;
+        stats->rms = isqrt(acc->sum_of_squares / acc->samples);
+    }
+    memset(acc, 0, sizeof(*acc));
+}
+
+
+static void notify(sysmon_event_t event) {
+    if (event_handler != nullptr) {
+        event_handler(event);
+    }
+}
+
+
+static inline void add_vsys_sample(int millivolts) {
+    accumulate(&vsys_acc, millivolts);
+
+    if (brownout) {
+        if (millivolts < brownout_min_mv) {
+            brownout_min_mv = millivolts;
+        }
+    } else if (millivolts < SYSMON_BROWNOUT_MV) {
+        brownout = true;
+        brownout_min_mv = millivolts;
+        DLOG("sysmon: brownout, VSYS %dmV", millivolts);
+        evlog_add(EVLOG_BROWNOUT, 1, millivolts);
+        notify(SYSMON_EVENT_BROWNOUT);
+    }
+}
+
+
+// The end of a period: publish its stats and see about the alerts.
+static void end_period(void) {
+    publish(&vsys_acc, &vsys_stats);
+    publish(&temperature_acc, &temperature_stats);
+
+    if (brownout && (vsys_stats.samples > 0) && (vsys_stats.min >= SYSMON_BROWNOUT_CLEAR_MV)) {
+        brownout = false;
+        DLOG("sysmon: brownout over, VSYS was down to %dmV", brownout_min_mv);
+        evlog_add(EVLOG_BROWNOUT, 0, brownout_min_mv);
+        notify(SYSMON_EVENT_BROWNOUT_CLEARED);
+    }
+
+    if (temperature_stats.samples > 0) {
+        int t = temperature_stats.mean;
+        if (!overtemp && (t >= SYSMON_OVERTEMP_DECI_C)) {
+            overtemp = true;
+            DLOG("sysmon: over temperature, %d.%dC", t / 10, t % 10);
+            evlog_add(EVLOG_OVERTEMP, 1, t);
+            notify(SYSMON_EVENT_OVERTEMP);
+        } else if (overtemp && (t < SYSMON_OVERTEMP_CLEAR_DECI_C)) {
+            overtemp = false;
+            DLOG("sysmon: temperature back down, %d.%dC", t / 10, t % 10);
+            evlog_add(EVLOG_OVERTEMP, 0, t);
+            notify(SYSMON_EVENT_OVERTEMP_CLEARED);
+        }
+    }
+
+    notify(SYSMON_EVENT_STATS);
+}
+
+
+void sysmon_init(void) {
+    adc_init();
+#if SYSMON_HAVE_VSYS
+    adc_gpio_init(VSYS_GPIO);
+    adc_select_input(VSYS_INPUT);
+    adc_set_round_robin((1 << VSYS_INPUT) | (1 << TEMPERATURE_INPUT));
+#else
+    adc_select_input(TEMPERATURE_INPUT);
+#endif
+    adc_set_temp_sensor_enabled(true);
+    adc_fifo_setup(true, true, 1, false, false);
+    adc_hw->div = ADC_DIV << ADC_DIV_INT_LSB;
+
+    data_channel = dma_claim_unused_channel(true);
+    control_channel = dma_claim_unused_channel(true);
+
+    // ADC FIFO -> ring, paced by the ADC, then chain to the control
+    // channel.
+    dma_channel_config c = dma_channel_get_default_config(data_channel);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, __builtin_ctz(RING_BYTES));
+    channel_config_set_dreq(&c, DREQ_ADC);
+    channel_config_set_chain_to(&c, control_channel);
+    dma_channel_configure(data_channel, &c, ring, &adc_hw->fifo, SYSMON_RING_SIZE, false);
+
+    // Restart the data channel for another lap around the ring.  Its
+    // write address has wrapped back to the start of the ring by then.
+    c = dma_channel_get_default_config(control_channel);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    dma_channel_configure(
+        control_channel, &c,
+        &dma_hw->ch[data_channel].al1_transfer_count_trig, &ring_transfers, 1,
+        false
+    );
+
+    tail = 0;
+    period_end = make_timeout_time_ms(SYSMON_PERIOD_MS);
+
+    adc_fifo_drain();
+    dma_channel_start(data_channel);
+    adc_run(true);
+}
+
+
+void sysmon_poll(void) {
+    uintptr_t write_addr = dma_channel_hw_addr(data_channel)->write_addr;
+    uint32_t head = ((write_addr - (uintptr_t)ring) / sizeof(ring[0])) & (SYSMON_RING_SIZE - 1);
+
+    while (tail != head) {
+        uint16_t raw = ring[tail];
+#if SYSMON_HAVE_VSYS
+        if ((tail & 1) == 0) {
+            add_vsys_sample(vsys_millivolts(raw));
+        } else {
+            accumulate(&temperature_acc, temperature_deci_c(raw));
+        }
+#else
+        accumulate(&temperature_acc, temperature_deci_c(raw));
+#endif
+        tail = (tail + 1) & (SYSMON_RING_SIZE - 1);
+    }
+
+    if (time_reached(period_end)) {
+        period_end = delayed_by_ms(period_end, SYSMON_PERIOD_MS);
+        end_period();
+    }
+}
+
+
+void sysmon_set_handler(void (*handler)(sysmon_event_t event)) {
+    event_handler = handler;
+}
+
+
+void sysmon_get_stats(sysmon_stats_t * vsys, sysmon_stats_t * temperature) {
+    *vsys = vsys_stats;
+    *temperature = temperature_stats;
+}
+
+
+bool sysmon_brownout(void) {
+    return brownout;
+}
+
+
+bool sysmon_overtemp(void) {
+    return overtemp;
+}
@@ -0,0 +1,113 @@
+#ifndef __SYSMON_H__
+#define __SYSMON_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// VSYS and die temperature monitor.
+//
+// VSYS is the Pico's supply, from the Mini360 buck converter off the
+// PD rail, so it sags when the source browns out; the RP2040's own
+// temperature sensor says when the box is cooking.
+//
+// The ADC runs free, round-robin over ADC3 (VSYS through the Pico's
+// 1:3 divider on GPIO29) and ADC4 (the temperature sensor), at
+// SYSMON_SAMPLE_HZ per input.  A DMA channel moves each result from
+// the ADC FIFO into a ring of SYSMON_RING_SIZE samples, using the
+// DMA's address wrapping, and a second DMA channel re-arms the first
+// whenever it has filled the ring, so sampling costs no CPU time at
+// all.  Samples alternate between the inputs, VSYS at even positions
+// in the ring.
+//
+// `sysmon_poll()` runs on the main loop and picks up whatever the DMA
+// wrote since last time, converts it (integer math, no floats) and
+// adds it to running sums for min/max/mean/RMS.  Every
+// SYSMON_PERIOD_MS the sums become the published stats and start over.
+// It must run often enough that the DMA doesn't lap it, the ring
+// holds SYSMON_RING_SIZE / (2 * SYSMON_SAMPLE_HZ) seconds.
+//
+// VSYS dropping below SYSMON_BROWNOUT_MV raises a brownout right away
+// (it's checked for every sample), a whole period at or above
+// SYSMON_BROWNOUT_CLEAR_MV clears it.  A period with a mean temperature
+// of SYSMON_OVERTEMP_DECI_C or more raises an over-temperature alert,
+// one below SYSMON_OVERTEMP_CLEAR_DECI_C clears it.  Alerts go to the
+// handler (see `sysmon_set_handler()`), DLOG and the event log (see
+// evlog.h).
+//
+// On a Pico W, GPIO29 is the wireless chip's SPI clock, so there is no
+// VSYS measurement, and the ADC samples only the temperature.
+//
+
+#ifdef RASPBERRYPI_PICO_W
+#define SYSMON_HAVE_VSYS 0
+#else
+#define SYSMON_HAVE_VSYS 1
+#endif
+
+// Per input.
+#ifndef SYSMON_SAMPLE_HZ
+#define SYSMON_SAMPLE_HZ 1000
+#endif
+
+// In samples, must be a power of 2.
+#ifndef SYSMON_RING_SIZE
+#define SYSMON_RING_SIZE 512
+#endif
+
+#ifndef SYSMON_PERIOD_MS
+#define SYSMON_PERIOD_MS 1000
+#endif
+
+#ifndef SYSMON_BROWNOUT_MV
+#define SYSMON_BROWNOUT_MV 4300
+#endif
+#ifndef SYSMON_BROWNOUT_CLEAR_MV
+#define SYSMON_BROWNOUT_CLEAR_MV 4500
+#endif
+
+// Tenths of a degree C.
+#ifndef SYSMON_OVERTEMP_DECI_C
+#define SYSMON_OVERTEMP_DECI_C 700
+#endif
+#ifndef SYSMON_OVERTEMP_CLEAR_DECI_C
+#define SYSMON_OVERTEMP_CLEAR_DECI_C 650
+#endif
+
+
+typedef enum {
+    SYSMON_EVENT_STATS,             // a period's stats are out
+    SYSMON_EVENT_BROWNOUT,
+    SYSMON_EVENT_BROWNOUT_CLEARED,
+    SYSMON_EVENT_OVERTEMP,
+    SYSMON_EVENT_OVERTEMP_CLEARED,
+} sysmon_event_t;
+
+// One period's worth of one input: millivolts for VSYS, tenths of a
+// degree C for the temperature.
+typedef struct {
+    uint32_t samples;       // 0: no stats (yet)
+    int min;
+    int max;
+    int mean;
+    int rms;
+} sysmon_stats_t;
+
+
+// Starts the ADC and the DMA.
+void sysmon_init(void);
+
+// Task: process new samples, see above.
+void sysmon_poll(void);
+
+// `handler` gets called from `sysmon_poll()` with every event.
+void sysmon_set_handler(void (*handler)(sysmon_event_t event));
+
+// The stats of the last complete period.
+void sysmon_get_stats(sysmon_stats_t * vsys, sysmon_stats_t * temperature);
+
+bool sysmon_brownout(void);
+bool sysmon_overtemp(void);
+
+
+#endif // __SYSMON_H__
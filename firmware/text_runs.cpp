@@ -0,0 +1,124 @@
+#include "pico/stdlib.h"
+
+#include "hagl.h"
+#include "hagl_char_scaled.h"
+
+#include "dlog.h"
+#include "hmi.h"
+#include "hot.h"
+#include "sysclock.h"
+#include "text_runs.h"
+#include "usb_proto.h"
+
+// Generated at build time by tools/make-font-runs.
+#include "font6x9-runs.h"
+
+
+static hagl_backend_t * bench_display;
+static uint8_t const * bench_font;
+
+// What the main window draws at scale 4.
+static char const * const bench_strings[] = { "20V", "3.00A" };
+static int const bench_scales[] = { 1, 2, 4 };
+
+#define NUM_BENCH_STRINGS (sizeof(bench_strings) / sizeof(bench_strings[0]))
+#define NUM_BENCH_SCALES (sizeof(bench_scales) / sizeof(bench_scales[0]))
+
+
+uint8_t HOT_FUNC(text_runs_put_char)(void const * surface, unsigned char c, int16_t x0, int16_t y0, hagl_color_t color, int scale) {
+    if (c >= FONT6X9_RUNS_GLYPHS) {
+        return 0;
+    }
+
+    for (uint16_t i = font6x9_runs_first[c]; i < font6x9_runs_first[c + 1]; ++i) {
+        uint16_t r = font6x9_runs[i];
+        int x = r & 0x7;
+        int w = ((r >> 3) & 0x7) + 1;
+        int y = (r >> 6) & 0xf;
+        int h = ((r >> 10) & 0xf) + 1;
+        hagl_fill_rectangle_xywh(surface, x0 + (x * scale), y0 + (y * scale), w * scale, h * scale, color);
+    }
+
+    return FONT6X9_RUNS_WIDTH * scale;
+}
+
+
+uint16_t HOT_FUNC(text_runs_put_text)(void const * surface, char const * str, int16_t x0, int16_t y0, hagl_color_t color, int scale) {
+    int16_t x = x0;
+
+    for (; *str != '\0'; ++str) {
+        if ((*str == '\r') || (*str == '\n')) {
+            x = x0;
+            y0 += FONT6X9_RUNS_HEIGHT * scale;
+        } else {
+            x += text_runs_put_char(surface, *str, x, y0, color, scale);
+        }
+    }
+
+    return x - x0;
+}
+
+
+// Microseconds per pass over the bench strings.
+static uint32_t bench(bool runs, int scale, int iterations, hagl_color_t color) {
+    hagl_clear(bench_display);
+
+    uint32_t start = time_us_32();
+    for (int i = 0; i < iterations; ++i) {
+        for (size_t s = 0; s < NUM_BENCH_STRINGS; ++s) {
+            int16_t y = 2 + (s * FONT6X9_RUNS_HEIGHT * scale);
+            if (runs) {
+                text_runs_put_text(bench_display, bench_strings[s], 2, y, color, scale);
+            } else {
+                hagl_put_text_scaled(bench_display, bench_strings[s], 2, y, color, scale, bench_font);
+            }
+        }
+    }
+    return (time_us_32() - start) / iterations;
+}
+
+
+static void handle_text_bench(uint8_t seq, uint8_t const * payload, size_t len) {
+    if (len != 1) {
+        usb_proto_error(USB_PROTO_OP_TEXT_BENCH, seq, USB_PROTO_ERROR_BAD_LENGTH);
+        return;
+    }
+    int iterations = MIN(MAX(payload[0], 1), TEXT_RUNS_BENCH_MAX_ITERATIONS);
+
+    // Time it at the clock we draw at.
+    sysclock_state_t clock = sysclock_get_state();
+    sysclock_set_state(SYSCLOCK_BOOST);
+
+    hagl_color_t color = hagl_color(bench_display, 0, 255, 0);
+    uint8_t reply[5 + (NUM_BENCH_SCALES * 9)];
+    size_t r = 0;
+
+    usb_proto_put_u32(&reply[r], sysclock_get_khz(SYSCLOCK_BOOST));
+    r += 4;
+    reply[r++] = NUM_BENCH_SCALES;
+    for (size_t i = 0; i < NUM_BENCH_SCALES; ++i) {
+        int scale = bench_scales[i];
+        uint32_t bitmap_us = bench(false, scale, iterations, color);
+        uint32_t runs_us = bench(true, scale, iterations, color);
+        DLOG("text bench scale %d: bitmap %u us, runs %u us", scale, bitmap_us, runs_us);
+
+        reply[r++] = scale;
+        usb_proto_put_u32(&reply[r], bitmap_us);
+        usb_proto_put_u32(&reply[r + 4], runs_us);
+        r += 8;
+    }
+
+    sysclock_set_state(clock);
+
+    // The benchmark scribbled all over the back buffer.
+    hmi_request_redraw();
+
+    usb_proto_reply(USB_PROTO_OP_TEXT_BENCH, seq, reply, r);
+}
+
+
+void text_runs_init(hagl_backend_t * display, uint8_t const * font) {
+    bench_display = display;
+    bench_font = font;
+    usb_proto_add_handler(USB_PROTO_OP_TEXT_BENCH, handle_text_bench);
+}
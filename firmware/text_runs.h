@@ -0,0 +1,48 @@
+#ifndef __TEXT_RUNS_H__
+#define __TEXT_RUNS_H__
+
+#include <stdint.h>
+
+#include "hagl/backend.h"
+#include "hagl/color.h"
+
+//
+// Scaled text in the UI font (font6x9) drawn as filled rectangles.
+//
+// `hagl_put_char_scaled()` expands each glyph into a bitmap a pixel at
+// a time and then blits it scaled, reading and writing every pixel of
+// the glyph's box, background included.  At scale 4 the main window's
+// "20V" is mostly big solid blocks, so instead the build precomputes
+// each glyph's set pixels as rectangles (tools/make-font-runs turns
+// every row into runs and merges runs that repeat down the rows into
+// one rectangle), keeps them in flash, and this draws each rectangle
+// with one `hagl_fill_rectangle_xywh()` at the scaled size.
+//
+// Only the glyphs' own pixels are drawn, the background is left
+// alone, so this is for text on a cleared screen.
+//
+// The host compares the two with USB_PROTO_OP_TEXT_BENCH (see
+// usb_proto.h), `tools/pd_sink_box.py textbench` runs it.
+//
+
+// The benchmark draws this many passes over the main window's text per
+// renderer and scale.
+#define TEXT_RUNS_BENCH_MAX_ITERATIONS 50
+
+
+// Registers the benchmark's USB protocol handler.  The benchmark draws
+// into `display`'s back buffer, and compares with
+// `hagl_put_text_scaled()` using `font`, which must be font6x9 (or
+// the firmware's copy of it).
+void text_runs_init(hagl_backend_t * display, uint8_t const * font);
+
+// Like `hagl_put_char_scaled()` with font6x9.  Returns the width
+// drawn.
+uint8_t text_runs_put_char(void const * surface, unsigned char c, int16_t x0, int16_t y0, hagl_color_t color, int scale);
+
+// Like `hagl_put_text_scaled()` with font6x9, CR and LF start another
+// line at `x0`.  Returns the width of the last line drawn.
+uint16_t text_runs_put_text(void const * surface, char const * str, int16_t x0, int16_t y0, hagl_color_t color, int scale);
+
+
+#endif // __TEXT_RUNS_H__
@@ -0,0 +1,549 @@
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "tusb.h"
+
+#include "boot.h"
+#include "dlog.h"
+#include "evlog.h"
+#include "hmi.h"
+#include "husb238.h"
+#include "pd.h"
+#include "sched.h"
+#include "usb_proto.h"
+
+
+// Decoded frame: op, seq, payload, crc16.
+#define USB_PROTO_MAX_FRAME (2 + USB_PROTO_MAX_PAYLOAD + 2)
+
+// COBS adds one byte per 254 bytes of input, plus one.
+#define USB_PROTO_MAX_ENCODED_FRAME (USB_PROTO_MAX_FRAME + (USB_PROTO_MAX_FRAME / 254) + 1)
+
+// What a frame adds to its payload on the wire: the zeros either side,
+// op, seq, CRC and the COBS overhead.
+#define USB_PROTO_FRAME_OVERHEAD (2 + USB_PROTO_MAX_ENCODED_FRAME - USB_PROTO_MAX_PAYLOAD)
+
+// Don't spend more than this many bytes' worth of time reading input
+// on each poll.  If there's more, the task runs again as soon as the
+// other tasks have had a turn.
+#define USB_PROTO_MAX_RX_PER_POLL 64
+
+
+static sched_task_t * usb_proto_task;
+
+static i2c_inst_t * usb_proto_i2c;
+static int * usb_proto_i2c_comm_errors;
+
+static uint8_t rx_buf[USB_PROTO_MAX_ENCODED_FRAME];
+static bool rx_in_frame;
+static size_t rx_len;
+static bool rx_overflow;
+
+static void (*key_handler)(uint8_t c);
+
+static uint32_t crc_errors;
+static uint32_t framing_errors;
+
+static uint16_t telemetry_period_ms;
+static absolute_time_t telemetry_next;
+
+static bool log_subscribed;
+
+// Sequence number for unsolicited frames.
+static uint8_t event_seq;
+
+#define USB_PROTO_MAX_HANDLERS 16
+static struct {
+    uint8_t op;
+    usb_proto_handler_t handler;
+} handlers[USB_PROTO_MAX_HANDLERS];
+static int num_handlers;
+
+
+//
+// Framing helpers.
+//
+
+static uint16_t crc16(uint8_t const * data, size_t len) {
+    uint16_t crc = 0xffff;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; ++bit) {
+            if (crc & 0x8000) {
+                crc = (crc << 1) ^ 0x1021;
+            } else {
+                crc = crc << 1;
+            }
+        }
+    }
+    return crc;
+}
+
+static size_t cobs_encode(uint8_t const * in, size_t len, uint8_t * out) {
+    size_t out_index = 1;
+    size_t code_index = 0;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; ++i) {
+        if (in[i] == 0) {
+            out[code_index] = code;
+            code = 1;
+            code_index = out_index++;
+        } else {
+            out[out_index++] = in[i];
+            ++code;
+            if (code == 0xff) {
+                out[code_index] = code;
+                code = 1;
+                code_index = out_index++;
+            }
+        }
+    }
+    out[code_index] = code;
+
+    return out_index;
+}
+
+// Returns the decoded length, or -1 if the input is not valid COBS.
+static int cobs_decode(uint8_t const * in, size_t len, uint8_t * out, size_t out_size) {
+    size_t in_index = 0;
+    size_t out_index = 0;
+
+    while (in_index < len) {
+        uint8_t code = in[in_index++];
+        if (code == 0) {
+            return -1;
+        }
+        for (uint8_t i = 1; i < code; ++i) {
+            if ((in_index >= len) || (out_index >= out_size)) {
+                return -1;
+            }
+            out[out_index++] = in[in_index++];
+        }
+        if ((code != 0xff) && (in_index < len)) {
+            if (out_index >= out_size) {
+                return -1;
+            }
+            out[out_index++] = 0;
+        }
+    }
+
+    return out_index;
+}
+
+// Returns false if the frame was too big, or there wasn't room for it.
+static bool send_frame(uint8_t op, uint8_t seq, uint8_t const * payload, size_t payload_len) {
+    uint8_t frame[USB_PROTO_MAX_FRAME];
+    uint8_t encoded[USB_PROTO_MAX_ENCODED_FRAME];
+
+    if (payload_len > USB_PROTO_MAX_PAYLOAD) {
+        return false;
+    }
+
+    frame[0] = op;
+    frame[1] = seq;
+    if (payload_len > 0) {
+        memcpy(&frame[2], payload, payload_len);
+    }
+    uint16_t crc = crc16(frame, 2 + payload_len);
+    frame[2 + payload_len] = crc & 0xff;
+    frame[2 + payload_len + 1] = crc >> 8;
+
+    size_t encoded_len = cobs_encode(frame, 2 + payload_len + 2, encoded);
+
+    // A frame bigger than the whole buffer goes out once the buffer is
+    // empty, that is, once the host has shown it's reading.
+    size_t needed = 1 + encoded_len + 1;
+    if (needed > CFG_TUD_CDC_TX_BUFSIZE) {
+        needed = CFG_TUD_CDC_TX_BUFSIZE;
+    }
+    if (usb_proto_tx_room() < needed) {
+        return false;
+    }
+
+    // The leading zero ends whatever text (from `printf()` or the VT100
+    // mirror) went out just before, so the host doesn't take it for the
+    // start of this frame and drop the frame on a bad CRC.
+    putchar_raw(0x00);
+    for (size_t i = 0; i < encoded_len; ++i) {
+        putchar_raw(encoded[i]);
+    }
+    putchar_raw(0x00);
+    return true;
+}
+
+static void send_error(uint8_t op, uint8_t seq, usb_proto_error_t error) {
+    uint8_t payload[2] = { op, (uint8_t)error };
+    send_frame(USB_PROTO_OP_ERROR, seq, payload, sizeof(payload));
+}
+
+
+//
+// Request handlers.  Each one gets the request payload and sends
+// exactly one reply frame.
+//
+
+static void handle_get_pdos(uint8_t seq, uint8_t const * payload, size_t len) {
+    pd_pdo_t pdos[PD_NUM_PDOS];
+    uint8_t reply[PD_NUM_PDOS * 5];
+
+    if (pd_get_pdos(usb_proto_i2c, pdos) != PICO_OK) {
+        ++*usb_proto_i2c_comm_errors;
+        send_error(USB_PROTO_OP_GET_PDOS, seq, USB_PROTO_ERROR_I2C);
+        return;
+    }
+
+    for (int i = 0; i < PD_NUM_PDOS; ++i) {
+        reply[(i * 5) + 0] = pdos[i].id;
+        usb_proto_put_u16(&reply[(i * 5) + 1], pdos[i].millivolts);
+        usb_proto_put_u16(&reply[(i * 5) + 3], pdos[i].milliamps);
+    }
+
+    send_frame(USB_PROTO_OP_GET_PDOS | USB_PROTO_OP_RESPONSE, seq, reply, sizeof(reply));
+}
+
+static void handle_get_contract(uint8_t seq, uint8_t const * payload, size_t len) {
+    uint8_t reply[6];
+    int millivolts = 0;
+    int milliamps = 0;
+    int current_pdo = 0;
+
+    memset(reply, 0, sizeof(reply));
+
+    if (husb238_connected(usb_proto_i2c)) {
+        if (
+            (pd_get_contract(usb_proto_i2c, &millivolts, &milliamps) != PICO_OK)
+            || (husb238_get_current_pdo(usb_proto_i2c, &current_pdo) != PICO_OK)
+        ) {
+            ++*usb_proto_i2c_comm_errors;
+            send_error(USB_PROTO_OP_GET_CONTRACT, seq, USB_PROTO_ERROR_I2C);
+            return;
+        }
+        reply[0] = 1;
+        usb_proto_put_u16(&reply[1], millivolts);
+        usb_proto_put_u16(&reply[3], milliamps);
+        reply[5] = current_pdo;
+    }
+
+    send_frame(USB_PROTO_OP_GET_CONTRACT | USB_PROTO_OP_RESPONSE, seq, reply, sizeof(reply));
+}
+
+static void handle_select_pdo(uint8_t seq, uint8_t const * payload, size_t len) {
+    if (len != 1) {
+        send_error(USB_PROTO_OP_SELECT_PDO, seq, USB_PROTO_ERROR_BAD_LENGTH);
+        return;
+    }
+
+    int r = husb238_select_pdo(usb_proto_i2c, payload[0]);
+    if (r != PICO_OK) {
+        ++*usb_proto_i2c_comm_errors;
+    }
+    evlog_add(EVLOG_SELECT, payload[0], r);
+
+    // The main window only draws when asked once there's a contract.
+    hmi_request_redraw();
+
+    uint8_t reply[1] = { (uint8_t)(int8_t)r };
+    send_frame(USB_PROTO_OP_SELECT_PDO | USB_PROTO_OP_RESPONSE, seq, reply, sizeof(reply));
+}
+
+static void handle_get_errors(uint8_t seq, uint8_t const * payload, size_t len) {
+    uint8_t reply[12];
+    usb_proto_put_u32(&reply[0], *usb_proto_i2c_comm_errors);
+    usb_proto_put_u32(&reply[4], crc_errors);
+    usb_proto_put_u32(&reply[8], framing_errors);
+    send_frame(USB_PROTO_OP_GET_ERRORS | USB_PROTO_OP_RESPONSE, seq, reply, sizeof(reply));
+}
+
+static void handle_reset_errors(uint8_t seq, uint8_t const * payload, size_t len) {
+    *usb_proto_i2c_comm_errors = 0;
+    crc_errors = 0;
+    framing_errors = 0;
+    send_frame(USB_PROTO_OP_RESET_ERRORS | USB_PROTO_OP_RESPONSE, seq, nullptr, 0);
+}
+
+static void handle_subscribe_telemetry(uint8_t seq, uint8_t const * payload, size_t len) {
+    if (len != 2) {
+        send_error(USB_PROTO_OP_SUBSCRIBE_TELEMETRY, seq, USB_PROTO_ERROR_BAD_LENGTH);
+        return;
+    }
+
+    telemetry_period_ms = usb_proto_get_u16(payload);
+    telemetry_next = make_timeout_time_ms(telemetry_period_ms);
+
+    send_frame(USB_PROTO_OP_SUBSCRIBE_TELEMETRY | USB_PROTO_OP_RESPONSE, seq, nullptr, 0);
+}
+
+static void handle_subscribe_log(uint8_t seq, uint8_t const * payload, size_t len) {
+    if (len != 1) {
+        send_error(USB_PROTO_OP_SUBSCRIBE_LOG, seq, USB_PROTO_ERROR_BAD_LENGTH);
+        return;
+    }
+
+    log_subscribed = (payload[0] != 0);
+
+    send_frame(USB_PROTO_OP_SUBSCRIBE_LOG | USB_PROTO_OP_RESPONSE, seq, nullptr, 0);
+}
+
+static void handle_get_boot_times(uint8_t seq, uint8_t const * payload, size_t len) {
+    uint8_t reply[BOOT_NUM_PHASES * 4];
+    for (int i = 0; i < BOOT_NUM_PHASES; ++i) {
+        usb_proto_put_u32(&reply[i * 4], boot_get_us((boot_phase_t)i));
+    }
+    send_frame(USB_PROTO_OP_GET_BOOT_TIMES | USB_PROTO_OP_RESPONSE, seq, reply, sizeof(reply));
+}
+
+
+// Returns false if the frame is too short or fails the CRC.
+static bool handle_frame(uint8_t const * frame, size_t len) {
+    if (len < 4) {
+        ++framing_errors;
+        return false;
+    }
+
+    uint16_t crc = frame[len - 2] | (frame[len - 1] << 8);
+    if (crc != crc16(frame, len - 2)) {
+        ++crc_errors;
+        return false;
+    }
+
+    uint8_t op = frame[0];
+    uint8_t seq = frame[1];
+    uint8_t const * payload = &frame[2];
+    size_t payload_len = len - 4;
+
+    switch (op) {
+    case USB_PROTO_OP_GET_PDOS:
+        handle_get_pdos(seq, payload, payload_len);
+        break;
+    case USB_PROTO_OP_GET_CONTRACT:
+        handle_get_contract(seq, payload, payload_len);
+        break;
+    case USB_PROTO_OP_SELECT_PDO:
+        handle_select_pdo(seq, payload, payload_len);
+        break;
+    case USB_PROTO_OP_GET_ERRORS:
+        handle_get_errors(seq, payload, payload_len);
+        break;
+    case USB_PROTO_OP_RESET_ERRORS:
+        handle_reset_errors(seq, payload, payload_len);
+        break;
+    case USB_PROTO_OP_SUBSCRIBE_TELEMETRY:
+        handle_subscribe_telemetry(seq, payload, payload_len);
+        break;
+    case USB_PROTO_OP_SUBSCRIBE_LOG:
+        handle_subscribe_log(seq, payload, payload_len);
+        break;
+    case USB_PROTO_OP_GET_BOOT_TIMES:
+        handle_get_boot_times(seq, payload, payload_len);
+        break;
+    default:
+        for (int i = 0; i < num_handlers; ++i) {
+            if (handlers[i].op == op) {
+                handlers[i].handler(seq, payload, payload_len);
+                return true;
+            }
+        }
+        send_error(op, seq, USB_PROTO_ERROR_UNKNOWN_OP);
+        break;
+    }
+
+    return true;
+}
+
+
+bool usb_proto_add_handler(uint8_t op, usb_proto_handler_t handler) {
+    if (num_handlers >= USB_PROTO_MAX_HANDLERS) {
+        return false;
+    }
+    handlers[num_handlers].op = op;
+    handlers[num_handlers].handler = handler;
+    ++num_handlers;
+    return true;
+}
+
+
+void usb_proto_set_key_handler(void (*handler)(uint8_t c)) {
+    key_handler = handler;
+}
+
+
+void usb_proto_reply(uint8_t op, uint8_t seq, uint8_t const * payload, size_t len) {
+    send_frame(op | USB_PROTO_OP_RESPONSE, seq, payload, len);
+}
+
+
+void usb_proto_error(uint8_t op, uint8_t seq, usb_proto_error_t error) {
+    send_error(op, seq, error);
+}
+
+
+bool usb_proto_send(uint8_t op, uint8_t const * payload, size_t len) {
+    if (!send_frame(op, event_seq, payload, len)) {
+        return false;
+    }
+    ++event_seq;
+    return true;
+}
+
+
+size_t usb_proto_tx_room(void) {
+    if (!tud_cdc_connected()) {
+        // stdio_usb throws away output when there's no terminal,
+        // without waiting.
+        return SIZE_MAX;
+    }
+    return tud_cdc_write_available();
+}
+
+
+static void send_telemetry(void) {
+    uint8_t payload[12];
+    int millivolts = 0;
+    int milliamps = 0;
+
+    memset(payload, 0, sizeof(payload));
+
+    if (husb238_connected(usb_proto_i2c)) {
+        if (pd_get_contract(usb_proto_i2c, &millivolts, &milliamps) != PICO_OK) {
+            ++*usb_proto_i2c_comm_errors;
+            millivolts = 0;
+            milliamps = 0;
+        }
+    }
+
+    usb_proto_put_u32(&payload[0], to_ms_since_boot(get_absolute_time()));
+    usb_proto_put_u16(&payload[4], millivolts);
+    usb_proto_put_u16(&payload[6], milliamps);
+    usb_proto_put_u32(&payload[8], *usb_proto_i2c_comm_errors);
+
+    usb_proto_send(USB_PROTO_OP_TELEMETRY, payload, sizeof(payload));
+}
+
+
+// Send one frame's worth of log records, if there are any and there's
+// room for them.  Returns false if not.  Only reads as many records as
+// fit, the rest stay in the ring until the host catches up.
+static bool send_log(void) {
+    uint32_t words[(USB_PROTO_MAX_PAYLOAD / 4) - 1];
+    uint8_t payload[USB_PROTO_MAX_PAYLOAD];
+
+    size_t room = usb_proto_tx_room();
+    if (room < USB_PROTO_FRAME_OVERHEAD + 4 + 4) {
+        return false;
+    }
+    size_t max_words = (room - USB_PROTO_FRAME_OVERHEAD - 4) / 4;
+    if (max_words > count_of(words)) {
+        max_words = count_of(words);
+    }
+
+    size_t n = dlog_read(words, max_words);
+    if (n == 0) {
+        return false;
+    }
+
+    usb_proto_put_u32(&payload[0], dlog_get_dropped());
+    for (size_t i = 0; i < n; ++i) {
+        usb_proto_put_u32(&payload[4 + (i * 4)], words[i]);
+    }
+
+    return usb_proto_send(USB_PROTO_OP_LOG, payload, 4 + (n * 4));
+}
+
+
+// From the USB interrupt, when input arrives.
+static void chars_available(void * param) {
+    sched_post(usb_proto_task);
+}
+
+
+void usb_proto_init(i2c_inst_t * i2c, int * i2c_comm_errors) {
+    usb_proto_i2c = i2c;
+    usb_proto_i2c_comm_errors = i2c_comm_errors;
+    rx_in_frame = false;
+    rx_len = 0;
+    rx_overflow = false;
+    telemetry_period_ms = 0;
+    log_subscribed = false;
+
+    usb_proto_task = sched_task_create("usb", usb_proto_poll);
+    sched_start_periodic(usb_proto_task, USB_PROTO_POLL_MS * 1000);
+    stdio_set_chars_available_callback(chars_available, nullptr);
+}
+
+
+void usb_proto_poll(void) {
+    bool more = true;
+    for (int i = 0; i < USB_PROTO_MAX_RX_PER_POLL; ++i) {
+        int c = getchar_timeout_us(0);
+        if (c < 0) {
+            more = false;
+            break;
+        }
+
+        if (!rx_in_frame) {
+            if (c == 0x00) {
+                rx_in_frame = true;
+                rx_len = 0;
+                rx_overflow = false;
+            } else if (key_handler != nullptr) {
+                key_handler(c);
+            }
+            continue;
+        }
+
+        if (c != 0x00) {
+            if (rx_len < sizeof(rx_buf)) {
+                rx_buf[rx_len++] = c;
+            } else {
+                rx_overflow = true;
+            }
+            continue;
+        }
+
+        if ((rx_len == 0) && !rx_overflow) {
+            // Back-to-back 0x00 bytes, we're still at the start of a frame.
+            continue;
+        }
+
+        // End of frame.
+        bool ok = false;
+        if (rx_overflow) {
+            ++framing_errors;
+        } else {
+            uint8_t frame[USB_PROTO_MAX_FRAME];
+            int len = cobs_decode(rx_buf, rx_len, frame, sizeof(frame));
+            if (len < 0) {
+                ++framing_errors;
+            } else {
+                ok = handle_frame(frame, len);
+            }
+        }
+
+        // A bad frame is most likely the tail of one the host gave up
+        // on, and then this 0x00 is the leading one of the host's next
+        // frame, so keep reading that as a frame rather than as
+        // keystrokes.
+        rx_in_frame = !ok;
+        rx_len = 0;
+        rx_overflow = false;
+    }
+
+    if ((telemetry_period_ms != 0) && time_reached(telemetry_next)) {
+        telemetry_next = delayed_by_ms(telemetry_next, telemetry_period_ms);
+        if (time_reached(telemetry_next)) {
+            // We fell behind (the HMI was busy), don't try to catch up.
+            telemetry_next = make_timeout_time_ms(telemetry_period_ms);
+        }
+        send_telemetry();
+    }
+
+    if (log_subscribed && send_log()) {
+        // Drain the ring faster than USB_PROTO_POLL_MS.
+        more = true;
+    }
+
+    if (more) {
+        sched_post(usb_proto_task);
+    }
+}
@@ -0,0 +1,263 @@
+#ifndef __USB_PROTO_H__
+#define __USB_PROTO_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hardware/i2c.h"
+
+//
+// Compact binary control & telemetry protocol over the USB CDC serial
+// port.
+//
+// Each frame is COBS-encoded, and starts and ends with a 0x00 byte.
+// Decoded, a frame looks like this (all multi-byte fields little-endian):
+//
+//     op (1 byte) | seq (1 byte) | payload (0-250 bytes) | crc16 (2 bytes)
+//
+// The CRC is CRC-16/CCITT-FALSE over op, seq and payload.
+//
+// The host sends requests, the device answers each with a frame with
+// the same seq and `op | USB_PROTO_OP_RESPONSE`, or with
+// USB_PROTO_OP_ERROR if the request could not be handled.  Telemetry
+// frames are sent unsolicited (with seq counting up) once the host
+// has subscribed.
+//
+// Host-to-device frames must have the leading 0x00 byte too.  Bytes
+// that arrive outside of a frame are keystrokes, and get passed to the
+// key handler (see vt100.h) so a terminal program can share the port
+// with the binary protocol.  The 0x00 that ends a bad frame also starts
+// the next one, so a frame the host gave up on part way through doesn't
+// turn its next frame into keystrokes.
+//
+// Anything that is not a well-formed frame (such as the text that
+// `printf()` and the VT100 mirror write to the same port) is ignored by
+// the host side.
+//
+// tools/pd_sink_box.py is the host-side client.
+//
+
+#define USB_PROTO_MAX_PAYLOAD 250
+
+#define USB_PROTO_POLL_MS 10
+
+#define USB_PROTO_OP_RESPONSE 0x80
+
+typedef enum {
+    // Request: no payload
+    // Response: 6x { id u8, millivolts u16, milliamps u16 }
+    USB_PROTO_OP_GET_PDOS = 0x01,
+
+    // Request: no payload
+    // Response: { attached u8, millivolts u16, milliamps u16, current pdo id u8 }
+    USB_PROTO_OP_GET_CONTRACT = 0x02,
+
+    // Request: { pdo id u8 }
+    // Response: { status i8 }
+    USB_PROTO_OP_SELECT_PDO = 0x03,
+
+    // Request: no payload
+    // Response: { i2c errors u32, crc errors u32, framing errors u32 }
+    USB_PROTO_OP_GET_ERRORS = 0x04,
+
+    // Request: no payload
+    // Response: no payload
+    USB_PROTO_OP_RESET_ERRORS = 0x05,
+
+    // Request: { period ms u16 }, 0 means "stop"
+    // Response: no payload
+    USB_PROTO_OP_SUBSCRIBE_TELEMETRY = 0x06,
+
+    // Request: { enable u8 }
+    // Response: no payload
+    USB_PROTO_OP_SUBSCRIBE_LOG = 0x07,
+
+    // Request: { enable u8 }
+    // Response: no payload
+    // Enabling (re-)sends every row of the framebuffer, see fb_mirror.h.
+    USB_PROTO_OP_FB_MIRROR = 0x08,
+
+    // Request: no payload
+    // Response: BOOT_NUM_PHASES x { us since boot u32 }, 0 means "not reached", see boot.h
+    USB_PROTO_OP_GET_BOOT_TIMES = 0x09,
+
+    // Request: { reset u8 }, non-zero resets the counters after reading them
+    // Response: { xip cache hits u32, xip cache accesses u32, frames drawn u32, hot code in ram u8 }
+    // See xip_stats.h.
+    USB_PROTO_OP_GET_XIP_STATS = 0x0a,
+
+    // Request: no payload
+    // Response: { static u32, heap size u32, heap high water u32, heap in use u32,
+    //             core0 stack size u32, core0 stack high water u32,
+    //             core1 stack size u32, core1 stack high water u32 }, all in bytes
+    // See memstats.h.
+    USB_PROTO_OP_GET_MEM_STATS = 0x0b,
+
+    // Input record & replay, see replay.h.
+    //
+    // Request: { replay_state_t u8 }: 0 stop, 1 record, 2 replay, 3 replay as fast as possible
+    // Response: no payload
+    USB_PROTO_OP_REPLAY_CONTROL = 0x0c,
+
+    // Request: no payload
+    // Response: { replay_state_t u8, recorded events u16, replayed events u16, timed draws u16 }
+    USB_PROTO_OP_REPLAY_STATUS = 0x0d,
+
+    // Request: { what u8 (0: events, 1: draw times), offset u16 }
+    // Response: { total u16, offset u16, entries }
+    //     events: { time us u32, hmi_event_t u8 } each
+    //     draw times: { us u32 } each
+    USB_PROTO_OP_REPLAY_READ = 0x0e,
+
+    // Replaces the recording from `offset` on, send the chunks in order.
+    // Request: { offset u16, events { time us u32, hmi_event_t u8 } }
+    // Response: no payload
+    USB_PROTO_OP_REPLAY_WRITE = 0x0f,
+
+    // Request: { task index u8 }
+    // Response: { number of tasks u8, then if the index is valid:
+    //             period us u32 (0: one-shot), runs u32, total run time us u32,
+    //             max run time us u32, max lateness us u32, skipped periods u32,
+    //             name (rest of the payload) }
+    // See sched.h.
+    USB_PROTO_OP_GET_TASK_STATS = 0x10,
+
+    // PD source benchmark, see pd_bench.h.
+    //
+    // Request: { repeats u8 }
+    // Response: { status i8 }, 0 if it started
+    USB_PROTO_OP_PD_BENCH_START = 0x11,
+
+    // Request: no payload
+    // Response: { pd_bench_state_t u8, source fingerprint u32, run u8, repeats u8, number of PDOs u8,
+    //             then for each PDO: { id u8, millivolts u16, samples u8,
+    //                                  min us u32, avg us u32, max us u32,
+    //                                  rejects u8, resets u8, timeouts u8, i2c errors u8 } }
+    USB_PROTO_OP_PD_BENCH_RESULTS = 0x12,
+
+    // Read the persistent event log, half a page at a time, see evlog.h.
+    //
+    // Request: { page index u16 (0 is the oldest), half u8 (0 or 1) }
+    // Response: { number of pages u16, dropped events u32, then if the index is valid:
+    //             128 bytes of the page }
+    USB_PROTO_OP_EVLOG_READ = 0x13,
+
+    // Scripted PDO sequences, see pd_seq.h.
+    //
+    // Replace the script, and store it in flash:
+    // Request: { repeats u16 (0: forever), then 1-16 steps of: { millivolts u16, hold ms u32 } }
+    // Response: { status i8 }, 0 if it was stored
+    USB_PROTO_OP_PD_SEQ_WRITE = 0x14,
+
+    // Request: { 1 to start the stored script, 0 to stop }
+    // Response: { status i8 }
+    USB_PROTO_OP_PD_SEQ_CONTROL = 0x15,
+
+    // Request: { first transition u32 }
+    // Response: { pd_seq_state_t u8, run u16, repeats u16, steps u8, transitions so far u32,
+    //             jitter us: min i32, max i32, mean i32,
+    //             first transition returned u32 (the oldest one still logged, if that's later),
+    //             number returned u8 (up to 12), then for each:
+    //             { run u16, step u8, millivolts u16, jitter us i32, contract us u32,
+    //               pd_seq_result_t u8 } }
+    USB_PROTO_OP_PD_SEQ_STATUS = 0x16,
+
+    // Time the main window's big text drawn as bitmaps
+    // (`hagl_put_text_scaled()`) and as rectangles (text_runs.h), at
+    // scales 1, 2 and 4.  Leaves the window to be redrawn.
+    //
+    // Request: { passes u8 (1-50) }
+    // Response: { system clock kHz u32, number of scales u8,
+    //             then for each: { scale u8, bitmap us u32, runs us u32 } },
+    //             in us per pass over the text
+    USB_PROTO_OP_TEXT_BENCH = 0x17,
+
+    // Unsolicited, device to host:
+    // { ms since boot u32, millivolts u16, milliamps u16, i2c errors u32 }
+    USB_PROTO_OP_TELEMETRY = 0x40,
+
+    // Unsolicited, device to host, while subscribed to the log:
+    // { dropped records u32, dlog records (see dlog.h) }
+    USB_PROTO_OP_LOG = 0x41,
+
+    // Unsolicited, device to host, while mirroring the framebuffer:
+    // { row u16, first x u16, RLE pixel runs }
+    USB_PROTO_OP_FB_ROW = 0x42,
+
+    // Unsolicited, device to host, after the rows that changed in a frame:
+    // { frame number u16, width u16, height u16 }
+    USB_PROTO_OP_FB_FRAME = 0x43,
+
+    // Device to host: { request op u8, error code u8 }
+    USB_PROTO_OP_ERROR = 0xff,
+} usb_proto_op_t;
+
+typedef enum {
+    USB_PROTO_ERROR_UNKNOWN_OP = 1,
+    USB_PROTO_ERROR_BAD_LENGTH = 2,
+    USB_PROTO_ERROR_I2C = 3,
+} usb_proto_error_t;
+
+
+typedef void (*usb_proto_handler_t)(uint8_t seq, uint8_t const * payload, size_t len);
+
+
+// `i2c_comm_errors` is the firmware's running count of failed
+// HUSB238 transactions, the protocol reports and resets it.  Starts
+// the task that runs `usb_proto_poll()`: every USB_PROTO_POLL_MS for
+// telemetry and the log, and right away when input arrives.
+void usb_proto_init(i2c_inst_t * i2c, int * i2c_comm_errors);
+
+// Handle whatever input is pending on the USB serial port and send
+// telemetry if it's due.  Never waits for input.
+void usb_proto_poll(void);
+
+// Other modules handle their own ops by registering a handler here.
+// The handler must answer with exactly one `usb_proto_reply()` or
+// `usb_proto_error()`.  Returns false if there's no room for another
+// handler.
+bool usb_proto_add_handler(uint8_t op, usb_proto_handler_t handler);
+
+// Bytes received outside of frames get passed to `handler`.
+void usb_proto_set_key_handler(void (*handler)(uint8_t c));
+
+// Send the response to request `op`.
+void usb_proto_reply(uint8_t op, uint8_t seq, uint8_t const * payload, size_t len);
+
+// Send an error response to request `op`.
+void usb_proto_error(uint8_t op, uint8_t seq, usb_proto_error_t error);
+
+// Send an unsolicited frame.  Returns false, having sent nothing, if
+// it doesn't fit in the USB buffer (see `usb_proto_tx_room()`).
+bool usb_proto_send(uint8_t op, uint8_t const * payload, size_t len);
+
+// How many bytes can go out on the USB serial port without waiting for
+// the host.  Writing more blocks for up to
+// PICO_STDIO_USB_STDOUT_TIMEOUT_US per write if the host has stopped
+// reading, so every writer checks this first.  Replies and frames
+// that don't fit are dropped.
+size_t usb_proto_tx_room(void);
+
+
+static inline void usb_proto_put_u16(uint8_t * p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static inline void usb_proto_put_u32(uint8_t * p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = v >> 24;
+}
+
+static inline uint16_t usb_proto_get_u16(uint8_t const * p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t usb_proto_get_u32(uint8_t const * p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+#endif // __USB_PROTO_H__
@@ -0,0 +1,195 @@
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "hmi.h"
+#include "usb_proto.h"
+#include "vt100.h"
+
+
+// Upper bound on how many bytes we write per trip through the main loop.
+#define VT100_MAX_BYTES_PER_POLL 96
+
+// The longest cursor-addressing sequence we send, "ESC[rr;ccH".
+#define VT100_CURSOR_SEQ_LEN 8
+
+
+static bool vt100_enabled;
+
+// What the terminal is showing now, and what it should be showing.
+static hmi_text_t shown;
+static hmi_text_t target;
+
+static uint32_t last_draw_count;
+static bool rerender;
+
+// The terminal needs clearing before anything else goes out.
+static bool need_clear;
+
+// Parser state for arrow keys, which arrive as "ESC [ A" etc.
+static enum {
+    KEY_STATE_NORMAL,
+    KEY_STATE_ESC,
+    KEY_STATE_CSI
+} key_state;
+
+// The last key was a CR.  Terminals send Enter as CR, LF or CR LF, and
+// CR LF is still one click.
+static bool after_cr;
+
+
+// Returns false, having written nothing, if `s` doesn't fit in the USB
+// buffer.
+static bool put_string(char const * s) {
+    if (usb_proto_tx_room() < strlen(s)) {
+        return false;
+    }
+    while (*s != '\0') {
+        putchar_raw(*s++);
+    }
+    return true;
+}
+
+
+// Clear the terminal (at the next poll, once there's room) and forget
+// what it was showing, so the poll repaints every non-blank cell.
+static void repaint(void) {
+    need_clear = true;
+    memset(shown.cells, ' ', sizeof(shown.cells));
+    rerender = true;
+}
+
+
+static void handle_key(uint8_t c) {
+    bool was_after_cr = after_cr;
+    after_cr = (c == '\r');
+
+    if (!vt100_enabled) {
+        vt100_enabled = true;
+        key_state = KEY_STATE_NORMAL;
+        repaint();
+        return;
+    }
+
+    if (key_state == KEY_STATE_ESC) {
+        key_state = (c == '[') ? KEY_STATE_CSI : KEY_STATE_NORMAL;
+        return;
+    }
+
+    if (key_state == KEY_STATE_CSI) {
+        key_state = KEY_STATE_NORMAL;
+        switch (c) {
+        case 'A':  // up
+        case 'D':  // left
+            hmi_inject_event(HMI_EVENT_CCW);
+            break;
+        case 'B':  // down
+        case 'C':  // right
+            hmi_inject_event(HMI_EVENT_CW);
+            break;
+        }
+        return;
+    }
+
+    switch (c) {
+    case 0x1b:
+        key_state = KEY_STATE_ESC;
+        break;
+    case 'j':
+    case 'l':
+    case '+':
+        hmi_inject_event(HMI_EVENT_CW);
+        break;
+    case 'k':
+    case 'h':
+    case '-':
+        hmi_inject_event(HMI_EVENT_CCW);
+        break;
+    case '\n':
+        if (was_after_cr) {
+            break;
+        }
+        hmi_inject_event(HMI_EVENT_CLICK);
+        break;
+    case '\r':
+    case ' ':
+        hmi_inject_event(HMI_EVENT_CLICK);
+        break;
+    case 0x0c:  // Ctrl-L
+        repaint();
+        break;
+    case 'q':
+        // Best effort, the mirror is off either way.
+        put_string("\x1b[2J\x1b[H\x1b[?25h");  // clear screen, home, show cursor
+        vt100_enabled = false;
+        break;
+    }
+}
+
+
+void vt100_init(void) {
+    vt100_enabled = false;
+    usb_proto_set_key_handler(handle_key);
+}
+
+
+void vt100_poll(void) {
+    if (!vt100_enabled) {
+        return;
+    }
+
+    uint32_t draw_count = hmi_get_draw_count();
+    if (rerender || (draw_count != last_draw_count)) {
+        hmi_text(&target);
+        last_draw_count = draw_count;
+        rerender = false;
+    }
+
+    if (need_clear) {
+        if (!put_string("\x1b[2J\x1b[H\x1b[?25l")) {  // clear screen, home, hide cursor
+            return;
+        }
+        need_clear = false;
+    }
+
+    // Never more than the USB buffer takes without waiting, so a
+    // terminal that stops reading can't stall the main loop.
+    int budget = VT100_MAX_BYTES_PER_POLL;
+    if (usb_proto_tx_room() < (size_t)budget) {
+        budget = usb_proto_tx_room();
+    }
+
+    for (int row = 0; row < HMI_TEXT_ROWS; ++row) {
+        int col = 0;
+        while (col < HMI_TEXT_COLS) {
+            if (target.cells[row][col] == shown.cells[row][col]) {
+                ++col;
+                continue;
+            }
+
+            // Found a changed cell, find the end of the run of changes.
+            int end = col + 1;
+            while ((end < HMI_TEXT_COLS) && (target.cells[row][end] != shown.cells[row][end])) {
+                ++end;
+            }
+
+            if (budget < VT100_CURSOR_SEQ_LEN + 1) {
+                return;
+            }
+            if (end - col > budget - VT100_CURSOR_SEQ_LEN) {
+                end = col + budget - VT100_CURSOR_SEQ_LEN;
+            }
+
+            char seq[VT100_CURSOR_SEQ_LEN + 1];
+            snprintf(seq, sizeof(seq), "\x1b[%d;%dH", row + 1, col + 1);
+            put_string(seq);
+            for (int i = col; i < end; ++i) {
+                putchar_raw(target.cells[row][i]);
+                shown.cells[row][i] = target.cells[row][i];
+            }
+            budget -= VT100_CURSOR_SEQ_LEN + (end - col);
+
+            col = end;
+        }
+    }
+}
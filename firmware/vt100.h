@@ -0,0 +1,28 @@
+#ifndef __VT100_H__
+#define __VT100_H__
+
+//
+// Text-mode mirror of the HMI on the USB serial port, for a remote UI
+// from any VT100-compatible terminal program.
+//
+// Pressing any key in the terminal turns the mirror on.  From then on
+// the active window's text rendition (see `hmi_window_t.text()`) is
+// re-rendered after every draw, and only the cells that changed are
+// rewritten, using cursor addressing.  Output per trip through the
+// main loop is capped, and never more than the USB buffer has room
+// for, so a slow link never backs up.
+//
+// Keys map back to knob events:
+//     cw:    down/right arrow, j, l, +
+//     ccw:   up/left arrow, k, h, -
+//     click: Enter, space
+//     Ctrl-L repaints the whole screen, q turns the mirror off.
+//
+
+void vt100_init(void);
+
+// Background task for `hmi_add_background_task()`.
+void vt100_poll(void);
+
+
+#endif // __VT100_H__
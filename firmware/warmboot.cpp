@@ -0,0 +1,72 @@
+#include "hardware/watchdog.h"
+#include "pico/stdlib.h"
+
+#include "sched.h"
+#include "warmboot.h"
+
+
+#define WARMBOOT_MAGIC 0x7761726d      // "warm"
+
+static bool warm;
+static sched_task_t * heartbeat_task;
+static void (*get_state)(warmboot_state_t * state);
+
+
+static uint32_t check(uint32_t s0, uint32_t s1, uint32_t s2) {
+    return ~(s0 ^ s1 ^ s2);
+}
+
+
+// Task: feed the watchdog, and keep the state in the scratch registers
+// up to date for when it bites.
+static void heartbeat(void) {
+    warmboot_state_t state;
+    get_state(&state);
+
+    uint32_t s1 = state.window | (state.rotation_index << 8);
+    uint32_t s2 = state.millivolts | ((state.milliamps & 0x7fff) << 16) | ((uint32_t)state.connected << 31);
+    watchdog_hw->scratch[1] = s1;
+    watchdog_hw->scratch[2] = s2;
+    watchdog_hw->scratch[3] = check(WARMBOOT_MAGIC, s1, s2);
+    watchdog_hw->scratch[0] = WARMBOOT_MAGIC;
+
+    watchdog_update();
+}
+
+
+bool warmboot_init(warmboot_state_t * state) {
+    uint32_t s0 = watchdog_hw->scratch[0];
+    uint32_t s1 = watchdog_hw->scratch[1];
+    uint32_t s2 = watchdog_hw->scratch[2];
+    uint32_t s3 = watchdog_hw->scratch[3];
+
+    // Only warm boot once per stash.
+    watchdog_hw->scratch[0] = 0;
+
+    warm = watchdog_enable_caused_reboot()
+        && (s0 == WARMBOOT_MAGIC)
+        && (s3 == check(s0, s1, s2));
+    if (!warm) {
+        return false;
+    }
+
+    state->window = s1 & 0xff;
+    state->rotation_index = (s1 >> 8) & 0xff;
+    state->connected = (s2 >> 31) & 1;
+    state->millivolts = s2 & 0xffff;
+    state->milliamps = (s2 >> 16) & 0x7fff;
+    return true;
+}
+
+
+bool warmboot_is_warm(void) {
+    return warm;
+}
+
+
+void warmboot_start(void (*get_state_fn)(warmboot_state_t * state)) {
+    get_state = get_state_fn;
+    heartbeat_task = sched_task_create("watchdog", heartbeat);
+    sched_start_periodic(heartbeat_task, WARMBOOT_HEARTBEAT_MS * 1000);
+    watchdog_enable(WARMBOOT_TIMEOUT_MS, true);
+}
@@ -0,0 +1,57 @@
+#ifndef __WARMBOOT_H__
+#define __WARMBOOT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// Watchdog, and warm restarts after it bites.
+//
+// `warmboot_start()` enables the RP2040's watchdog and feeds it from a
+// scheduler task, so it's fed only as long as the main loop keeps
+// running tasks.  If something hangs (say, a blocking i2c call on a
+// wedged bus) for WARMBOOT_TIMEOUT_MS, the watchdog resets the chip.
+//
+// The same task keeps a copy of what's on the screen (the active
+// window, the screen rotation, whether there was a source and the
+// contract) in the watchdog's scratch registers, which survive the
+// reset.  After a watchdog reset `warmboot_init()` hands that state
+// back, and main() takes the warm path: it puts the last contract (or
+// "No input power") back on the screen as soon as the display is up
+// instead of the splash screen, skips restoring the source's favorite
+// PDO (the HUSB238 kept its contract through our reset), and goes back
+// to the window that was active.  When the screen
+// is back it marks BOOT_PHASE_WARM_RESTORE (see boot.h); the whole
+// outage is that plus however long the hang took to hit the timeout.
+//
+// Scratch registers 0-3 are ours, the SDK uses 4-7.
+//
+
+#ifndef WARMBOOT_TIMEOUT_MS
+#define WARMBOOT_TIMEOUT_MS 2000
+#endif
+
+#define WARMBOOT_HEARTBEAT_MS 100
+
+typedef struct {
+    uint8_t window;
+    uint8_t rotation_index;
+    bool connected;         // whether the HUSB238 had power
+    uint16_t millivolts;    // 0 if there was no contract
+    uint16_t milliamps;
+} warmboot_state_t;
+
+
+// Returns true if the watchdog reset us with valid state in the
+// scratch registers, and the state in `*state`.  Call early in main().
+bool warmboot_init(warmboot_state_t * state);
+
+// Was this a warm boot?
+bool warmboot_is_warm(void);
+
+// Enables the watchdog and starts the heartbeat task, which calls
+// `get_state()` to get what it should stash.
+void warmboot_start(void (*get_state)(warmboot_state_t * state));
+
+
+#endif // __WARMBOOT_H__
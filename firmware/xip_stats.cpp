@@ -0,0 +1,48 @@
+#include "hardware/structs/xip_ctrl.h"
+
+#include "hmi.h"
+#include "usb_proto.h"
+#include "xip_stats.h"
+
+
+static void handle_get_xip_stats(uint8_t seq, uint8_t const * payload, size_t len) {
+    if (len != 1) {
+        usb_proto_error(USB_PROTO_OP_GET_XIP_STATS, seq, USB_PROTO_ERROR_BAD_LENGTH);
+        return;
+    }
+
+    uint32_t hits, accesses;
+    xip_stats_get(&hits, &accesses);
+
+    uint8_t reply[13];
+    usb_proto_put_u32(&reply[0], hits);
+    usb_proto_put_u32(&reply[4], accesses);
+    usb_proto_put_u32(&reply[8], hmi_get_draw_count());
+    reply[12] = HOT_IN_RAM;
+
+    if (payload[0]) {
+        xip_stats_reset();
+    }
+
+    usb_proto_reply(USB_PROTO_OP_GET_XIP_STATS, seq, reply, sizeof(reply));
+}
+
+
+void xip_stats_init(void) {
+    usb_proto_add_handler(USB_PROTO_OP_GET_XIP_STATS, handle_get_xip_stats);
+}
+
+
+void xip_stats_reset(void) {
+    // Writing any value clears the counter.
+    xip_ctrl_hw->ctr_hit = 0;
+    xip_ctrl_hw->ctr_acc = 0;
+}
+
+
+void xip_stats_get(uint32_t * hits, uint32_t * accesses) {
+    // Read hits first so a cache access between the two reads can't
+    // make hits > accesses.
+    *hits = xip_ctrl_hw->ctr_hit;
+    *accesses = xip_ctrl_hw->ctr_acc;
+}
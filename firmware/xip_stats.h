@@ -0,0 +1,24 @@
+#ifndef __XIP_STATS_H__
+#define __XIP_STATS_H__
+
+#include <stdint.h>
+
+//
+// XIP cache hit/miss counters.
+//
+// The RP2040's XIP controller counts cache accesses and hits.  The
+// host reads (and optionally resets) the counters with
+// USB_PROTO_OP_GET_XIP_STATS, see usb_proto.h, along with the number of
+// frames drawn so it can tell what the counts covered.
+// `tools/pd_sink_box.py xip` runs a measurement.
+//
+
+// Registers the USB protocol handler.
+void xip_stats_init(void);
+
+void xip_stats_reset(void);
+
+// The counters saturate at 0xffffffff.  Misses are accesses - hits.
+void xip_stats_get(uint32_t * hits, uint32_t * accesses);
+
+#endif // __XIP_STATS_H__
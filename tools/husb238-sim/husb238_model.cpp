@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <random>
+
+#include "hardware/i2c.h"
+
+#include "husb238_model.h"
+#include "sim_pico.h"
+
+
+#define GO_COMMAND_SELECT_PDO 0x01
+#define GO_COMMAND_GET_SRC_CAP 0x04
+#define GO_COMMAND_HARD_RESET 0x10
+
+#define SRC_PDO_DETECTED 0x80
+#define REG_SRC_PDO_5V 0x02
+#define NUM_REGS 10
+
+// Requests for a PDO the source doesn't offer get an answer this fast.
+#define REJECT_US 5000
+
+// SRC_PDO selection codes, and PD_STATUS0 voltage codes (index + 1),
+// for 5/9/12/15/18/20V, same as firmware/pd.cpp.
+static uint8_t const pdo_ids[PD_NUM_PDOS] = { 0x1, 0x2, 0x3, 0x8, 0x9, 0xa };
+static int const pdo_millivolts[PD_NUM_PDOS] = { 5000, 9000, 12000, 15000, 18000, 20000 };
+
+// PD_STATUS0 bits 3:0 and SRC_PDO_xV bits 3:0.
+static uint16_t const current_code_ma[16] = {
+    500, 700, 1000, 1250, 1500, 1750, 2000, 2250,
+    2500, 2750, 3000, 3250, 3500, 4000, 4500, 5000,
+};
+
+typedef enum {
+    PENDING_NONE,
+    PENDING_CONTRACT,       // a request the source accepted
+    PENDING_REJECT,         // a request for a PDO the source doesn't offer
+    PENDING_HARD_RESET,     // the source is coming back from a hard reset
+    PENDING_BOOT,           // the chip is coming back from a reset
+} pending_t;
+
+static husb238_model_config_t config;
+static husb238_model_stats_t stats;
+static std::mt19937 rng;
+
+static uint8_t regs[NUM_REGS];
+static uint8_t reg_pointer;
+static int contract = -1;       // index into pdo_ids, -1 if no contract
+
+static pending_t pending;
+static uint64_t pending_at_us;
+static int pending_pdo;
+
+static uint64_t booting_until_us;
+static uint64_t stuck_until_us;
+static uint64_t next_stuck_us;
+static uint64_t next_reset_us;
+static uint64_t last_reset_us;
+
+i2c_inst_t i2c0_inst;
+i2c_inst_t i2c1_inst;
+
+
+static uint8_t current_code(int milliamps) {
+    uint8_t code = 0;
+    for (uint8_t i = 0; i < 16; ++i) {
+        if (current_code_ma[i] <= milliamps) {
+            code = i;
+        }
+    }
+    return code;
+}
+
+
+// When the next of a random series of events with `per_s` average
+// rate happens, after `after_us`.
+static uint64_t next_event_us(uint64_t after_us, double per_s) {
+    if (per_s <= 0.0) {
+        return UINT64_MAX;
+    }
+    std::exponential_distribution<double> interval_s(per_s);
+    return after_us + 1 + (uint64_t)(interval_s(rng) * 1e6);
+}
+
+
+static void set_response(int response) {
+    regs[PD_REG_PD_STATUS1] = (regs[PD_REG_PD_STATUS1] & ~(0x7 << 3)) | (response << 3);
+}
+
+
+static void set_contract(int pdo) {
+    contract = pdo;
+    if (pdo < 0) {
+        regs[PD_REG_PD_STATUS0] = 0;
+    } else {
+        regs[PD_REG_PD_STATUS0] = ((pdo + 1) << 4) | current_code(config.pdo_milliamps[pdo]);
+    }
+    ++stats.contracts;
+}
+
+
+// The chip's state after power-up: attached to the source, at 5V.
+static void power_up(void) {
+    for (int i = 0; i < NUM_REGS; ++i) {
+        regs[i] = 0;
+    }
+    for (int i = 0; i < PD_NUM_PDOS; ++i) {
+        if (config.pdo_milliamps[i] > 0) {
+            regs[REG_SRC_PDO_5V + i] = SRC_PDO_DETECTED | current_code(config.pdo_milliamps[i]);
+        }
+    }
+    regs[PD_REG_PD_STATUS1] = PD_STATUS1_ATTACH;
+    set_contract(0);
+    reg_pointer = 0;
+}
+
+
+static void chip_reset(uint64_t now_us) {
+    ++stats.resets;
+    last_reset_us = now_us;
+    next_reset_us = next_event_us(now_us, config.reset_per_s);
+
+    for (int i = 0; i < NUM_REGS; ++i) {
+        regs[i] = 0;
+    }
+    contract = -1;
+    booting_until_us = now_us + config.boot_us;
+    pending = PENDING_BOOT;
+    pending_at_us = booting_until_us;
+}
+
+
+static void complete_pending(void) {
+    switch (pending) {
+    case PENDING_CONTRACT:
+        set_contract(pending_pdo);
+        set_response(PD_RESPONSE_SUCCESS);
+        break;
+    case PENDING_REJECT:
+        set_response(PD_RESPONSE_INVALID);
+        break;
+    case PENDING_HARD_RESET:
+        set_contract(0);
+        set_response(PD_RESPONSE_SUCCESS);
+        break;
+    case PENDING_BOOT:
+        power_up();
+        break;
+    case PENDING_NONE:
+        break;
+    }
+    pending = PENDING_NONE;
+}
+
+
+// Catch up with everything that happened up to `now_us`, in order.
+static void update(uint64_t now_us) {
+    for (;;) {
+        uint64_t pending_us = (pending != PENDING_NONE) ? pending_at_us : UINT64_MAX;
+        if (std::min(pending_us, next_reset_us) > now_us) {
+            break;
+        }
+        if (pending_us <= next_reset_us) {
+            complete_pending();
+        } else {
+            chip_reset(next_reset_us);
+        }
+    }
+
+    while (next_stuck_us <= now_us) {
+        stuck_until_us = next_stuck_us + config.stuck_us;
+        next_stuck_us = next_event_us(stuck_until_us, config.stuck_per_s);
+    }
+}
+
+
+static void go_command(uint8_t command, uint64_t now_us) {
+    if (command & GO_COMMAND_HARD_RESET) {
+        set_contract(-1);
+        pending = PENDING_HARD_RESET;
+        pending_at_us = now_us + config.hard_reset_us;
+        return;
+    }
+
+    if (command & GO_COMMAND_SELECT_PDO) {
+        ++stats.requests;
+        uint8_t id = regs[PD_REG_SRC_PDO] >> 4;
+        pending_pdo = -1;
+        for (int i = 0; i < PD_NUM_PDOS; ++i) {
+            if ((pdo_ids[i] == id) && (config.pdo_milliamps[i] > 0)) {
+                pending_pdo = i;
+            }
+        }
+        if (pending_pdo < 0) {
+            pending = PENDING_REJECT;
+            pending_at_us = now_us + REJECT_US;
+            return;
+        }
+        std::uniform_int_distribution<uint32_t> delay_us(config.request_min_us, config.request_max_us);
+        pending = PENDING_CONTRACT;
+        pending_at_us = now_us + delay_us(rng);
+        return;
+    }
+
+    if (command & GO_COMMAND_GET_SRC_CAP) {
+        set_response(PD_RESPONSE_SUCCESS);
+    }
+}
+
+
+static void write_reg(uint8_t reg, uint8_t value, uint64_t now_us) {
+    if (reg == PD_REG_SRC_PDO) {
+        regs[reg] = value;
+    } else if (reg == PD_REG_GO_COMMAND) {
+        go_command(value, now_us);
+    }
+    // The rest are read-only.
+}
+
+
+// How long `bytes` bytes plus the address take on the bus, with start
+// and stop.
+static uint64_t bus_us(i2c_inst_t * i2c, size_t bytes) {
+    uint baudrate = (i2c->baudrate > 0) ? i2c->baudrate : 100 * 1000;
+    return (((bytes + 1) * 9 + 2) * 1000000ull) / baudrate;
+}
+
+
+// One transaction, `until` is 0 for the ones that block forever.
+static int transaction(i2c_inst_t * i2c, uint8_t addr, bool read, uint8_t * data, size_t len, absolute_time_t until) {
+    uint64_t now_us = sim_now_us();
+    update(now_us);
+    ++stats.transactions;
+
+    if (now_us < stuck_until_us) {
+        ++stats.stuck;
+        if ((until != 0) && (until < stuck_until_us)) {
+            sim_advance_us(std::max(until, now_us) - now_us);
+            return PICO_ERROR_TIMEOUT;
+        }
+        stats.stuck_wait_us += stuck_until_us - now_us;
+        sim_advance_us(stuck_until_us - now_us);
+        return PICO_ERROR_GENERIC;
+    }
+
+    std::bernoulli_distribution nack(config.nack_rate);
+    if ((addr != PD_I2C_ADDR) || (now_us < booting_until_us) || nack(rng)) {
+        ++stats.nacks;
+        sim_advance_us(bus_us(i2c, 0));
+        return PICO_ERROR_GENERIC;
+    }
+
+    sim_advance_us(bus_us(i2c, len));
+
+    if (read) {
+        for (size_t i = 0; i < len; ++i) {
+            data[i] = (reg_pointer < NUM_REGS) ? regs[reg_pointer] : 0;
+            ++reg_pointer;
+        }
+    } else if (len > 0) {
+        reg_pointer = data[0];
+        for (size_t i = 1; i < len; ++i) {
+            write_reg(reg_pointer++, data[i], sim_now_us());
+        }
+    }
+    return (int)len;
+}
+
+
+void husb238_model_default_config(husb238_model_config_t * c) {
+    *c = (husb238_model_config_t) {
+        .pdo_milliamps = { 3000, 3000, 0, 3000, 0, 3000 },
+        .request_min_us = 40 * 1000,
+        .request_max_us = 250 * 1000,
+        .hard_reset_us = 800 * 1000,
+        .nack_rate = 0.0,
+        .stuck_per_s = 0.0,
+        .stuck_us = 50 * 1000,
+        .reset_per_s = 0.0,
+        .boot_us = 30 * 1000,
+        .seed = 1,
+    };
+}
+
+
+void husb238_model_init(husb238_model_config_t const * c) {
+    uint64_t now_us = sim_now_us();
+
+    config = *c;
+    stats = (husb238_model_stats_t) {};
+    rng.seed(config.seed);
+
+    pending = PENDING_NONE;
+    booting_until_us = 0;
+    stuck_until_us = 0;
+    last_reset_us = UINT64_MAX;
+    next_stuck_us = next_event_us(now_us, config.stuck_per_s);
+    next_reset_us = next_event_us(now_us, config.reset_per_s);
+
+    power_up();
+    stats.contracts = 0;
+}
+
+
+void husb238_model_get_stats(husb238_model_stats_t * s) {
+    update(sim_now_us());
+    *s = stats;
+}
+
+
+int husb238_model_contract_millivolts(void) {
+    update(sim_now_us());
+    return (contract < 0) ? 0 : pdo_millivolts[contract];
+}
+
+
+uint64_t husb238_model_last_reset_us(void) {
+    return last_reset_us;
+}
+
+
+//
+// The SDK's i2c functions.
+//
+
+uint i2c_init(i2c_inst_t * i2c, uint baudrate) {
+    i2c->baudrate = baudrate;
+    return baudrate;
+}
+
+int i2c_write_blocking(i2c_inst_t * i2c, uint8_t addr, uint8_t const * src, size_t len, bool nostop) {
+    return transaction(i2c, addr, false, (uint8_t *)src, len, 0);
+}
+
+int i2c_read_blocking(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop) {
+    return transaction(i2c, addr, true, dst, len, 0);
+}
+
+int i2c_write_blocking_until(i2c_inst_t * i2c, uint8_t addr, uint8_t const * src, size_t len, bool nostop, absolute_time_t until) {
+    return transaction(i2c, addr, false, (uint8_t *)src, len, until);
+}
+
+int i2c_read_blocking_until(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop, absolute_time_t until) {
+    return transaction(i2c, addr, true, dst, len, until);
+}
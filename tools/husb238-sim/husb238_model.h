@@ -0,0 +1,88 @@
+#ifndef __HUSB238_MODEL_H__
+#define __HUSB238_MODEL_H__
+
+#include <stdint.h>
+
+#include "pd.h"
+
+//
+// A behavioral model of the HUSB238 and the source behind it, on the
+// far end of the shim's `i2c_write_blocking()` / `i2c_read_blocking()`
+// (see shim/hardware/i2c.h), so the real driver and firmware/pd.cpp can
+// run against it on the host.
+//
+// The model has the HUSB238's register map: PD_STATUS0/1, the
+// SRC_PDO_xV registers describing what the source offers, SRC_PDO and
+// GO_COMMAND.  Requesting a PDO (GO_COMMAND 0x01) changes the contract
+// after a random delay in [request_min_us, request_max_us], requesting
+// one the source doesn't offer gets an "invalid" response, and a hard
+// reset (GO_COMMAND 0x10) drops the contract for hard_reset_us and
+// comes back at 5V.  Transactions take as long as their bits take at
+// the controller's baud rate.
+//
+// And it misbehaves on demand, which is the point:
+//
+// - NACKs: each transaction fails to be acknowledged with probability
+//   `nack_rate`.
+//
+// - Stuck bus: something holds the bus for `stuck_us`, `stuck_per_s`
+//   times a second on average.  The blocking calls wait it out (the
+//   SDK's would too), the `_until` ones time out.
+//
+// - Chip resets: the HUSB238 browns out `reset_per_s` times a second
+//   on average.  It NACKs everything for `boot_us`, then comes back
+//   attached at 5V as after power-up, whatever was selected before.
+//
+// Faults arrive at random times (exponentially distributed) from a
+// seeded generator, so a run with the same config and seed repeats
+// exactly.
+//
+
+typedef struct {
+    // Max current the source offers at 5/9/12/15/18/20V, 0 if it
+    // doesn't offer that voltage.
+    int pdo_milliamps[PD_NUM_PDOS];
+
+    uint32_t request_min_us;
+    uint32_t request_max_us;
+    uint32_t hard_reset_us;
+
+    double nack_rate;
+    double stuck_per_s;
+    uint32_t stuck_us;
+    double reset_per_s;
+    uint32_t boot_us;
+
+    uint32_t seed;
+} husb238_model_config_t;
+
+typedef struct {
+    uint32_t transactions;
+    uint32_t nacks;             // injected, and while booting after a reset
+    uint32_t stuck;             // transactions that ran into a stuck bus
+    uint64_t stuck_wait_us;     // time the blocking calls spent waiting it out
+    uint32_t resets;
+    uint32_t requests;          // GO_COMMAND PDO requests
+    uint32_t contracts;         // contracts that changed
+} husb238_model_stats_t;
+
+
+// A config with a 5/9/15/20V 3A source, contracts that take 40-250 ms,
+// and no faults.
+void husb238_model_default_config(husb238_model_config_t * config);
+
+// Power up the model (attached, 5V contract), at the current simulated
+// time.
+void husb238_model_init(husb238_model_config_t const * config);
+
+void husb238_model_get_stats(husb238_model_stats_t * stats);
+
+// What the contract really is right now, 0 while there's none, no
+// matter whether anyone can read it over the bus.
+int husb238_model_contract_millivolts(void);
+
+// When the last chip reset happened, or UINT64_MAX if it never did.
+uint64_t husb238_model_last_reset_us(void);
+
+
+#endif // __HUSB238_MODEL_H__
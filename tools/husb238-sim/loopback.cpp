@@ -0,0 +1,591 @@
+//
+// Loopback test of the USB serial protocol (firmware/usb_proto.cpp).
+//
+// The real usb_proto.cpp runs with the serial port replaced by two byte
+// queues, and the HUSB238 model (see husb238_model.h) behind the
+// handlers that talk to the chip.  The test plays the host: it frames
+// requests with its own COBS and CRC-16 code (the same as
+// tools/pd_sink_box.py), feeds them in, and unframes and checks what
+// comes back.  It covers:
+//
+// - framing: COBS round trips, including payloads with zeros and runs
+//   of 254 non-zero bytes, and every device frame starting and ending
+//   with a 0x00 byte.
+// - errors: bad CRCs, bad COBS, frames that don't fit, short frames,
+//   unknown ops and bad lengths, and the counters that GET_ERRORS
+//   reports.
+// - dispatch: the built-in ops, handlers registered with
+//   `usb_proto_add_handler()`, and keystrokes outside of frames going to
+//   the key handler.
+// - a poll that leaves input unread posting the task to run again.
+// - a host that stops reading: frames that don't fit in the USB buffer
+//   are dropped instead of blocking.
+// - SELECT_PDO changing the model's contract and asking for a redraw.
+//
+// Prints each failed check and exits non-zero if there were any.
+//
+// Usage: usb-proto-loopback
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include <deque>
+#include <vector>
+
+#include "pico/stdlib.h"
+#include "hardware/i2c.h"
+
+#include "boot.h"
+#include "dlog.h"
+#include "evlog.h"
+#include "hmi.h"
+#include "husb238_model.h"
+#include "pd.h"
+#include "sched.h"
+#include "sim_pico.h"
+#include "tusb.h"
+#include "usb_proto.h"
+
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+typedef std::vector<uint8_t> bytes_t;
+
+typedef struct {
+    uint8_t op;
+    uint8_t seq;
+    bytes_t payload;
+} frame_t;
+
+static i2c_inst_t * const i2c = i2c0;
+static int i2c_comm_errors;
+
+static int failures;
+
+// The serial port, as seen from the device.
+static std::deque<uint8_t> to_device;
+static bytes_t from_device;
+
+// Room in the device's USB buffer.  The host reads everything as soon
+// as it's written unless the test says otherwise.
+static uint32_t tx_room = CFG_TUD_CDC_TX_BUFSIZE;
+
+static bytes_t keys;
+static uint32_t redraws;
+static int evlog_events;
+static evlog_event_t evlog_last_type;
+static uint8_t evlog_last_a;
+
+static uint32_t usb_task_posts;
+
+static uint8_t host_seq;
+
+
+static void check(bool ok, char const * what, int line) {
+    if (!ok) {
+        printf("loopback.cpp:%d: check failed: %s\n", line, what);
+        ++failures;
+    }
+}
+
+
+//
+// What usb_proto.cpp needs from the rest of the firmware and the SDK.
+//
+
+int getchar_timeout_us(uint32_t timeout_us) {
+    if (to_device.empty()) {
+        return PICO_ERROR_TIMEOUT;
+    }
+    int c = to_device.front();
+    to_device.pop_front();
+    return c;
+}
+
+int putchar_raw(int c) {
+    from_device.push_back(c);
+    return c;
+}
+
+bool tud_cdc_connected(void) {
+    return true;
+}
+
+uint32_t tud_cdc_write_available(void) {
+    return tx_room;
+}
+
+void stdio_set_chars_available_callback(void (*fn)(void *), void * param) {
+}
+
+// There's only the one task, and the test runs it by hand.
+struct sched_task {
+    int unused;
+};
+
+sched_task_t * sched_task_create(char const * name, void (*run)(void)) {
+    static sched_task_t task;
+    return &task;
+}
+
+void sched_start_periodic(sched_task_t * task, uint32_t period_us) {
+}
+
+void sched_post(sched_task_t * task) {
+    ++usb_task_posts;
+}
+
+uint32_t boot_get_us(boot_phase_t phase) {
+    return (phase + 1) * 1000;
+}
+
+size_t dlog_read(uint32_t * words, size_t max_words) {
+    return 0;
+}
+
+uint32_t dlog_get_dropped(void) {
+    return 0;
+}
+
+void evlog_add(evlog_event_t type, uint8_t a, uint16_t b) {
+    ++evlog_events;
+    evlog_last_type = type;
+    evlog_last_a = a;
+}
+
+void hmi_request_redraw(void) {
+    ++redraws;
+}
+
+
+//
+// The host's end, written separately from the firmware's so the two
+// check each other.
+//
+
+static uint16_t crc16(bytes_t const & data) {
+    uint16_t crc = 0xffff;
+    for (uint8_t b : data) {
+        crc ^= b << 8;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+static bytes_t cobs_encode(bytes_t const & in) {
+    bytes_t out;
+    size_t code_index = 0;
+    out.push_back(0);
+    for (uint8_t b : in) {
+        if (b != 0) {
+            out.push_back(b);
+        }
+        if ((b == 0) || ((out.size() - code_index) == 0xff)) {
+            out[code_index] = out.size() - code_index;
+            code_index = out.size();
+            out.push_back(0);
+        }
+    }
+    out[code_index] = out.size() - code_index;
+    return out;
+}
+
+// False if `in` is not valid COBS.
+static bool cobs_decode(bytes_t const & in, bytes_t * out) {
+    out->clear();
+    size_t i = 0;
+    while (i < in.size()) {
+        uint8_t code = in[i++];
+        if ((code == 0) || ((i + code - 1) > in.size())) {
+            return false;
+        }
+        out->insert(out->end(), in.begin() + i, in.begin() + i + code - 1);
+        i += code - 1;
+        if ((code != 0xff) && (i < in.size())) {
+            out->push_back(0);
+        }
+    }
+    return true;
+}
+
+static bytes_t frame_body(uint8_t op, uint8_t seq, bytes_t const & payload) {
+    bytes_t body = { op, seq };
+    body.insert(body.end(), payload.begin(), payload.end());
+    uint16_t crc = crc16(body);
+    body.push_back(crc & 0xff);
+    body.push_back(crc >> 8);
+    return body;
+}
+
+static void send_raw(bytes_t const & data) {
+    to_device.insert(to_device.end(), data.begin(), data.end());
+}
+
+// Send `encoded` between zeros, as a frame.
+static void send_encoded(bytes_t const & encoded) {
+    send_raw({ 0x00 });
+    send_raw(encoded);
+    send_raw({ 0x00 });
+}
+
+static uint8_t send_request(uint8_t op, bytes_t const & payload) {
+    ++host_seq;
+    send_encoded(cobs_encode(frame_body(op, host_seq, payload)));
+    return host_seq;
+}
+
+// Let the device read everything it's been sent.
+static void run_device(void) {
+    while (!to_device.empty()) {
+        usb_proto_poll();
+    }
+}
+
+// Split what the device sent into frames, checking each one is
+// well-formed, and forget it.
+static std::vector<frame_t> received(void) {
+    std::vector<frame_t> frames;
+
+    // Every frame starts and ends with a zero.
+    CHECK(from_device.empty() || (from_device[0] == 0x00));
+
+    bytes_t encoded;
+    size_t zeros = 0;
+    for (uint8_t c : from_device) {
+        if (c != 0x00) {
+            encoded.push_back(c);
+            continue;
+        }
+        ++zeros;
+        if (encoded.empty()) {
+            continue;
+        }
+        bytes_t body;
+        CHECK(cobs_decode(encoded, &body));
+        CHECK(body.size() >= 4);
+        if (body.size() >= 4) {
+            uint16_t crc = body[body.size() - 2] | (body[body.size() - 1] << 8);
+            CHECK(crc == crc16(bytes_t(body.begin(), body.end() - 2)));
+            frames.push_back({ body[0], body[1], bytes_t(body.begin() + 2, body.end() - 2) });
+        }
+        encoded.clear();
+    }
+    CHECK(encoded.empty());
+    CHECK(zeros == 2 * frames.size());
+
+    from_device.clear();
+    return frames;
+}
+
+// Send a request and return the one reply.
+static frame_t request(uint8_t op, bytes_t const & payload) {
+    uint8_t seq = send_request(op, payload);
+    run_device();
+    std::vector<frame_t> frames = received();
+    CHECK(frames.size() == 1);
+    if (frames.size() != 1) {
+        return { 0, 0, {} };
+    }
+    CHECK(frames[0].seq == seq);
+    return frames[0];
+}
+
+static void check_error(frame_t const & reply, uint8_t op, usb_proto_error_t error) {
+    CHECK(reply.op == USB_PROTO_OP_ERROR);
+    CHECK(reply.payload == bytes_t({ op, (uint8_t)error }));
+}
+
+static uint32_t get_errors(int which) {
+    frame_t reply = request(USB_PROTO_OP_GET_ERRORS, {});
+    CHECK(reply.op == (USB_PROTO_OP_GET_ERRORS | USB_PROTO_OP_RESPONSE));
+    CHECK(reply.payload.size() == 12);
+    if (reply.payload.size() != 12) {
+        return 0;
+    }
+    return usb_proto_get_u32(&reply.payload[which * 4]);
+}
+
+
+//
+// Registered handlers and the key handler.
+//
+
+#define OP_ECHO 0x70
+
+static void handle_echo(uint8_t seq, uint8_t const * payload, size_t len) {
+    usb_proto_reply(OP_ECHO, seq, payload, len);
+}
+
+static void key_handler(uint8_t c) {
+    keys.push_back(c);
+}
+
+
+//
+// The tests.
+//
+
+static void test_echo(void) {
+    // Short, empty, zeros in odd places, long non-zero runs (COBS's
+    // 0xff code), and the largest payload there is.
+    std::vector<bytes_t> payloads = {
+        {},
+        { 0x00 },
+        { 0x00, 0x00, 0x00 },
+        { 0x01, 0x00, 0x02, 0x00 },
+    };
+    for (size_t len : { 252, 253, 254, 255 }) {
+        if (len > USB_PROTO_MAX_PAYLOAD) {
+            break;
+        }
+        bytes_t p;
+        for (size_t i = 0; i < len; ++i) {
+            p.push_back((i % 255) + 1);
+        }
+        payloads.push_back(p);
+    }
+    bytes_t max;
+    for (size_t i = 0; i < USB_PROTO_MAX_PAYLOAD; ++i) {
+        max.push_back((i % 7 == 3) ? 0 : i);
+    }
+    payloads.push_back(max);
+    bytes_t long_run(USB_PROTO_MAX_PAYLOAD, 0xa5);
+    payloads.push_back(long_run);
+
+    for (bytes_t const & p : payloads) {
+        frame_t reply = request(OP_ECHO, p);
+        CHECK(reply.op == (OP_ECHO | USB_PROTO_OP_RESPONSE));
+        CHECK(reply.payload == p);
+    }
+}
+
+static void test_pdos_and_select(void) {
+    frame_t reply = request(USB_PROTO_OP_GET_PDOS, {});
+    CHECK(reply.op == (USB_PROTO_OP_GET_PDOS | USB_PROTO_OP_RESPONSE));
+    CHECK(reply.payload.size() == PD_NUM_PDOS * 5);
+    if (reply.payload.size() != PD_NUM_PDOS * 5) {
+        return;
+    }
+
+    // The default model offers 5, 9, 15 and 20V at 3A.
+    int id_9v = -1;
+    int offered = 0;
+    for (int i = 0; i < PD_NUM_PDOS; ++i) {
+        uint8_t const * p = &reply.payload[i * 5];
+        if (usb_proto_get_u16(&p[3]) > 0) {
+            ++offered;
+            CHECK(usb_proto_get_u16(&p[3]) == 3000);
+            if (usb_proto_get_u16(&p[1]) == 9000) {
+                id_9v = p[0];
+            }
+        }
+    }
+    CHECK(offered == 4);
+    CHECK(id_9v >= 0);
+    if (id_9v < 0) {
+        return;
+    }
+
+    reply = request(USB_PROTO_OP_GET_CONTRACT, {});
+    CHECK(reply.op == (USB_PROTO_OP_GET_CONTRACT | USB_PROTO_OP_RESPONSE));
+    CHECK(reply.payload.size() == 6);
+    CHECK((reply.payload.size() == 6) && (reply.payload[0] == 1) && (usb_proto_get_u16(&reply.payload[1]) == 5000));
+
+    uint32_t redraws_before = redraws;
+    int events_before = evlog_events;
+    reply = request(USB_PROTO_OP_SELECT_PDO, { (uint8_t)id_9v });
+    CHECK(reply.op == (USB_PROTO_OP_SELECT_PDO | USB_PROTO_OP_RESPONSE));
+    CHECK(reply.payload == bytes_t({ PICO_OK }));
+    CHECK(redraws > redraws_before);
+    CHECK(evlog_events == events_before + 1);
+    CHECK((evlog_last_type == EVLOG_SELECT) && (evlog_last_a == id_9v));
+
+    // The model takes up to 250 ms to change the contract.
+    sim_advance_us(300 * 1000);
+    CHECK(husb238_model_contract_millivolts() == 9000);
+    reply = request(USB_PROTO_OP_GET_CONTRACT, {});
+    CHECK((reply.payload.size() == 6) && (usb_proto_get_u16(&reply.payload[1]) == 9000));
+    CHECK((reply.payload.size() == 6) && (reply.payload[5] == id_9v));
+
+    check_error(request(USB_PROTO_OP_SELECT_PDO, {}), USB_PROTO_OP_SELECT_PDO, USB_PROTO_ERROR_BAD_LENGTH);
+    check_error(request(USB_PROTO_OP_SELECT_PDO, { 1, 2 }), USB_PROTO_OP_SELECT_PDO, USB_PROTO_ERROR_BAD_LENGTH);
+}
+
+static void test_bad_frames(void) {
+    request(USB_PROTO_OP_RESET_ERRORS, {});
+    CHECK(get_errors(1) == 0);
+    CHECK(get_errors(2) == 0);
+
+    // A flipped bit.
+    bytes_t body = frame_body(OP_ECHO, ++host_seq, { 1, 2, 3 });
+    body[3] ^= 0x10;
+    send_encoded(cobs_encode(body));
+    // A flipped CRC.
+    body = frame_body(OP_ECHO, ++host_seq, {});
+    body[2] ^= 0x01;
+    send_encoded(cobs_encode(body));
+    run_device();
+    CHECK(received().empty());
+    CHECK(get_errors(1) == 2);
+
+    // A COBS code that runs past the end of the frame.
+    send_encoded({ 0x05, 0x01 });
+    // Too short to hold op, seq and a CRC.
+    send_encoded(cobs_encode({ OP_ECHO, 0x01, 0x02 }));
+    // Longer than any frame.
+    send_encoded(bytes_t(USB_PROTO_MAX_PAYLOAD + 16, 0x01));
+    run_device();
+    CHECK(received().empty());
+    CHECK(get_errors(2) == 3);
+
+    // Good frames still get through after all that, including one that
+    // follows a frame the host gave up on half way.
+    send_raw({ 0x00, 0x03, 0x11 });
+    frame_t reply = request(OP_ECHO, { 0x42 });
+    CHECK(reply.payload == bytes_t({ 0x42 }));
+
+    // Back-to-back requests.
+    send_encoded(cobs_encode(frame_body(OP_ECHO, 0x10, { 0xaa })));
+    send_encoded(cobs_encode(frame_body(OP_ECHO, 0x11, { 0xbb })));
+    run_device();
+    std::vector<frame_t> frames = received();
+    CHECK(frames.size() == 2);
+    CHECK((frames.size() == 2) && (frames[0].seq == 0x10) && (frames[1].seq == 0x11));
+
+    check_error(request(0x6f, {}), 0x6f, USB_PROTO_ERROR_UNKNOWN_OP);
+    request(USB_PROTO_OP_RESET_ERRORS, {});
+    CHECK(get_errors(1) == 0);
+    CHECK(get_errors(2) == 0);
+}
+
+static void test_keys(void) {
+    // Keystrokes between frames go to the key handler, and don't get
+    // in the way of the frames.
+    keys.clear();
+    send_raw({ 'a', '\r' });
+    uint8_t seq = send_request(OP_ECHO, { 0x07 });
+    send_raw({ 0x1b, '[', 'A' });
+    run_device();
+    std::vector<frame_t> frames = received();
+    CHECK(frames.size() == 1);
+    CHECK((frames.size() == 1) && (frames[0].seq == seq));
+    CHECK(keys == bytes_t({ 'a', '\r', 0x1b, '[', 'A' }));
+
+    // More than one poll's worth of input has the task run again right
+    // away, and reading the last of it doesn't.
+    keys.clear();
+    send_raw(bytes_t(100, 'x'));
+    uint32_t posts = usb_task_posts;
+    usb_proto_poll();
+    CHECK(usb_task_posts == posts + 1);
+    usb_proto_poll();
+    CHECK(usb_task_posts == posts + 1);
+    CHECK(keys.size() == 100);
+}
+
+static void test_boot_times_and_telemetry(void) {
+    frame_t reply = request(USB_PROTO_OP_GET_BOOT_TIMES, {});
+    CHECK(reply.payload.size() == BOOT_NUM_PHASES * 4);
+    for (int i = 0; (i < BOOT_NUM_PHASES) && (reply.payload.size() == BOOT_NUM_PHASES * 4); ++i) {
+        CHECK(usb_proto_get_u32(&reply.payload[i * 4]) == (uint32_t)((i + 1) * 1000));
+    }
+
+    bytes_t period(2);
+    usb_proto_put_u16(period.data(), 100);
+    reply = request(USB_PROTO_OP_SUBSCRIBE_TELEMETRY, period);
+    CHECK(reply.op == (USB_PROTO_OP_SUBSCRIBE_TELEMETRY | USB_PROTO_OP_RESPONSE));
+
+    // Ten periods, polling every USB_PROTO_POLL_MS like the firmware.
+    for (int ms = 0; ms < 1000; ms += USB_PROTO_POLL_MS) {
+        sim_advance_us(USB_PROTO_POLL_MS * 1000);
+        usb_proto_poll();
+    }
+    std::vector<frame_t> frames = received();
+    CHECK((frames.size() >= 9) && (frames.size() <= 11));
+    for (size_t i = 0; i < frames.size(); ++i) {
+        CHECK(frames[i].op == USB_PROTO_OP_TELEMETRY);
+        CHECK(frames[i].payload.size() == 12);
+        CHECK((i == 0) || (frames[i].seq == (uint8_t)(frames[i - 1].seq + 1)));
+    }
+
+    usb_proto_put_u16(period.data(), 0);
+    request(USB_PROTO_OP_SUBSCRIBE_TELEMETRY, period);
+    for (int ms = 0; ms < 1000; ms += USB_PROTO_POLL_MS) {
+        sim_advance_us(USB_PROTO_POLL_MS * 1000);
+        usb_proto_poll();
+    }
+    CHECK(received().empty());
+}
+
+static void test_host_not_reading(void) {
+    bytes_t period(2);
+    usb_proto_put_u16(period.data(), 100);
+    request(USB_PROTO_OP_SUBSCRIBE_TELEMETRY, period);
+
+    // With the buffer full, replies and telemetry are dropped rather
+    // than waited for.
+    tx_room = 0;
+    send_request(OP_ECHO, { 0x01, 0x02 });
+    run_device();
+    for (int ms = 0; ms < 500; ms += USB_PROTO_POLL_MS) {
+        sim_advance_us(USB_PROTO_POLL_MS * 1000);
+        usb_proto_poll();
+    }
+    CHECK(from_device.empty());
+
+    // A frame only goes out if all of it fits.
+    tx_room = 8;
+    send_request(OP_ECHO, { 0x01, 0x02, 0x03, 0x04, 0x05 });
+    run_device();
+    CHECK(from_device.empty());
+
+    // Once the host reads again, telemetry picks up where it left off,
+    // with no gap in the sequence numbers.
+    tx_room = CFG_TUD_CDC_TX_BUFSIZE;
+    for (int ms = 0; ms < 500; ms += USB_PROTO_POLL_MS) {
+        sim_advance_us(USB_PROTO_POLL_MS * 1000);
+        usb_proto_poll();
+    }
+    std::vector<frame_t> frames = received();
+    CHECK(frames.size() >= 4);
+    for (size_t i = 0; i < frames.size(); ++i) {
+        CHECK(frames[i].op == USB_PROTO_OP_TELEMETRY);
+        CHECK((i == 0) || (frames[i].seq == (uint8_t)(frames[i - 1].seq + 1)));
+    }
+
+    usb_proto_put_u16(period.data(), 0);
+    request(USB_PROTO_OP_SUBSCRIBE_TELEMETRY, period);
+}
+
+
+int main(int argc, char * argv[]) {
+    husb238_model_config_t model_config;
+    husb238_model_default_config(&model_config);
+
+    sim_reset_time();
+    i2c_init(i2c, 100 * 1000);
+    husb238_model_init(&model_config);
+
+    usb_proto_init(i2c, &i2c_comm_errors);
+    CHECK(usb_proto_add_handler(OP_ECHO, handle_echo));
+    usb_proto_set_key_handler(key_handler);
+
+    test_echo();
+    test_pdos_and_select();
+    test_bad_frames();
+    test_keys();
+    test_boot_times_and_telemetry();
+    test_host_not_reading();
+
+    CHECK(i2c_comm_errors == 0);
+
+    if (failures > 0) {
+        printf("usb-proto-loopback: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("usb-proto-loopback: ok\n");
+    return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef __SHIM_HARDWARE_GPIO_H__
+#define __SHIM_HARDWARE_GPIO_H__
+
+#include "pico.h"
+
+// There's nothing on the other end of these.
+
+enum gpio_function {
+    GPIO_FUNC_I2C = 3,
+};
+
+static inline void gpio_set_function(uint gpio, enum gpio_function fn) {}
+static inline void gpio_pull_up(uint gpio) {}
+static inline void gpio_disable_pulls(uint gpio) {}
+
+
+#endif // __SHIM_HARDWARE_GPIO_H__
@@ -0,0 +1,37 @@
+#ifndef __SHIM_HARDWARE_I2C_H__
+#define __SHIM_HARDWARE_I2C_H__
+
+#include "pico.h"
+#include "pico/time.h"
+
+// The SDK's blocking i2c API, talking to the HUSB238 model (see
+// husb238_model.h) instead of a controller.
+
+typedef struct i2c_inst {
+    uint baudrate;
+} i2c_inst_t;
+
+extern i2c_inst_t i2c0_inst;
+extern i2c_inst_t i2c1_inst;
+
+#define i2c0 (&i2c0_inst)
+#define i2c1 (&i2c1_inst)
+
+uint i2c_init(i2c_inst_t * i2c, uint baudrate);
+
+int i2c_write_blocking(i2c_inst_t * i2c, uint8_t addr, uint8_t const * src, size_t len, bool nostop);
+int i2c_read_blocking(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop);
+
+int i2c_write_blocking_until(i2c_inst_t * i2c, uint8_t addr, uint8_t const * src, size_t len, bool nostop, absolute_time_t until);
+int i2c_read_blocking_until(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop, absolute_time_t until);
+
+static inline int i2c_write_timeout_us(i2c_inst_t * i2c, uint8_t addr, uint8_t const * src, size_t len, bool nostop, uint timeout_us) {
+    return i2c_write_blocking_until(i2c, addr, src, len, nostop, make_timeout_time_us(timeout_us));
+}
+
+static inline int i2c_read_timeout_us(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop, uint timeout_us) {
+    return i2c_read_blocking_until(i2c, addr, dst, len, nostop, make_timeout_time_us(timeout_us));
+}
+
+
+#endif // __SHIM_HARDWARE_I2C_H__
@@ -0,0 +1,28 @@
+#ifndef __SHIM_PICO_H__
+#define __SHIM_PICO_H__
+
+//
+// Just enough of the Pico SDK for the HUSB238 driver, firmware/pd.cpp
+// and firmware/usb_proto.cpp to build on the host, see sim_pico.h.
+//
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+enum pico_error_codes {
+    PICO_OK = 0,
+    PICO_ERROR_NONE = 0,
+    PICO_ERROR_TIMEOUT = -1,
+    PICO_ERROR_GENERIC = -2,
+    PICO_ERROR_NO_DATA = -3,
+};
+
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+
+static inline void tight_loop_contents(void) {}
+
+
+#endif // __SHIM_PICO_H__
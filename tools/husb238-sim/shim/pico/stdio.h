@@ -0,0 +1,14 @@
+#ifndef __SHIM_PICO_STDIO_H__
+#define __SHIM_PICO_STDIO_H__
+
+#include "pico.h"
+
+// The USB serial port.  Whatever runs on the host provides the other
+// end, see loopback.cpp.
+
+int getchar_timeout_us(uint32_t timeout_us);
+int putchar_raw(int c);
+void stdio_set_chars_available_callback(void (*fn)(void *), void * param);
+
+
+#endif // __SHIM_PICO_STDIO_H__
@@ -0,0 +1,10 @@
+#ifndef __SHIM_PICO_STDLIB_H__
+#define __SHIM_PICO_STDLIB_H__
+
+#include "pico.h"
+#include "pico/stdio.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+
+
+#endif // __SHIM_PICO_STDLIB_H__
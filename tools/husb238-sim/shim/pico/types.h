@@ -0,0 +1,8 @@
+#ifndef __SHIM_PICO_TYPES_H__
+#define __SHIM_PICO_TYPES_H__
+
+#include "pico.h"
+#include "pico/time.h"
+
+
+#endif // __SHIM_PICO_TYPES_H__
@@ -0,0 +1,15 @@
+#ifndef __SHIM_TUSB_H__
+#define __SHIM_TUSB_H__
+
+#include "pico.h"
+
+// The CDC side of TinyUSB, for checking there's room to write without
+// blocking.  loopback.cpp decides how much there is.
+
+#define CFG_TUD_CDC_TX_BUFSIZE 256
+
+bool tud_cdc_connected(void);
+uint32_t tud_cdc_write_available(void);
+
+
+#endif // __SHIM_TUSB_H__
@@ -0,0 +1,92 @@
+#include "pico/time.h"
+
+#include "sim_pico.h"
+
+
+static uint64_t now_us;
+
+
+void sim_reset_time(void) {
+    now_us = 0;
+}
+
+
+uint64_t sim_now_us(void) {
+    return now_us;
+}
+
+
+void sim_advance_us(uint64_t us) {
+    now_us += us;
+}
+
+
+//
+// The SDK's time functions.
+//
+
+uint64_t time_us_64(void) {
+    return ++now_us;
+}
+
+uint32_t time_us_32(void) {
+    return (uint32_t)time_us_64();
+}
+
+absolute_time_t get_absolute_time(void) {
+    return time_us_64();
+}
+
+uint64_t to_us_since_boot(absolute_time_t t) {
+    return t;
+}
+
+uint32_t to_ms_since_boot(absolute_time_t t) {
+    return t / 1000;
+}
+
+absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us) {
+    return t + us;
+}
+
+absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms) {
+    return t + (ms * 1000ull);
+}
+
+absolute_time_t make_timeout_time_us(uint64_t us) {
+    return get_absolute_time() + us;
+}
+
+absolute_time_t make_timeout_time_ms(uint32_t ms) {
+    return get_absolute_time() + (ms * 1000ull);
+}
+
+int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+    return (int64_t)(to - from);
+}
+
+bool time_reached(absolute_time_t t) {
+    return time_us_64() >= t;
+}
+
+void sleep_us(uint64_t us) {
+    now_us += us;
+}
+
+void sleep_ms(uint32_t ms) {
+    now_us += ms * 1000ull;
+}
+
+void sleep_until(absolute_time_t t) {
+    if (t > now_us) {
+        now_us = t;
+    }
+}
+
+void busy_wait_us(uint64_t us) {
+    sleep_us(us);
+}
+
+void busy_wait_ms(uint32_t ms) {
+    sleep_ms(ms);
+}
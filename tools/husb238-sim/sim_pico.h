@@ -0,0 +1,23 @@
+#ifndef __SIM_PICO_H__
+#define __SIM_PICO_H__
+
+#include <stdint.h>
+
+//
+// Simulated time for the host build.
+//
+// Nothing takes real time: the clock only moves when something sleeps,
+// when an i2c transaction goes over the (simulated) bus, or by a
+// microsecond every time code reads it, so busy-wait loops end too.
+// That makes runs fast and repeatable, and the times they report are
+// what the RP2040 would see.
+//
+
+void sim_reset_time(void);
+
+uint64_t sim_now_us(void);
+
+void sim_advance_us(uint64_t us);
+
+
+#endif // __SIM_PICO_H__
@@ -0,0 +1,323 @@
+//
+// Stress benchmark for the HUSB238 driver (and firmware/pd.cpp) against
+// the behavioral model, see husb238_model.h.
+//
+// Each run first measures throughput: back-to-back contract reads for
+// one simulated second.  Then it runs a session shaped like the
+// firmware's main loop: a UI tick every --frame-ms that reads the
+// contract, a check for the source attaching every 250 ms that selects
+// the wanted PDO when it does (like the firmware's source restore),
+// and the wanted PDO changing to the next one the source offers every
+// --select-s, like someone turning the knob.  It reports:
+//
+// - throughput: driver calls per second and how many of them worked.
+// - error recovery: how long from a call failing until one works again,
+//   and how long from the chip resetting until the contract is back at
+//   the wanted voltage (or whether it never came back).
+// - UI stalls: how long each tick spent in the driver, and how many
+//   ticks blew the frame budget, i.e. stalls you'd see on the display.
+//
+// `--nack-rate` takes a comma-separated list, for a sweep.
+//
+// Usage: husb238-stress [--seconds 60] [--seed 1] [--nack-rate 0,0.001,0.01]
+//            [--stuck-per-min 0] [--stuck-ms 50] [--resets-per-min 0]
+//            [--boot-ms 30] [--request-ms 40,250] [--frame-ms 20]
+//            [--select-s 5] [--baud 100000] [--pdos 3000,3000,0,3000,0,3000]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "pico/stdlib.h"
+#include "hardware/i2c.h"
+
+#include "husb238.h"
+#include "husb238_model.h"
+#include "pd.h"
+#include "sim_pico.h"
+
+
+#define ATTACH_POLL_US (250 * 1000)
+#define THROUGHPUT_US (1000 * 1000)
+
+typedef struct {
+    double seconds;
+    uint32_t frame_us;
+    uint32_t select_us;
+    uint baudrate;
+} session_config_t;
+
+static i2c_inst_t * const i2c = i2c0;
+
+// Failed driver calls, and how long it took until one worked again.
+static bool in_error;
+static uint64_t error_since_us;
+static uint32_t failed_calls;
+static std::vector<uint64_t> error_recovery_us;
+
+
+static void call_result(uint64_t started_us, bool ok) {
+    if (!ok) {
+        ++failed_calls;
+        if (!in_error) {
+            in_error = true;
+            error_since_us = started_us;
+        }
+    } else if (in_error) {
+        in_error = false;
+        error_recovery_us.push_back(sim_now_us() - error_since_us);
+    }
+}
+
+
+static int read_contract(int * millivolts) {
+    int milliamps;
+    uint64_t started_us = sim_now_us();
+    int r = pd_get_contract(i2c, millivolts, &milliamps);
+    call_result(started_us, r == PICO_OK);
+    return r;
+}
+
+
+static bool connected(void) {
+    uint64_t started_us = sim_now_us();
+    bool attached = husb238_connected(i2c);
+    call_result(started_us, attached);
+    return attached;
+}
+
+
+static void select_pdo(int id) {
+    uint64_t started_us = sim_now_us();
+    int r = husb238_select_pdo(i2c, id);
+    call_result(started_us, r == PICO_OK);
+}
+
+
+static double ms(uint64_t us) {
+    return us / 1000.0;
+}
+
+
+// "min/p50/p99/max ms" of `samples`, which get sorted.
+static void print_distribution(char const * what, std::vector<uint64_t> & samples) {
+    if (samples.empty()) {
+        printf("    %-26s -\n", what);
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    printf(
+        "    %-26s %8.2f %8.2f %8.2f %8.2f  (%zu)\n",
+        what, ms(samples[0]), ms(samples[n / 2]), ms(samples[(n * 99) / 100]), ms(samples[n - 1]), n
+    );
+}
+
+
+static void run(husb238_model_config_t const * model_config, session_config_t const * s) {
+    husb238_model_stats_t stats;
+
+    sim_reset_time();
+    i2c_init(i2c, s->baudrate);
+    husb238_model_init(model_config);
+
+    in_error = false;
+    failed_calls = 0;
+    error_recovery_us.clear();
+
+    // Throughput.
+    uint32_t reads = 0, good_reads = 0;
+    while (sim_now_us() < THROUGHPUT_US) {
+        int millivolts;
+        ++reads;
+        if (read_contract(&millivolts) == PICO_OK) {
+            ++good_reads;
+        }
+    }
+
+    // The session.
+    int offered[PD_NUM_PDOS];
+    int num_offered = 0;
+    for (int i = 0; i < PD_NUM_PDOS; ++i) {
+        if (model_config->pdo_milliamps[i] > 0) {
+            offered[num_offered++] = i;
+        }
+    }
+    static int const pdo_ids[PD_NUM_PDOS] = { 0x1, 0x2, 0x3, 0x8, 0x9, 0xa };
+    static int const pdo_millivolts[PD_NUM_PDOS] = { 5000, 9000, 12000, 15000, 18000, 20000 };
+    int wanted = num_offered - 1;
+
+    uint64_t start_us = sim_now_us();
+    uint64_t end_us = start_us + (uint64_t)(s->seconds * 1e6);
+    uint64_t next_attach_poll_us = start_us;
+    uint64_t next_select_us = start_us + s->select_us;
+    bool attached = false;
+
+    uint64_t seen_reset_us = UINT64_MAX;
+    bool restoring = false;
+    uint32_t lost_contracts = 0;
+    std::vector<uint64_t> contract_recovery_us;
+
+    std::vector<uint64_t> tick_us;
+    uint32_t slow_ticks = 0;
+
+    select_pdo(pdo_ids[offered[wanted]]);
+
+    while (sim_now_us() < end_us) {
+        uint64_t tick_start_us = sim_now_us();
+        int millivolts;
+
+        read_contract(&millivolts);
+
+        if (tick_start_us >= next_attach_poll_us) {
+            next_attach_poll_us = tick_start_us + ATTACH_POLL_US;
+            bool now_attached = connected();
+            if (now_attached && !attached) {
+                select_pdo(pdo_ids[offered[wanted]]);
+            }
+            attached = now_attached;
+        }
+
+        if (tick_start_us >= next_select_us) {
+            next_select_us = tick_start_us + s->select_us;
+            wanted = (wanted + 1) % num_offered;
+            select_pdo(pdo_ids[offered[wanted]]);
+        }
+
+        uint64_t stall_us = sim_now_us() - tick_start_us;
+        tick_us.push_back(stall_us);
+        if (stall_us > s->frame_us) {
+            ++slow_ticks;
+        }
+
+        // Did the chip reset, and is the contract back where we want it?
+        uint64_t reset_us = husb238_model_last_reset_us();
+        if (reset_us != seen_reset_us) {
+            if (restoring) {
+                ++lost_contracts;
+            }
+            seen_reset_us = reset_us;
+            restoring = true;
+        }
+        if (restoring && (husb238_model_contract_millivolts() == pdo_millivolts[offered[wanted]])) {
+            contract_recovery_us.push_back(sim_now_us() - reset_us);
+            restoring = false;
+        }
+
+        sleep_until(tick_start_us + s->frame_us);
+    }
+    if (restoring) {
+        ++lost_contracts;
+    }
+
+    husb238_model_get_stats(&stats);
+
+    printf(
+        "nack rate %.4f, stuck bus %.1f/min x %.0f ms, resets %.1f/min, %.0f s\n",
+        model_config->nack_rate, model_config->stuck_per_s * 60.0, ms(model_config->stuck_us),
+        model_config->reset_per_s * 60.0, s->seconds
+    );
+    printf(
+        "  throughput: %u contract reads/s, %.2f%% ok\n",
+        reads, reads ? (100.0 * good_reads) / reads : 0.0
+    );
+    printf(
+        "  bus: %u transactions, %u nacks, %u stuck (%.1f ms waiting), %u resets, %u requests, %u contracts\n",
+        stats.transactions, stats.nacks, stats.stuck, ms(stats.stuck_wait_us),
+        stats.resets, stats.requests, stats.contracts
+    );
+    printf("  %u failed driver calls\n", failed_calls);
+    printf("    %-26s %8s %8s %8s %8s\n", "ms", "min", "p50", "p99", "max");
+    print_distribution("error recovery", error_recovery_us);
+    print_distribution("contract back after reset", contract_recovery_us);
+    print_distribution("driver time per UI tick", tick_us);
+    printf(
+        "  %u of %zu UI ticks over the %.0f ms frame budget, %u resets lost the contract\n\n",
+        slow_ticks, tick_us.size(), ms(s->frame_us), lost_contracts
+    );
+}
+
+
+static void usage(char const * argv0) {
+    fprintf(stderr, "usage: %s [--seconds S] [--seed N] [--nack-rate R[,R...]] [--stuck-per-min N]\n", argv0);
+    fprintf(stderr, "    [--stuck-ms MS] [--resets-per-min N] [--boot-ms MS] [--request-ms MIN,MAX]\n");
+    fprintf(stderr, "    [--frame-ms MS] [--select-s S] [--baud HZ] [--pdos MA,MA,MA,MA,MA,MA]\n");
+    exit(1);
+}
+
+
+int main(int argc, char * argv[]) {
+    husb238_model_config_t model_config;
+    husb238_model_default_config(&model_config);
+
+    session_config_t s = {
+        .seconds = 60.0,
+        .frame_us = 20 * 1000,
+        .select_us = 5 * 1000 * 1000,
+        .baudrate = 100 * 1000,
+    };
+
+    std::vector<double> nack_rates = { 0.0 };
+
+    for (int i = 1; i < argc; ++i) {
+        char const * opt = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+        char * arg = argv[++i];
+
+        if (strcmp(opt, "--seconds") == 0) {
+            s.seconds = atof(arg);
+        } else if (strcmp(opt, "--seed") == 0) {
+            model_config.seed = strtoul(arg, nullptr, 0);
+        } else if (strcmp(opt, "--nack-rate") == 0) {
+            nack_rates.clear();
+            for (char * r = strtok(arg, ","); r != nullptr; r = strtok(nullptr, ",")) {
+                nack_rates.push_back(atof(r));
+            }
+        } else if (strcmp(opt, "--stuck-per-min") == 0) {
+            model_config.stuck_per_s = atof(arg) / 60.0;
+        } else if (strcmp(opt, "--stuck-ms") == 0) {
+            model_config.stuck_us = atof(arg) * 1000;
+        } else if (strcmp(opt, "--resets-per-min") == 0) {
+            model_config.reset_per_s = atof(arg) / 60.0;
+        } else if (strcmp(opt, "--boot-ms") == 0) {
+            model_config.boot_us = atof(arg) * 1000;
+        } else if (strcmp(opt, "--request-ms") == 0) {
+            double min_ms, max_ms;
+            if ((sscanf(arg, "%lf,%lf", &min_ms, &max_ms) != 2) || (min_ms > max_ms)) {
+                usage(argv[0]);
+            }
+            model_config.request_min_us = min_ms * 1000;
+            model_config.request_max_us = max_ms * 1000;
+        } else if (strcmp(opt, "--frame-ms") == 0) {
+            s.frame_us = atof(arg) * 1000;
+        } else if (strcmp(opt, "--select-s") == 0) {
+            s.select_us = atof(arg) * 1e6;
+        } else if (strcmp(opt, "--baud") == 0) {
+            s.baudrate = strtoul(arg, nullptr, 0);
+        } else if (strcmp(opt, "--pdos") == 0) {
+            int * ma = model_config.pdo_milliamps;
+            if (sscanf(arg, "%d,%d,%d,%d,%d,%d", &ma[0], &ma[1], &ma[2], &ma[3], &ma[4], &ma[5]) != 6) {
+                usage(argv[0]);
+            }
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if ((s.frame_us == 0) || (s.select_us == 0) || (s.baudrate == 0) || (model_config.pdo_milliamps[0] == 0)) {
+        usage(argv[0]);
+    }
+
+    for (double nack_rate : nack_rates) {
+        model_config.nack_rate = nack_rate;
+        run(&model_config, &s);
+    }
+
+    return 0;
+}
@@ -0,0 +1,643 @@
+#!/usr/bin/env python3
+
+#
+# Host-side client for the pd-sink-box binary USB serial protocol.
+# See firmware/usb_proto.h for the frame format and the list of ops.
+#
+# Use it as a library:
+#
+#     import pd_sink_box
+#     box = pd_sink_box.PdSinkBox("/dev/ttyACM0")
+#     print(box.get_contract())
+#
+# Or from the command line:
+#
+#     ./pd_sink_box.py /dev/ttyACM0 pdos
+#     ./pd_sink_box.py /dev/ttyACM0 select 2
+#     ./pd_sink_box.py /dev/ttyACM0 telemetry 100
+#     ./pd_sink_box.py /dev/ttyACM0 boot
+#     ./pd_sink_box.py /dev/ttyACM0 xip 10
+#     ./pd_sink_box.py /dev/ttyACM0 mem
+#     ./pd_sink_box.py /dev/ttyACM0 record spin.json
+#     ./pd_sink_box.py /dev/ttyACM0 replay spin.json --fast
+#
+# Requires pyserial.
+#
+
+import argparse
+import json
+import struct
+import sys
+import time
+
+import serial
+
+
+OP_GET_PDOS = 0x01
+OP_GET_CONTRACT = 0x02
+OP_SELECT_PDO = 0x03
+OP_GET_ERRORS = 0x04
+OP_RESET_ERRORS = 0x05
+OP_SUBSCRIBE_TELEMETRY = 0x06
+OP_GET_BOOT_TIMES = 0x09
+OP_GET_XIP_STATS = 0x0A
+OP_GET_MEM_STATS = 0x0B
+OP_REPLAY_CONTROL = 0x0C
+OP_REPLAY_STATUS = 0x0D
+OP_REPLAY_READ = 0x0E
+OP_REPLAY_WRITE = 0x0F
+OP_GET_TASK_STATS = 0x10
+OP_PD_BENCH_START = 0x11
+OP_PD_BENCH_RESULTS = 0x12
+OP_EVLOG_READ = 0x13
+OP_PD_SEQ_WRITE = 0x14
+OP_PD_SEQ_CONTROL = 0x15
+OP_PD_SEQ_STATUS = 0x16
+OP_TEXT_BENCH = 0x17
+OP_TELEMETRY = 0x40
+OP_RESPONSE = 0x80
+OP_ERROR = 0xFF
+
+# Must match boot_phase_t in firmware/boot.h.
+BOOT_PHASES = [
+    "main",
+    "stdio",
+    "settings",
+    "display",
+    "first-frame",
+    "i2c",
+    "husb238",
+    "hmi",
+    "first-contract",
+    "warm-restore",
+]
+
+
+# Must match evlog_event_t and the page layout in firmware/evlog.h.
+EVLOG_MAGIC = 0x4C45
+EVLOG_EMPTY = 0xFF
+EVLOG_EVENTS = {
+    1: "boot",
+    2: "attach",
+    3: "detach",
+    4: "contract",
+    5: "select",
+    6: "restore",
+    7: "i2c-errors",
+    8: "sequence",
+    9: "brownout",
+    10: "overtemp",
+}
+
+# Must match pd_bench_state_t in firmware/pd_bench.h.
+PD_BENCH_RUNNING = 1
+PD_BENCH_ABORTED = 3
+
+# Must match pd_seq_state_t and pd_seq_result_t in firmware/pd_seq.h.
+PD_SEQ_RUNNING = 1
+PD_SEQ_RESULTS = ["verifying", "ok", "rejected", "timeout", "superseded", "i2c-error"]
+
+# Must match replay_state_t in firmware/replay.h.
+REPLAY_IDLE = 0
+REPLAY_RECORDING = 1
+REPLAY_REPLAYING = 2
+REPLAY_REPLAYING_FAST = 3
+
+# Must match hmi_event_t in firmware/hmi.h.
+HMI_EVENTS = ["cw", "ccw", "click"]
+
+
+class ProtocolError(Exception):
+    pass
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xFFFF
+            else:
+                crc = (crc << 1) & 0xFFFF
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_index = 0
+    code = 1
+    for b in data:
+        if b == 0:
+            out[code_index] = code
+            code = 1
+            code_index = len(out)
+            out.append(0)
+        else:
+            out.append(b)
+            code += 1
+            if code == 0xFF:
+                out[code_index] = code
+                code = 1
+                code_index = len(out)
+                out.append(0)
+    out[code_index] = code
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(data):
+            raise ProtocolError("bad COBS data")
+        out += data[i:i + code - 1]
+        i += code - 1
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def encode_frame(op, seq, payload=b""):
+    body = bytes([op, seq]) + payload
+    return cobs_encode(body + struct.pack("<H", crc16(body))) + b"\x00"
+
+
+def decode_frame(encoded):
+    """Returns (op, seq, payload), or None if `encoded` is not a valid frame."""
+    try:
+        frame = cobs_decode(encoded)
+    except ProtocolError:
+        return None
+    if len(frame) < 4:
+        return None
+    (crc,) = struct.unpack("<H", frame[-2:])
+    if crc != crc16(frame[:-2]):
+        return None
+    return (frame[0], frame[1], frame[2:-2])
+
+
+class PdSinkBox:
+    def __init__(self, port, timeout=1.0):
+        if isinstance(port, str):
+            port = serial.Serial(port, timeout=0.05)
+        self.port = port
+        self.timeout = timeout
+        self.seq = 0
+        self.rx = bytearray()
+        self.telemetry = []
+
+    def close(self):
+        self.port.close()
+
+    def read_frame(self, timeout=None):
+        """Returns the next valid frame as (op, seq, payload), or None on timeout.
+        Anything on the wire that's not a valid frame is silently dropped."""
+        deadline = time.monotonic() + (self.timeout if timeout is None else timeout)
+        while True:
+            end = self.rx.find(b"\x00")
+            if end >= 0:
+                encoded = bytes(self.rx[:end])
+                del self.rx[:end + 1]
+                frame = decode_frame(encoded)
+                if frame is not None:
+                    return frame
+                continue
+            if time.monotonic() > deadline:
+                return None
+            self.rx += self.port.read(max(1, self.port.in_waiting))
+
+    def request(self, op, payload=b""):
+        self.seq = (self.seq + 1) & 0xFF
+        # The leading zero flushes any partial frame the device may
+        # have been collecting.
+        self.port.write(b"\x00" + encode_frame(op, self.seq, payload))
+        while True:
+            frame = self.read_frame()
+            if frame is None:
+                raise ProtocolError("timeout waiting for reply to op 0x%02x" % op)
+            (reply_op, reply_seq, reply_payload) = frame
+            if reply_op == OP_TELEMETRY:
+                self.telemetry.append(parse_telemetry(reply_payload))
+                continue
+            if reply_seq != self.seq:
+                continue
+            if reply_op == OP_ERROR:
+                raise ProtocolError("device error %d for op 0x%02x" % (reply_payload[1], reply_payload[0]))
+            if reply_op != (op | OP_RESPONSE):
+                raise ProtocolError("unexpected reply op 0x%02x" % reply_op)
+            return reply_payload
+
+    def get_pdos(self):
+        """Returns a list of (id, millivolts, milliamps)."""
+        payload = self.request(OP_GET_PDOS)
+        return [struct.unpack_from("<BHH", payload, i * 5) for i in range(6)]
+
+    def get_contract(self):
+        """Returns (attached, millivolts, milliamps, current pdo id)."""
+        (attached, mv, ma, pdo) = struct.unpack("<BHHB", self.request(OP_GET_CONTRACT))
+        return (bool(attached), mv, ma, pdo)
+
+    def select_pdo(self, pdo_id):
+        (status,) = struct.unpack("<b", self.request(OP_SELECT_PDO, bytes([pdo_id])))
+        return status
+
+    def get_errors(self):
+        """Returns (i2c errors, crc errors, framing errors)."""
+        return struct.unpack("<III", self.request(OP_GET_ERRORS))
+
+    def reset_errors(self):
+        self.request(OP_RESET_ERRORS)
+
+    def subscribe_telemetry(self, period_ms):
+        """Ask for telemetry every `period_ms` milliseconds, 0 to stop."""
+        self.request(OP_SUBSCRIBE_TELEMETRY, struct.pack("<H", period_ms))
+
+    def get_boot_times(self):
+        """Returns a list of (phase name, microseconds since boot), 0 if not reached."""
+        payload = self.request(OP_GET_BOOT_TIMES)
+        times = struct.unpack("<%dI" % (len(payload) // 4), payload)
+        return [(BOOT_PHASES[i] if i < len(BOOT_PHASES) else "phase-%d" % i, us) for (i, us) in enumerate(times)]
+
+    def get_xip_stats(self, reset=False):
+        """Returns (xip cache hits, xip cache accesses, frames drawn, hot code in ram)."""
+        (hits, accesses, frames, hot_in_ram) = struct.unpack(
+            "<IIIB", self.request(OP_GET_XIP_STATS, bytes([1 if reset else 0]))
+        )
+        return (hits, accesses, frames, bool(hot_in_ram))
+
+    def get_mem_stats(self):
+        """Returns a dict of RAM usage in bytes, see firmware/memstats.h."""
+        names = [
+            "static",
+            "heap_size",
+            "heap_high_water",
+            "heap_in_use",
+            "stack0_size",
+            "stack0_high_water",
+            "stack1_size",
+            "stack1_high_water",
+        ]
+        return dict(zip(names, struct.unpack("<8I", self.request(OP_GET_MEM_STATS))))
+
+    def get_task_stats(self):
+        """Returns a list of dicts, one per scheduler task, see firmware/sched.h."""
+        names = ["period_us", "runs", "total_us", "max_us", "max_late_us", "skipped"]
+        tasks = []
+        num_tasks = 1
+        while len(tasks) < num_tasks:
+            payload = self.request(OP_GET_TASK_STATS, bytes([len(tasks)]))
+            num_tasks = payload[0]
+            if len(payload) < 25:
+                break
+            task = dict(zip(names, struct.unpack("<6I", payload[1:25])))
+            task["name"] = payload[25:].decode("ascii", "replace")
+            tasks.append(task)
+        return tasks
+
+    def pd_bench_start(self, repeats):
+        (status,) = struct.unpack("<b", self.request(OP_PD_BENCH_START, bytes([repeats])))
+        return status
+
+    def pd_bench_results(self):
+        """Returns (state, source fingerprint, run, repeats, results), with
+        a dict per PDO, see firmware/pd_bench.h."""
+        names = ["id", "mv", "samples", "min_us", "avg_us", "max_us", "rejects", "resets", "timeouts", "i2c_errors"]
+        payload = self.request(OP_PD_BENCH_RESULTS)
+        (state, fingerprint, run, repeats, n) = struct.unpack_from("<BIBBB", payload)
+        results = [
+            dict(zip(names, struct.unpack_from("<BHBIIIBBBB", payload, 8 + (i * 20))))
+            for i in range(n)
+        ]
+        return (state, fingerprint, run, repeats, results)
+
+    def pd_seq_write(self, steps, repeats):
+        """Replaces the sequencer's script with `steps`, a list of
+        (millivolts, hold ms), run `repeats` times (0: forever)."""
+        payload = struct.pack("<H", repeats) + b"".join(struct.pack("<HI", mv, ms) for (mv, ms) in steps)
+        (status,) = struct.unpack("<b", self.request(OP_PD_SEQ_WRITE, payload))
+        return status
+
+    def pd_seq_control(self, run):
+        (status,) = struct.unpack("<b", self.request(OP_PD_SEQ_CONTROL, bytes([1 if run else 0])))
+        return status
+
+    def pd_seq_status(self, first=0):
+        """Returns (status, transitions): a dict with the sequencer's
+        state, run, repeats, steps, total transitions and jitter
+        stats, and a dict for each logged transition from number
+        `first` on, see firmware/pd_seq.h."""
+        names = ["state", "run", "repeats", "steps", "transitions", "jitter_min_us", "jitter_max_us",
+                 "jitter_mean_us", "first", "n"]
+        payload = self.request(OP_PD_SEQ_STATUS, struct.pack("<I", first))
+        status = dict(zip(names, struct.unpack_from("<BHHBIiiiIB", payload)))
+        entry_names = ["run", "step", "mv", "jitter_us", "contract_us", "result"]
+        transitions = [
+            dict(zip(entry_names, struct.unpack_from("<HBHiIB", payload, 27 + (i * 14))))
+            for i in range(status["n"])
+        ]
+        return (status, transitions)
+
+    def text_bench(self, passes):
+        """Returns (system clock kHz, results), with a (scale, bitmap us,
+        runs us) per scale, see firmware/text_runs.h."""
+        payload = self.request(OP_TEXT_BENCH, bytes([passes]))
+        (khz, n) = struct.unpack_from("<IB", payload)
+        return (khz, [struct.unpack_from("<BII", payload, 5 + (i * 9)) for i in range(n)])
+
+    def evlog_read(self):
+        """Returns (events, dropped), with events a list of
+        (boot number, ms since that boot, event name, a, b), oldest
+        first.  See firmware/evlog.h."""
+        events = []
+        dropped = 0
+        index = 0
+        num_pages = 1
+        while index < num_pages:
+            page = b""
+            for half in (0, 1):
+                payload = self.request(OP_EVLOG_READ, struct.pack("<HB", index, half))
+                (num_pages, dropped) = struct.unpack_from("<HI", payload)
+                page += payload[6:]
+            index += 1
+            if len(page) < 256:
+                break
+            (magic, boot, _) = struct.unpack_from("<HHI", page)
+            if magic != EVLOG_MAGIC:
+                continue
+            for offset in range(8, 256, 8):
+                (ms, event, a, b) = struct.unpack_from("<IBBH", page, offset)
+                if event != EVLOG_EMPTY:
+                    events.append((boot, ms, EVLOG_EVENTS.get(event, "event-%d" % event), a, b))
+        return (events, dropped)
+
+    def replay_control(self, state):
+        self.request(OP_REPLAY_CONTROL, bytes([state]))
+
+    def replay_status(self):
+        """Returns (state, recorded events, replayed events, timed draws)."""
+        return struct.unpack("<BHHH", self.request(OP_REPLAY_STATUS))
+
+    def _replay_read(self, what, entry_format):
+        entries = []
+        while True:
+            payload = self.request(OP_REPLAY_READ, struct.pack("<BH", what, len(entries)))
+            (total, offset) = struct.unpack_from("<HH", payload)
+            size = struct.calcsize(entry_format)
+            for i in range(4, len(payload), size):
+                entries.append(struct.unpack_from(entry_format, payload, i))
+            if len(entries) >= total or len(payload) == 4:
+                return entries
+
+    def replay_get_events(self):
+        """Returns the recording as a list of (time us, event name)."""
+        return [(t, HMI_EVENTS[e]) for (t, e) in self._replay_read(0, "<IB")]
+
+    def replay_get_draw_times(self):
+        """Returns the draw times of the last replay, in microseconds."""
+        return [us for (us,) in self._replay_read(1, "<I")]
+
+    def replay_set_events(self, events):
+        """Uploads a recording, a list of (time us, event name)."""
+        wire = [struct.pack("<IB", t, HMI_EVENTS.index(e)) for (t, e) in events]
+        chunk = (250 - 2) // 5
+        for offset in range(0, max(1, len(wire)), chunk):
+            self.request(OP_REPLAY_WRITE, struct.pack("<H", offset) + b"".join(wire[offset:offset + chunk]))
+
+    def read_telemetry(self, timeout=None):
+        """Returns the next telemetry sample as (ms, millivolts, milliamps, i2c errors), or None."""
+        if self.telemetry:
+            return self.telemetry.pop(0)
+        while True:
+            frame = self.read_frame(timeout)
+            if frame is None:
+                return None
+            if frame[0] == OP_TELEMETRY:
+                return parse_telemetry(frame[2])
+
+
+def parse_telemetry(payload):
+    return struct.unpack("<IHHI", payload)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Talk to a pd-sink-box over USB serial.")
+    parser.add_argument("port", help="serial port, e.g. /dev/ttyACM0")
+    sub = parser.add_subparsers(dest="command", required=True)
+    sub.add_parser("pdos", help="list the PDOs offered by the source")
+    sub.add_parser("contract", help="show the current contract")
+    p = sub.add_parser("select", help="select a PDO")
+    p.add_argument("pdo_id", type=int)
+    sub.add_parser("errors", help="show error counters")
+    sub.add_parser("reset-errors", help="reset error counters")
+    p = sub.add_parser("telemetry", help="stream telemetry")
+    p.add_argument("period_ms", type=int)
+    sub.add_parser("boot", help="show boot phase timing")
+    sub.add_parser("mem", help="show RAM usage and high-water marks")
+    sub.add_parser("tasks", help="show scheduler task statistics")
+    p = sub.add_parser("bench", help="measure how fast the source switches between its PDOs")
+    p.add_argument("--repeats", type=int, default=5)
+    sub.add_parser("events", help="show the event log from the flash")
+    p = sub.add_parser("textbench", help="time big text drawn as bitmaps and as rectangles")
+    p.add_argument("--passes", type=int, default=20)
+    p = sub.add_parser("sequence", help="run a scripted PDO sequence and follow its transitions")
+    p.add_argument("script", nargs="?", help="volts:seconds steps, e.g. 5:2,20:10,9:2 (default: the stored script)")
+    p.add_argument("--repeats", type=int, default=1, help="times to run the script, 0 for until stopped")
+    p.add_argument("--no-start", action="store_true", help="only store the script")
+    p.add_argument("--stop", action="store_true", help="stop a running sequence")
+    p = sub.add_parser("record", help="record knob input into a file, until you hit Enter")
+    p.add_argument("file")
+    p = sub.add_parser("replay", help="replay recorded knob input and time the draws")
+    p.add_argument("file")
+    p.add_argument("--fast", action="store_true", help="replay as fast as possible instead of at the original speed")
+    p.add_argument("--save", metavar="FILE", help="save the draw times as JSON, for comparing builds")
+    p = sub.add_parser("xip", help="measure the XIP cache hit rate")
+    p.add_argument("seconds", type=float, nargs="?", default=5.0)
+    args = parser.parse_args()
+
+    box = PdSinkBox(args.port)
+
+    if args.command == "pdos":
+        for (pdo_id, mv, ma) in box.get_pdos():
+            if ma > 0:
+                print("pdo %d: %.2fV %.2fA" % (pdo_id, mv / 1000, ma / 1000))
+    elif args.command == "contract":
+        (attached, mv, ma, pdo_id) = box.get_contract()
+        if attached:
+            print("pdo %d: %.2fV %.2fA" % (pdo_id, mv / 1000, ma / 1000))
+        else:
+            print("not attached")
+    elif args.command == "select":
+        status = box.select_pdo(args.pdo_id)
+        if status != 0:
+            print("select failed: %d" % status)
+            sys.exit(1)
+    elif args.command == "errors":
+        (i2c, crc, framing) = box.get_errors()
+        print("i2c: %d, crc: %d, framing: %d" % (i2c, crc, framing))
+    elif args.command == "reset-errors":
+        box.reset_errors()
+    elif args.command == "boot":
+        for (name, us) in box.get_boot_times():
+            if us == 0:
+                print("%-15s -" % name)
+            else:
+                print("%-15s %8.1f ms" % (name, us / 1000))
+    elif args.command == "mem":
+        m = box.get_mem_stats()
+        print("static:      %6d bytes" % m["static"])
+        print("heap:        %6d of %6d bytes at most, %d in use now" % (m["heap_high_water"], m["heap_size"], m["heap_in_use"]))
+        print("core0 stack: %6d of %6d bytes at most" % (m["stack0_high_water"], m["stack0_size"]))
+        print("core1 stack: %6d of %6d bytes at most" % (m["stack1_high_water"], m["stack1_size"]))
+    elif args.command == "tasks":
+        print("%-16s %9s %9s %9s %9s %9s %8s" % ("task", "period", "runs", "avg us", "max us", "late us", "skipped"))
+        for t in box.get_task_stats():
+            period = "%d ms" % (t["period_us"] // 1000) if t["period_us"] else "once"
+            avg = t["total_us"] / t["runs"] if t["runs"] else 0
+            print(
+                "%-16s %9s %9d %9.1f %9d %9d %8d"
+                % (t["name"], period, t["runs"], avg, t["max_us"], t["max_late_us"], t["skipped"])
+            )
+    elif args.command == "bench":
+        status = box.pd_bench_start(args.repeats)
+        if status != 0:
+            sys.exit("bench failed to start (%d), is a source with 2+ PDOs attached?" % status)
+        state = PD_BENCH_RUNNING
+        while state == PD_BENCH_RUNNING:
+            time.sleep(0.5)
+            (state, fingerprint, run, repeats, results) = box.pd_bench_results()
+        print("source %08x, %d runs%s" % (fingerprint, run, " (stopped)" if state == PD_BENCH_ABORTED else ""))
+        print("%6s %8s %8s %8s %8s %8s %8s %8s %8s" % ("PDO", "samples", "min ms", "avg ms", "max ms", "rejects", "resets", "t/o", "i2c err"))
+        for r in results:
+            print(
+                "%5dV %8d %8.1f %8.1f %8.1f %8d %8d %8d %8d"
+                % (r["mv"] // 1000, r["samples"], r["min_us"] / 1000.0, r["avg_us"] / 1000.0, r["max_us"] / 1000.0,
+                   r["rejects"], r["resets"], r["timeouts"], r["i2c_errors"])
+            )
+    elif args.command == "events":
+        (events, dropped) = box.evlog_read()
+        for (boot, ms, event, a, b) in events:
+            if event == "boot":
+                detail = "after a watchdog reset" if a else ""
+            elif event == "contract":
+                detail = "%.1fV %.2fA" % (b / 1000.0, a * 0.05) if b else "none"
+            elif event in ("select", "restore"):
+                detail = "PDO %d%s" % (a, "" if b == 0 else ", failed (%d)" % struct.unpack("<h", struct.pack("<H", b))[0])
+            elif event == "i2c-errors":
+                detail = "%d errors in %d s" % (b, a)
+            elif event == "sequence":
+                detail = ("started, %d runs" % b) if a else ("ended after %d runs" % b)
+            elif event == "brownout":
+                detail = ("VSYS %.2fV" % (b / 1000.0)) if a else ("over, VSYS was down to %.2fV" % (b / 1000.0))
+            elif event == "overtemp":
+                detail = "%s%.1fC" % ("" if a else "over, ", b / 10.0)
+            else:
+                detail = ""
+            print("boot %5d %10.3f s  %-10s %s" % (boot, ms / 1000.0, event, detail))
+        if dropped:
+            print("(%d events dropped since boot)" % dropped)
+    elif args.command == "textbench":
+        (khz, results) = box.text_bench(args.passes)
+        print("at %d MHz, us per pass over the main window's text:" % (khz // 1000))
+        print("%5s %10s %10s %8s" % ("scale", "bitmap", "runs", "speedup"))
+        for (scale, bitmap_us, runs_us) in results:
+            print("%5d %10d %10d %7.1fx" % (scale, bitmap_us, runs_us, bitmap_us / runs_us if runs_us else 0))
+    elif args.command == "sequence":
+        if args.stop:
+            box.pd_seq_control(False)
+            return
+        if args.script:
+            steps = []
+            for step in args.script.split(","):
+                (volts, seconds) = step.split(":")
+                steps.append((int(round(float(volts) * 1000)), int(round(float(seconds) * 1000))))
+            status = box.pd_seq_write(steps, args.repeats)
+            if status != 0:
+                sys.exit("the box didn't take the script (%d)" % status)
+        if args.no_start:
+            return
+        status = box.pd_seq_control(True)
+        if status != 0:
+            sys.exit("sequence failed to start (%d), does the source offer all its voltages?" % status)
+        print("%5s %4s %6s %10s %11s  %s" % ("run", "step", "V", "jitter us", "contract ms", "result"))
+        seen = 0
+        try:
+            while True:
+                time.sleep(0.2)
+                (status, transitions) = box.pd_seq_status(seen)
+                if status["first"] > seen:
+                    print("(%d transitions not shown)" % (status["first"] - seen))
+                for (i, t) in enumerate(transitions):
+                    if t["result"] == 0:
+                        break
+                    print(
+                        "%5d %4d %6.1f %10d %11s  %s"
+                        % (t["run"], t["step"], t["mv"] / 1000.0, t["jitter_us"],
+                           "%.1f" % (t["contract_us"] / 1000.0) if t["result"] == 1 else "-",
+                           PD_SEQ_RESULTS[t["result"]] if t["result"] < len(PD_SEQ_RESULTS) else t["result"])
+                    )
+                    seen = status["first"] + i + 1
+                if (status["state"] != PD_SEQ_RUNNING) and (seen >= status["transitions"]):
+                    break
+        except KeyboardInterrupt:
+            box.pd_seq_control(False)
+            (status, _) = box.pd_seq_status(seen)
+        if status["transitions"] > 0:
+            print(
+                "%d transitions, jitter us: min %d, mean %d, max %d"
+                % (status["transitions"], status["jitter_min_us"], status["jitter_mean_us"], status["jitter_max_us"])
+            )
+    elif args.command == "record":
+        box.replay_control(REPLAY_RECORDING)
+        input("recording, use the knob and hit Enter when done: ")
+        box.replay_control(REPLAY_IDLE)
+        events = box.replay_get_events()
+        with open(args.file, "w") as f:
+            json.dump({"events": events}, f, indent=1)
+        print("recorded %d events" % len(events))
+    elif args.command == "replay":
+        with open(args.file) as f:
+            events = json.load(f)["events"]
+        box.replay_set_events(events)
+        box.replay_control(REPLAY_REPLAYING_FAST if args.fast else REPLAY_REPLAYING)
+        while box.replay_status()[0] != REPLAY_IDLE:
+            time.sleep(0.2)
+        draws = box.replay_get_draw_times()
+        print("%d events, %d draws" % (len(events), len(draws)))
+        if draws:
+            s = sorted(draws)
+            print(
+                "draw us: min %d, median %d, p95 %d, max %d, mean %.0f"
+                % (s[0], s[len(s) // 2], s[(len(s) * 95) // 100], s[-1], sum(s) / len(s))
+            )
+        if args.save:
+            with open(args.save, "w") as f:
+                json.dump({"events": len(events), "fast": args.fast, "draw_us": draws}, f)
+    elif args.command == "xip":
+        (_, _, frames_before, _) = box.get_xip_stats(reset=True)
+        time.sleep(args.seconds)
+        (hits, accesses, frames, hot_in_ram) = box.get_xip_stats()
+        misses = accesses - hits
+        frames -= frames_before
+        print("hot code in %s" % ("SRAM" if hot_in_ram else "flash"))
+        print("%d accesses, %d hits, %d misses" % (accesses, hits, misses))
+        if accesses > 0:
+            print("hit rate: %.2f%%" % (100.0 * hits / accesses))
+        if frames > 0:
+            print("%d frames drawn, %.0f misses per frame" % (frames, misses / frames))
+    elif args.command == "telemetry":
+        box.subscribe_telemetry(args.period_ms)
+        try:
+            while True:
+                sample = box.read_telemetry()
+                if sample is not None:
+                    (ms, mv, ma, errors) = sample
+                    print("%10d ms: %.2fV %.2fA (%d i2c errors)" % (ms, mv / 1000, ma / 1000, errors))
+        except KeyboardInterrupt:
+            box.subscribe_telemetry(0)
+
+
+if __name__ == "__main__":
+    main()